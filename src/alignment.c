@@ -14,9 +14,13 @@
 #include <string.h>
 #include <ctype.h> // tolower
 #include <assert.h>
+#include <limits.h> // LONG_MIN, LONG_MAX
+#include <stdint.h>
+#include <pthread.h>
 
 #include "alignment.h"
 #include "alignment_macros.h"
+#include "alignment_simd.h"
 
 const char align_col_mismatch[] = "\033[92m"; // Mismatch (GREEN)
 const char align_col_indel[] = "\033[91m"; // Insertion / deletion (RED)
@@ -24,6 +28,732 @@ const char align_col_indel[] = "\033[91m"; // Insertion / deletion (RED)
 const char align_col_context[] = "\033[95m";
 const char align_col_stop[] = "\033[0m";
 
+// Codes of len characters of seq, giving new characters the next code
+static void aligner_encode_seq(aligner_profile_t *prof, const scoring_t *scoring,
+                               const char *seq, size_t len,
+                               uint8_t **codes, size_t *capacity)
+{
+  size_t i;
+  int c;
+
+  if(*capacity < len+1) {
+    *capacity = ROUNDUP2POW(len+1);
+    *codes = realloc(*codes, *capacity);
+    if(*codes == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for(i = 0; i < len; i++)
+  {
+    c = scoring->case_sensitive ? (uint8_t)seq[i] : tolower((uint8_t)seq[i]);
+    if(prof->codes[c] < 0) {
+      prof->symbols[prof->ncodes] = (char)c;
+      prof->codes[c] = (int)prof->ncodes++;
+    }
+    (*codes)[i] = (uint8_t)prof->codes[c];
+  }
+}
+
+// Score of code i against code j under scoring, as kept in the table
+static score_t aligner_profile_entry(const aligner_profile_t *prof,
+                                     const scoring_t *scoring,
+                                     size_t i, size_t j)
+{
+  bool is_match;
+  int substitution_penalty;
+  scoring_lookup(scoring, prof->symbols[i], prof->symbols[j],
+                 &substitution_penalty, &is_match);
+  return scoring->no_mismatches && !is_match ? PROFILE_NO_MATCH
+                                             : substitution_penalty;
+}
+
+// Whether the table built so far still matches scoring
+static bool aligner_profile_current(const aligner_profile_t *prof,
+                                    const scoring_t *scoring)
+{
+  size_t i, j, n = prof->table_codes;
+
+  for(i = 0; i < n; i++)
+    for(j = 0; j < n; j++)
+      if(prof->table[i*n+j] != aligner_profile_entry(prof, scoring, i, j))
+        return false;
+
+  return true;
+}
+
+// Encode seq_a and seq_b and make sure the table covers all of their codes.
+// Only the table and profile rows depend on the scoring.
+static void aligner_encode(aligner_t *aligner,
+                           const char *seq_a, const char *seq_b,
+                           size_t len_a, size_t len_b,
+                           const scoring_t *scoring)
+{
+  aligner_profile_t *prof = &aligner->profile;
+  size_t i, j, n;
+
+  scoring_check_fits(scoring, len_a, len_b);
+
+  if(!prof->loaded || prof->case_sensitive != scoring->case_sensitive ||
+     prof->len != len_a || memcmp(prof->seq, seq_a, len_a) != 0)
+  {
+    if(prof->seq_capacity < len_a+1) {
+      prof->seq_capacity = ROUNDUP2POW(len_a+1);
+      prof->seq = realloc(prof->seq, prof->seq_capacity);
+      if(prof->seq == NULL) {
+        fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+        exit(EXIT_FAILURE);
+      }
+    }
+    memcpy(prof->seq, seq_a, len_a);
+    prof->len = len_a;
+    prof->loaded = true;
+    prof->case_sensitive = scoring->case_sensitive;
+    memset(prof->codes, 0xff, sizeof(prof->codes));
+    prof->ncodes = prof->table_codes = prof->nrows = 0;
+    aligner_encode_seq(prof, scoring, seq_a, len_a,
+                       &prof->codes_a, &prof->codes_a_capacity);
+  }
+
+  aligner_encode_seq(prof, scoring, seq_b, len_b,
+                     &prof->codes_b, &prof->codes_b_capacity);
+
+  // Scores changed since the table was built: rebuild it and the rows
+  if(!aligner_profile_current(prof, scoring))
+    prof->table_codes = prof->nrows = 0;
+
+  if(prof->table_codes < prof->ncodes)
+  {
+    n = prof->ncodes;
+    prof->table = realloc(prof->table, n * n * sizeof(score_t));
+    if(prof->table == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+
+    for(i = 0; i < n; i++)
+      for(j = 0; j < n; j++)
+        prof->table[i*n+j] = aligner_profile_entry(prof, scoring, i, j);
+
+    prof->table_codes = n;
+  }
+}
+
+// Score of seq_a[x] against seq_b[y], from the encoded sequences
+static inline score_t aligner_substitution(const aligner_t *aligner,
+                                           size_t x, size_t y)
+{
+  const aligner_profile_t *prof = &aligner->profile;
+  return prof->table[prof->codes_a[x]*prof->ncodes + prof->codes_b[y]];
+}
+
+// Build the query profile rows for any new codes.  Rows are only ever added
+// here, so pointers to them stay valid while a matrix is filled.
+static void aligner_profile_load(aligner_profile_t *prof)
+{
+  size_t x, j, len = prof->len, n = prof->ncodes;
+
+  if(prof->nrows == n) return;
+
+  if(n * len > prof->rows_capacity) {
+    prof->rows_capacity = ROUNDUP2POW(n * len);
+    prof->rows = realloc(prof->rows, prof->rows_capacity * sizeof(score_t));
+    if(prof->rows == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  for(j = prof->nrows; j < n; j++) {
+    score_t *row = prof->rows + j*len;
+    for(x = 0; x < len; x++) row[x] = prof->table[prof->codes_a[x]*n + j];
+  }
+
+  prof->nrows = n;
+}
+
+// Scores of the query against seq_b[y]
+static inline const score_t* aligner_profile_row(const aligner_profile_t *prof,
+                                                 size_t y)
+{
+  return prof->rows + (size_t)prof->codes_b[y] * prof->len;
+}
+
+// Matrix alignment_reverse_move() would step into from a cell with score,
+// given the scores of the cell it came from and the penalty from each of them.
+// Branch free (GAP_A is 1, GAP_B 2, MATCH 0) so that alignment_trace_row()
+// vectorises.
+static inline uint8_t alignment_trace_source(score_t score, score_t match,
+                                             score_t gap_a, score_t gap_b,
+                                             int match_penalty,
+                                             int gap_a_penalty,
+                                             int gap_b_penalty,
+                                             bool gap_a_allowed,
+                                             bool gap_b_allowed)
+{
+  int from_a = gap_a_allowed & (gap_a + gap_a_penalty == score);
+  int from_b = gap_b_allowed & (gap_b + gap_b_penalty == score) & !from_a;
+  int none = !(from_a | from_b | (match + match_penalty == score));
+  return (uint8_t)(from_a | from_b << 1 | none * TRACE_NONE);
+}
+
+// Record the traceback bits of cells seq_i_start+1 to seq_i_end of row
+// seq_j+1 once they are filled: for each matrix, the one
+// alignment_reverse_move() would step back into.  Kept out of the fill loops,
+// which are bound by the dependency along the row; no cell here depends on
+// another, so the loop vectorises.
+static void alignment_trace_row(aligner_t *aligner, size_t seq_j,
+                                size_t seq_i_start, size_t seq_i_end)
+{
+  const score_t *match_scores = aligner->match_scores;
+  const score_t *gap_a_scores = aligner->gap_a_scores;
+  const score_t *gap_b_scores = aligner->gap_b_scores;
+  uint8_t *traceback = aligner->traceback;
+  const scoring_t *scoring = aligner->scoring;
+  const size_t row_step = aligner->row_step;
+  const size_t len_i = aligner->score_width-1, len_j = aligner->score_height-1;
+  const int gap_open_penalty = scoring->gap_extend + scoring->gap_open;
+  const int gap_extend_penalty = scoring->gap_extend;
+  const bool free_end = scoring->no_end_gap_penalty;
+  const score_t *sub_row = aligner_profile_row(&aligner->profile, seq_j);
+
+  // Gaps end free in the last row and column.  Without gaps, steps back into
+  // a gap only reach the first row or column, or run along the last.
+  const bool last_row = seq_j+1 == len_j;
+  const int gap_b_open = last_row && free_end ? 0 : gap_open_penalty;
+  const int gap_b_extend = last_row && free_end ? 0 : gap_extend_penalty;
+  const bool gap_b_up = !scoring->no_gaps_in_b || seq_j == 0;
+  const bool gap_b_left = !scoring->no_gaps_in_b || last_row;
+
+  size_t seq_i = seq_i_start, seq_i_run, index, index_up;
+  int substitution_penalty, gap_a_open, gap_a_extend;
+  bool last_col, gap_a_before, gap_a_up, forbidden;
+  uint8_t from_match, from_gap_a, from_gap_b;
+
+  index = aligner_index(aligner, seq_i_start+1, seq_j+1);
+  index_up = index - row_step;
+
+  // The first and last columns each take a run of their own, the cells
+  // between them all have the same penalties
+  while(seq_i < seq_i_end)
+  {
+    seq_i_run = seq_i == 0 ? 1 : MAX2(seq_i+1, MIN2(seq_i_end, len_i-1));
+    last_col = seq_i_run == len_i;
+    gap_a_open = last_col && free_end ? 0 : gap_open_penalty;
+    gap_a_extend = last_col && free_end ? 0 : gap_extend_penalty;
+    gap_a_before = !scoring->no_gaps_in_a || seq_i == 0;
+    gap_a_up = !scoring->no_gaps_in_a || last_col;
+
+    for(; seq_i < seq_i_run; seq_i++, index++, index_up++)
+    {
+      // Forbidden substitutions were set to min, with no path in
+      substitution_penalty = sub_row[seq_i];
+      forbidden = substitution_penalty == PROFILE_NO_MATCH;
+      substitution_penalty = forbidden ? 0 : substitution_penalty;
+
+      from_match
+        = alignment_trace_source(match_scores[index],
+                                 match_scores[index_up-1],
+                                 gap_a_scores[index_up-1],
+                                 gap_b_scores[index_up-1],
+                                 substitution_penalty, substitution_penalty,
+                                 substitution_penalty, gap_a_before, gap_b_up);
+      from_match = forbidden ? TRACE_NONE : from_match;
+
+      from_gap_a
+        = alignment_trace_source(gap_a_scores[index],
+                                 match_scores[index_up],
+                                 gap_a_scores[index_up],
+                                 gap_b_scores[index_up],
+                                 gap_a_open, gap_a_extend, gap_a_open,
+                                 gap_a_up, gap_b_up);
+
+      from_gap_b
+        = alignment_trace_source(gap_b_scores[index],
+                                 match_scores[index-1],
+                                 gap_a_scores[index-1],
+                                 gap_b_scores[index-1],
+                                 gap_b_open, gap_b_open, gap_b_extend,
+                                 gap_a_before, gap_b_left);
+
+      traceback[index] = (uint8_t)(from_match << (2*MATCH) |
+                                   from_gap_a << (2*GAP_A) |
+                                   from_gap_b << (2*GAP_B));
+    }
+  }
+}
+
+// The diagonal kernel below only beats the scalar rows with at least 8 lanes
+// (AVX2): with SSE2's 4, moving cells in and out of the lanes costs more than
+// the vector arithmetic saves, so those builds keep the scalar fill.
+#if defined(SEQ_ALIGN_SIMD) && SIMD_LANES_I32 >= 8
+  #define ALIGN_FILL_DIAGONALS 1
+#endif
+
+#ifdef ALIGN_FILL_DIAGONALS
+// Fill cells (x,y) with x0 < x <= x1 and y0 < y <= y1, whose neighbours above
+// and to the left are already filled, working on SIMD_LANES_I32 rows at a
+// time.  Lane r handles row y+r and runs one column behind lane r-1, so each
+// step computes one anti-diagonal of the strip: the cell above comes from the
+// neighbouring lane's previous step, the cell to the left from this lane's
+// previous step and the diagonal from two steps back.  Results are stored
+// row-major, exactly as alignment_fill_row_cells() would leave them, and the
+// traceback bits of each row recorded once the strip is done.
+static void alignment_fill_diagonals(aligner_t *aligner, score_t min,
+                                     size_t x0, size_t x1,
+                                     size_t y0, size_t y1)
+{
+  score_t *match_scores = aligner->match_scores;
+  score_t *gap_a_scores = aligner->gap_a_scores;
+  score_t *gap_b_scores = aligner->gap_b_scores;
+  const scoring_t *scoring = aligner->scoring;
+  const size_t nlanes = SIMD_LANES_I32, score_width = aligner->score_width;
+  const size_t len_i = score_width-1, len_j = aligner->score_height-1;
+  const size_t width = x1-x0;
+  size_t y, t, r, r_lo, r_hi, nrows, nsteps, index, index_up;
+
+  const simd_t vmin = simd_set1_i32(min);
+  const simd_t vopen = simd_set1_i32(scoring->gap_extend + scoring->gap_open);
+  const simd_t vextend = simd_set1_i32(scoring->gap_extend);
+  const simd_t vlast_i = simd_set1_i32((int)len_i-1-(int)x0);
+  const simd_t vnone = simd_set1_i32(-1), vwidth = simd_set1_i32((int)width);
+
+  const score_t *sub_rows[SIMD_LANES_I32];
+  score_t substitution_penalty;
+
+  simd_lanes_t lanes, rows, last_row, sub, forbid, out_m, out_a, out_b;
+  simd_t seq_i, active, last_col, new_m, new_a, new_b, free_gap;
+  simd_t left_m, left_a, left_b, diag_m, diag_a, diag_b, up_m, up_a, up_b;
+
+  for(r = 0; r < nlanes; r++) lanes.i32[r] = (int32_t)r;
+
+  for(y = y0+1; y <= y1; y += nlanes)
+  {
+    nrows = MIN2(nlanes, y1+1-y);
+    nsteps = width + nrows - 1;
+    index_up = (y-1)*score_width + x0; // row above this strip, from column x0
+
+    // Left and diagonal neighbours both start on column x0
+    for(r = 0; r < nlanes; r++)
+    {
+      rows.i32[r] = r < nrows ? -1 : 0;
+      last_row.i32[r] = y+r == len_j ? -1 : 0;
+      sub_rows[r] = r < nrows ? aligner_profile_row(&aligner->profile, y-1+r)+x0
+                              : NULL;
+      index = (y+r)*score_width + x0;
+      out_m.i32[r] = r < nrows ? match_scores[index] : min;
+      out_a.i32[r] = r < nrows ? gap_a_scores[index] : min;
+      out_b.i32[r] = r < nrows ? gap_b_scores[index] : min;
+    }
+
+    diag_m = left_m = out_m.v;
+    diag_a = left_a = out_a.v;
+    diag_b = left_b = out_b.v;
+
+    for(t = 0; t < nsteps; t++)
+    {
+      // Lane r aligns seq_a[x0+t-r] with seq_b[y-1+r]
+      r_lo = t >= width ? t-width+1 : 0;
+      r_hi = MIN2(t, nrows-1);
+
+      memset(&sub, 0, sizeof(sub));
+      memset(&forbid, 0, sizeof(forbid));
+
+      for(r = r_lo; r <= r_hi; r++)
+      {
+        substitution_penalty = sub_rows[r][t-r];
+        forbid.i32[r] = substitution_penalty == PROFILE_NO_MATCH ? -1 : 0;
+        sub.i32[r] = forbid.i32[r] ? 0 : substitution_penalty;
+      }
+
+      seq_i = simd_sub_i32(simd_set1_i32((int)t), lanes.v);
+      active = simd_and(simd_and(simd_cmpgt_i32(seq_i, vnone),
+                                 simd_cmpgt_i32(vwidth, seq_i)),
+                        rows.v);
+      last_col = simd_cmpeq_i32(seq_i, vlast_i);
+
+      // The first lane reads the row above the strip
+      diag_m = simd_shl_i32(diag_m, t <= width ? match_scores[index_up+t] : min);
+      diag_a = simd_shl_i32(diag_a, t <= width ? gap_a_scores[index_up+t] : min);
+      diag_b = simd_shl_i32(diag_b, t <= width ? gap_b_scores[index_up+t] : min);
+      up_m = simd_shl_i32(left_m, t < width ? match_scores[index_up+t+1] : min);
+      up_a = simd_shl_i32(left_a, t < width ? gap_a_scores[index_up+t+1] : min);
+      up_b = simd_shl_i32(left_b, t < width ? gap_b_scores[index_up+t+1] : min);
+
+      // match_scores from [i-1][j-1]
+      new_m = simd_max_i32(simd_max_i32(diag_m, diag_a), diag_b);
+      new_m = simd_max_i32(simd_add_i32(new_m, sub.v), vmin);
+      if(scoring->no_mismatches) new_m = simd_blend(forbid.v, vmin, new_m);
+
+      // gap_a_scores from [i][j-1]
+      new_a = simd_max_i32(simd_add_i32(up_m, vopen), simd_add_i32(up_a, vextend));
+      new_a = simd_max_i32(simd_max_i32(new_a, simd_add_i32(up_b, vopen)), vmin);
+      if(scoring->no_end_gap_penalty) {
+        free_gap = simd_max_i32(simd_max_i32(up_m, up_a), up_b);
+        new_a = simd_blend(last_col, free_gap, new_a);
+      }
+      if(scoring->no_gaps_in_a) new_a = simd_blend(last_col, new_a, vmin);
+
+      // gap_b_scores from [i-1][j]
+      new_b = simd_max_i32(simd_add_i32(left_m, vopen), simd_add_i32(left_a, vopen));
+      new_b = simd_max_i32(simd_max_i32(new_b, simd_add_i32(left_b, vextend)), vmin);
+      if(scoring->no_end_gap_penalty) {
+        free_gap = simd_max_i32(simd_max_i32(left_m, left_a), left_b);
+        new_b = simd_blend(last_row.v, free_gap, new_b);
+      }
+      if(scoring->no_gaps_in_b) new_b = simd_blend(last_row.v, new_b, vmin);
+
+      // Lanes that have not started or have finished keep their last cell
+      diag_m = left_m; diag_a = left_a; diag_b = left_b;
+      left_m = simd_blend(active, new_m, left_m);
+      left_a = simd_blend(active, new_a, left_a);
+      left_b = simd_blend(active, new_b, left_b);
+
+      out_m.v = left_m;
+      out_a.v = left_a;
+      out_b.v = left_b;
+
+      for(r = r_lo; r <= r_hi; r++)
+      {
+        index = (y+r)*score_width + x0+t-r+1;
+        match_scores[index] = out_m.i32[r];
+        gap_a_scores[index] = out_a.i32[r];
+        gap_b_scores[index] = out_b.i32[r];
+      }
+    }
+
+    for(r = 0; r < nrows; r++) alignment_trace_row(aligner, y+r-1, x0, x1);
+  }
+}
+#endif /* ALIGN_FILL_DIAGONALS */
+
+// Fill n cells of a row from index onwards, none of them in the last row or
+// column, with sub_row holding their substitution scores.  Away from the last
+// row and column the recurrences only depend on no_mismatches, no_gaps_in_a
+// and no_gaps_in_b, so there is a copy of the loop for each combination with
+// the tests resolved at compile time.
+#define ALIGNMENT_FILL_ROW(name,no_mismatches,no_gaps_in_a,no_gaps_in_b)      \
+  static void name(aligner_t *aligner, const score_t *sub_row,                 \
+                   size_t index, size_t n, score_t min,                        \
+                   int gap_open_penalty, int gap_extend_penalty)               \
+  {                                                                            \
+    score_t *match_row = aligner->match_scores + index;                        \
+    score_t *gap_a_row = aligner->gap_a_scores + index;                        \
+    score_t *gap_b_row = aligner->gap_b_scores + index;                        \
+    const score_t *match_up = match_row - aligner->row_step;                   \
+    const score_t *gap_a_up = gap_a_row - aligner->row_step;                   \
+    const score_t *gap_b_up = gap_b_row - aligner->row_step;                   \
+    size_t k;                                                                  \
+    score_t substitution_penalty, new_m, new_a, new_b, up_m, up_a, up_b;       \
+                                                                               \
+    /* The cells to the left and up-left are carried along in locals, so */   \
+    /* each step only reads the row above and writes this one */              \
+    score_t left_m = match_row[-1], left_a = gap_a_row[-1];                    \
+    score_t left_b = gap_b_row[-1];                                            \
+    score_t diag_m = match_up[-1], diag_a = gap_a_up[-1];                      \
+    score_t diag_b = gap_b_up[-1];                                             \
+                                                                               \
+    for(k = 0; k < n; k++)                                                     \
+    {                                                                          \
+      substitution_penalty = sub_row[k];                                       \
+      up_m = match_up[k];                                                      \
+      up_a = gap_a_up[k];                                                      \
+      up_b = gap_b_up[k];                                                      \
+                                                                               \
+      if(no_mismatches && substitution_penalty == PROFILE_NO_MATCH)            \
+        new_m = min;                                                           \
+      else                                                                     \
+        new_m = MAX4(diag_m + substitution_penalty,                            \
+                     diag_a + substitution_penalty,                            \
+                     diag_b + substitution_penalty,                            \
+                     min);                                                     \
+                                                                               \
+      if(no_gaps_in_a)                                                         \
+        new_a = min;                                                           \
+      else                                                                     \
+        new_a = MAX4(up_m + gap_open_penalty,                                  \
+                     up_a + gap_extend_penalty,                                \
+                     up_b + gap_open_penalty,                                  \
+                     min);                                                     \
+                                                                               \
+      if(no_gaps_in_b)                                                         \
+        new_b = min;                                                           \
+      else                                                                     \
+        new_b = MAX4(left_m + gap_open_penalty,                                \
+                     left_a + gap_open_penalty,                                \
+                     left_b + gap_extend_penalty,                              \
+                     min);                                                     \
+                                                                               \
+      match_row[k] = left_m = new_m;                                           \
+      gap_a_row[k] = left_a = new_a;                                           \
+      gap_b_row[k] = left_b = new_b;                                           \
+      diag_m = up_m;                                                           \
+      diag_a = up_a;                                                           \
+      diag_b = up_b;                                                           \
+    }                                                                          \
+  }
+
+ALIGNMENT_FILL_ROW(alignment_fill_row_000, 0, 0, 0)
+ALIGNMENT_FILL_ROW(alignment_fill_row_001, 0, 0, 1)
+ALIGNMENT_FILL_ROW(alignment_fill_row_010, 0, 1, 0)
+ALIGNMENT_FILL_ROW(alignment_fill_row_011, 0, 1, 1)
+ALIGNMENT_FILL_ROW(alignment_fill_row_100, 1, 0, 0)
+ALIGNMENT_FILL_ROW(alignment_fill_row_101, 1, 0, 1)
+ALIGNMENT_FILL_ROW(alignment_fill_row_110, 1, 1, 0)
+ALIGNMENT_FILL_ROW(alignment_fill_row_111, 1, 1, 1)
+
+typedef void (*alignment_fill_row_f)(aligner_t *aligner,
+                                     const score_t *sub_row,
+                                     size_t index, size_t n, score_t min,
+                                     int gap_open_penalty,
+                                     int gap_extend_penalty);
+
+// Indexed by no_mismatches*4 + no_gaps_in_a*2 + no_gaps_in_b
+static const alignment_fill_row_f alignment_fill_rows[8] = {
+  alignment_fill_row_000, alignment_fill_row_001,
+  alignment_fill_row_010, alignment_fill_row_011,
+  alignment_fill_row_100, alignment_fill_row_101,
+  alignment_fill_row_110, alignment_fill_row_111};
+
+// Fill cells seq_i_start+1 to seq_i_end of row seq_j+1, whose neighbours
+// above and to the left are already filled
+static void alignment_fill_row_cells(aligner_t *aligner,
+                                     alignment_fill_row_f fill_row,
+                                     score_t min, size_t seq_j,
+                                     size_t seq_i_start, size_t seq_i_end)
+{
+  score_t *match_scores = aligner->match_scores;
+  score_t *gap_a_scores = aligner->gap_a_scores;
+  score_t *gap_b_scores = aligner->gap_b_scores;
+  const scoring_t *scoring = aligner->scoring;
+  const size_t row_step = aligner->row_step;
+  const size_t len_i = aligner->score_width-1, len_j = aligner->score_height-1;
+  const int gap_open_penalty = scoring->gap_extend + scoring->gap_open;
+  const int gap_extend_penalty = scoring->gap_extend;
+
+  size_t seq_i, seq_i_interior;
+  size_t index, index_left, index_up, index_upleft;
+  const score_t *sub_row;
+  int substitution_penalty;
+
+  sub_row = aligner_profile_row(&aligner->profile, seq_j);
+
+  // Everything before the last column (or nothing on the last row) goes
+  // through the specialised loop, the rest cell by cell below
+  seq_i_interior = seq_j+1 < len_j ? MAX2(seq_i_start, MIN2(seq_i_end, len_i-1))
+                                   : seq_i_start;
+
+  if(seq_i_interior > seq_i_start)
+  {
+    fill_row(aligner, sub_row + seq_i_start,
+             aligner_index(aligner, seq_i_start+1, seq_j+1),
+             seq_i_interior - seq_i_start, min,
+             gap_open_penalty, gap_extend_penalty);
+  }
+
+  index = aligner_index(aligner, seq_i_interior+1, seq_j+1);
+  index_left = index-1;
+  index_up = index-row_step;
+  index_upleft = index_up-1;
+
+  for(seq_i = seq_i_interior; seq_i < seq_i_end; seq_i++)
+  {
+    // Update match_scores[i][j] with position [i-1][j-1]
+    // substitution penalty
+    substitution_penalty = sub_row[seq_i];
+
+    if(substitution_penalty == PROFILE_NO_MATCH)
+    {
+      match_scores[index] = min;
+    }
+    else
+    {
+      // substitution
+      // 1) continue alignment
+      // 2) close gap in seq_a
+      // 3) close gap in seq_b
+      match_scores[index]
+        = MAX4(match_scores[index_upleft] + substitution_penalty,
+               gap_a_scores[index_upleft] + substitution_penalty,
+               gap_b_scores[index_upleft] + substitution_penalty,
+               min);
+    }
+
+    // Long arithmetic since some INTs are set to min and penalty is -ve
+    // (adding as ints would cause an integer overflow)
+
+    // Update gap_a_scores[i][j] from position [i][j-1]
+    if(seq_i == len_i-1 && scoring->no_end_gap_penalty)
+    {
+      gap_a_scores[index] = MAX3(match_scores[index_up],
+                                 gap_a_scores[index_up],
+                                 gap_b_scores[index_up]);
+    }
+    else if(!scoring->no_gaps_in_a || seq_i == len_i-1)
+    {
+      gap_a_scores[index]
+        = MAX4(match_scores[index_up] + gap_open_penalty,
+               gap_a_scores[index_up] + gap_extend_penalty,
+               gap_b_scores[index_up] + gap_open_penalty,
+               min);
+    }
+    else
+      gap_a_scores[index] = min;
+
+    // Update gap_b_scores[i][j] from position [i-1][j]
+    if(seq_j == len_j-1 && scoring->no_end_gap_penalty)
+    {
+      gap_b_scores[index] = MAX3(match_scores[index_left],
+                                 gap_a_scores[index_left],
+                                 gap_b_scores[index_left]);
+    }
+    else if(!scoring->no_gaps_in_b || seq_j == len_j-1)
+    {
+      gap_b_scores[index]
+        = MAX4(match_scores[index_left] + gap_open_penalty,
+               gap_a_scores[index_left] + gap_open_penalty,
+               gap_b_scores[index_left] + gap_extend_penalty,
+               min);
+    }
+    else
+      gap_b_scores[index] = min;
+
+    index++;
+    index_left++;
+    index_up++;
+    index_upleft++;
+  }
+
+  alignment_trace_row(aligner, seq_j, seq_i_start, seq_i_end);
+}
+
+// Fill cells (x,y) with x0 < x <= x1 and y0 < y <= y1, whose neighbours above
+// and to the left are already filled
+static void alignment_fill_block(aligner_t *aligner,
+                                 alignment_fill_row_f fill_row, score_t min,
+                                 size_t x0, size_t x1, size_t y0, size_t y1)
+{
+#ifdef ALIGN_FILL_DIAGONALS
+  (void)fill_row;
+  alignment_fill_diagonals(aligner, min, x0, x1, y0, y1);
+#else
+  size_t seq_j;
+  for(seq_j = y0; seq_j < y1; seq_j++)
+    alignment_fill_row_cells(aligner, fill_row, min, seq_j, x0, x1);
+#endif
+}
+
+// Threaded fills cut the matrices into tiles of this many rows and columns
+#define ALIGN_TILE 256
+
+// Tiles of a threaded fill.  A tile is queued once the tiles above and to its
+// left are filled; threads take tiles from the queue until all are filled.
+typedef struct
+{
+  aligner_t *aligner;
+  alignment_fill_row_f fill_row;
+  score_t min;
+  size_t tiles_x, tiles_y, ntiles, nfilled;
+  uint8_t *waiting; // per tile: how many of the tiles above/left are not filled
+  size_t *queue, queue_start, queue_end;
+  pthread_mutex_t lock;
+  pthread_cond_t tile_ready;
+} alignment_wavefront_t;
+
+static void alignment_wavefront_push(alignment_wavefront_t *wf, size_t tile)
+{
+  if(--wf->waiting[tile] == 0) wf->queue[wf->queue_end++] = tile;
+}
+
+static void* alignment_wavefront_run(void *arg)
+{
+  alignment_wavefront_t *wf = arg;
+  const size_t len_i = wf->aligner->score_width-1;
+  const size_t len_j = wf->aligner->score_height-1;
+  size_t tile, tx, ty;
+
+  pthread_mutex_lock(&wf->lock);
+
+  while(1)
+  {
+    while(wf->queue_start == wf->queue_end && wf->nfilled < wf->ntiles)
+      pthread_cond_wait(&wf->tile_ready, &wf->lock);
+
+    if(wf->queue_start == wf->queue_end) break;
+
+    tile = wf->queue[wf->queue_start++];
+    tx = tile % wf->tiles_x;
+    ty = tile / wf->tiles_x;
+    pthread_mutex_unlock(&wf->lock);
+
+    alignment_fill_block(wf->aligner, wf->fill_row, wf->min,
+                         tx*ALIGN_TILE, MIN2((tx+1)*ALIGN_TILE, len_i),
+                         ty*ALIGN_TILE, MIN2((ty+1)*ALIGN_TILE, len_j));
+
+    pthread_mutex_lock(&wf->lock);
+    wf->nfilled++;
+    if(tx+1 < wf->tiles_x) alignment_wavefront_push(wf, tile+1);
+    if(ty+1 < wf->tiles_y) alignment_wavefront_push(wf, tile+wf->tiles_x);
+    pthread_cond_broadcast(&wf->tile_ready);
+  }
+
+  pthread_mutex_unlock(&wf->lock);
+  return NULL;
+}
+
+// Fill everything below the first row and right of the first column on
+// aligner->nthreads threads, the calling thread being one of them
+static void alignment_fill_wavefront(aligner_t *aligner,
+                                     alignment_fill_row_f fill_row,
+                                     score_t min)
+{
+  alignment_wavefront_t wf;
+  size_t i, nthreads = aligner->nthreads, nstarted = 0;
+
+  wf.aligner = aligner;
+  wf.fill_row = fill_row;
+  wf.min = min;
+  wf.tiles_x = (aligner->score_width-1 + ALIGN_TILE-1) / ALIGN_TILE;
+  wf.tiles_y = (aligner->score_height-1 + ALIGN_TILE-1) / ALIGN_TILE;
+  wf.ntiles = wf.tiles_x * wf.tiles_y;
+  wf.nfilled = 0;
+  wf.waiting = malloc(wf.ntiles);
+  wf.queue = malloc(wf.ntiles * sizeof(size_t));
+  pthread_t *threads = malloc((nthreads-1) * sizeof(pthread_t));
+
+  if(wf.waiting == NULL || wf.queue == NULL || threads == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  for(i = 0; i < wf.ntiles; i++)
+    wf.waiting[i] = (i % wf.tiles_x > 0) + (i >= wf.tiles_x);
+
+  wf.queue[0] = 0;
+  wf.queue_start = 0;
+  wf.queue_end = 1;
+
+  pthread_mutex_init(&wf.lock, NULL);
+  pthread_cond_init(&wf.tile_ready, NULL);
+
+  // If threads cannot be started, those that were (or just this one) do it all
+  for(i = 0; i+1 < nthreads; i++) {
+    if(pthread_create(&threads[nstarted], NULL,
+                      alignment_wavefront_run, &wf) == 0) nstarted++;
+  }
+
+  alignment_wavefront_run(&wf);
+
+  for(i = 0; i < nstarted; i++) pthread_join(threads[i], NULL);
+
+  pthread_mutex_destroy(&wf.lock);
+  pthread_cond_destroy(&wf.tile_ready);
+  free(wf.waiting);
+  free(wf.queue);
+  free(threads);
+}
+
 // Fill in traceback matrix
 static void alignment_fill_matrices(aligner_t *aligner, char is_sw)
 {
@@ -31,101 +761,407 @@ static void alignment_fill_matrices(aligner_t *aligner, char is_sw)
   score_t *gap_a_scores = aligner->gap_a_scores;
   score_t *gap_b_scores = aligner->gap_b_scores;
   const scoring_t *scoring = aligner->scoring;
-  size_t score_width = aligner->score_width;
-  size_t score_height = aligner->score_height;
-  size_t i, j;
-
-  int gap_open_penalty = scoring->gap_extend + scoring->gap_open;
-  int gap_extend_penalty = scoring->gap_extend;
+  size_t score_width = aligner->score_width;
+  size_t score_height = aligner->score_height;
+  size_t row_step = aligner->row_step;
+  size_t i, j, i_end = score_width, j_end = score_height;
+
+  const score_t min = is_sw ? 0 : SCORE_MIN + abs(scoring->min_penalty);
+
+  size_t seq_j, len_i = score_width-1, len_j = score_height-1;
+  size_t seq_i_start, seq_i_end, index;
+
+  const alignment_fill_row_f fill_row
+    = alignment_fill_rows[scoring->no_mismatches*4 +
+                          scoring->no_gaps_in_a*2 + scoring->no_gaps_in_b];
+
+  aligner_profile_load(&aligner->profile);
+
+  if(aligner->banded)
+  {
+    // Everything outside the band (and its border) starts at min, with no
+    // path into it
+    size_t num_cells = aligner_num_cells(aligner);
+    for(index = 0; index < num_cells; index++)
+      match_scores[index] = gap_a_scores[index] = gap_b_scores[index] = min;
+    memset(aligner->traceback, 0xff, num_cells);
+
+    // First row and column only as far as the band goes
+    i_end = (size_t)MIN2((long)score_width, aligner->band_hi+1);
+    j_end = (size_t)MIN2((long)score_height, 1-aligner->band_lo);
+  }
+
+  // [0][0]
+  index = aligner_index(aligner, 0, 0);
+  match_scores[index] = 0;
+  gap_a_scores[index] = 0;
+  gap_b_scores[index] = 0;
+
+  if(is_sw)
+  {
+    for(i = 1, index++; i < i_end; i++, index++)
+      match_scores[index] = gap_a_scores[index] = gap_b_scores[index] = 0;
+    for(j = 1, index = aligner_index(aligner, 0, 1); j < j_end;
+        j++, index += row_step)
+      match_scores[index] = gap_a_scores[index] = gap_b_scores[index] = min;
+  }
+  else
+  {
+    // work along first row -> [i][0]
+    for(i = 1, index++; i < i_end; i++, index++)
+    {
+      match_scores[index] = min;
+
+      // Think carefully about which way round these are
+      gap_a_scores[index] = min;
+      gap_b_scores[index] = scoring->no_start_gap_penalty ? 0
+                            : scoring->gap_open + (int)i * scoring->gap_extend;
+    }
+
+    // work down first column -> [0][j]
+    for(j = 1, index = aligner_index(aligner, 0, 1); j < j_end;
+        j++, index += row_step)
+    {
+      match_scores[index] = min;
+
+      // Think carefully about which way round these are
+      gap_a_scores[index] = scoring->no_start_gap_penalty ? 0
+                            : scoring->gap_open + (int)j * scoring->gap_extend;
+      gap_b_scores[index] = min;
+    }
+  }
+
+  // More than one tile each way
+  if(!aligner->banded && aligner->nthreads > 1 &&
+     len_i > ALIGN_TILE && len_j > ALIGN_TILE) {
+    alignment_fill_wavefront(aligner, fill_row, min);
+    return;
+  }
+
+#ifdef ALIGN_FILL_DIAGONALS
+  // Enough rows to fill the vector lanes
+  if(!aligner->banded && len_i > 0 && len_j >= SIMD_LANES_I32) {
+    alignment_fill_diagonals(aligner, min, 0, len_i, 0, len_j);
+    return;
+  }
+#endif
+
+  for(seq_j = 0; seq_j < len_j; seq_j++)
+  {
+    // Fill [1..len_i][seq_j+1], or only the part within the band
+    seq_i_start = 0;
+    seq_i_end = len_i;
+
+    if(aligner->banded)
+    {
+      long x_lo = (long)seq_j+1 + aligner->band_lo;
+      long x_hi = (long)seq_j+1 + aligner->band_hi;
+      seq_i_start = x_lo > 1 ? (size_t)x_lo-1 : 0;
+      seq_i_end = MIN2(len_i, (size_t)x_hi);
+    }
+
+    alignment_fill_row_cells(aligner, fill_row, min, seq_j,
+                             seq_i_start, seq_i_end);
+  }
+}
+
+static void aligner_reserve(aligner_t *aligner, size_t new_capacity)
+{
+  if(aligner->capacity < new_capacity)
+  {
+    aligner->capacity = ROUNDUP2POW(new_capacity);
+    size_t mem = sizeof(score_t) * aligner->capacity;
+    aligner->match_scores = realloc(aligner->match_scores, mem);
+    aligner->gap_a_scores = realloc(aligner->gap_a_scores, mem);
+    aligner->gap_b_scores = realloc(aligner->gap_b_scores, mem);
+    if(!aligner->match_scores || !aligner->gap_a_scores ||
+       !aligner->gap_b_scores) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void aligner_reserve_traceback(aligner_t *aligner, size_t num_cells)
+{
+  if(aligner->traceback_capacity < num_cells)
+  {
+    aligner->traceback_capacity = ROUNDUP2POW(num_cells);
+    free(aligner->traceback);
+    aligner->traceback = malloc(aligner->traceback_capacity);
+    if(aligner->traceback == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+void aligner_load(aligner_t *aligner,
+                  const char *seq_a, const char *seq_b,
+                  size_t len_a, size_t len_b,
+                  const scoring_t *scoring)
+{
+  aligner->scoring = scoring;
+  aligner->seq_a = seq_a;
+  aligner->seq_b = seq_b;
+  aligner->score_width = len_a+1;
+  aligner->score_height = len_b+1;
+  aligner->row_step = aligner->score_width;
+  aligner->col_offset = 0;
+  aligner->band_lo = -(long)len_b;
+  aligner->band_hi = (long)len_a;
+  aligner->banded = false;
+  aligner->compact = false;
+
+  aligner_encode(aligner, seq_a, seq_b, len_a, len_b, scoring);
+  aligner_reserve(aligner, aligner->score_width * aligner->score_height);
+  aligner_reserve_traceback(aligner, aligner_num_cells(aligner));
+}
+
+void aligner_align(aligner_t *aligner,
+                   const char *seq_a, const char *seq_b,
+                   size_t len_a, size_t len_b,
+                   const scoring_t *scoring, char is_sw)
+{
+  aligner_load(aligner, seq_a, seq_b, len_a, len_b, scoring);
+  alignment_fill_matrices(aligner, is_sw);
+}
+
+// Cell (x,y) of the first row or column, as set by alignment_fill_matrices()
+static inline void alignment_score_border(const scoring_t *scoring,
+                                          char is_sw, score_t min,
+                                          size_t x, size_t y,
+                                          score_t *match, score_t *gap_a,
+                                          score_t *gap_b)
+{
+  if(is_sw || (x == 0 && y == 0)) {
+    *match = *gap_a = *gap_b = (y == 0 ? 0 : min);
+  }
+  else if(y == 0) {
+    *match = *gap_a = min;
+    *gap_b = scoring->no_start_gap_penalty ? 0
+             : scoring->gap_open + (int)x * scoring->gap_extend;
+  }
+  else {
+    *match = *gap_b = min;
+    *gap_a = scoring->no_start_gap_penalty ? 0
+             : scoring->gap_open + (int)y * scoring->gap_extend;
+  }
+}
+
+score_t aligner_score(aligner_t *aligner,
+                      const char *seq_a, const char *seq_b,
+                      size_t len_a, size_t len_b,
+                      const scoring_t *scoring, char is_sw,
+                      size_t *end_x, size_t *end_y)
+{
+  // Rows run along the shorter sequence
+  const bool swapped = len_a > len_b;
+  const size_t len_outer = swapped ? len_a : len_b;
+  const size_t len_inner = swapped ? len_b : len_a;
+  const size_t width = len_inner+1;
+
+  const int gap_open_penalty = scoring->gap_extend + scoring->gap_open;
+  const int gap_extend_penalty = scoring->gap_extend;
+  const score_t min = is_sw ? 0 : SCORE_MIN + abs(scoring->min_penalty);
+
+  aligner_reserve(aligner, 2*width);
+  aligner_encode(aligner, seq_a, seq_b, len_a, len_b, scoring);
+  aligner_profile_load(&aligner->profile);
+
+  score_t *match_scores = aligner->match_scores;
+  score_t *gap_a_scores = aligner->gap_a_scores;
+  score_t *gap_b_scores = aligner->gap_b_scores;
+
+  size_t prev = 0, curr = width, tmp, outer, inner, x, y;
+  size_t index, index_upleft, index_up, index_left;
+  size_t best_x = 0, best_y = 0;
+  score_t best = 0;
+
+  for(inner = 0; inner < width; inner++) {
+    alignment_score_border(scoring, is_sw, min,
+                           swapped ? 0 : inner, swapped ? inner : 0,
+                           &match_scores[inner], &gap_a_scores[inner],
+                           &gap_b_scores[inner]);
+  }
+
+  for(outer = 1; outer <= len_outer; outer++)
+  {
+    alignment_score_border(scoring, is_sw, min,
+                           swapped ? outer : 0, swapped ? 0 : outer,
+                           &match_scores[curr], &gap_a_scores[curr],
+                           &gap_b_scores[curr]);
+
+    for(inner = 1; inner <= len_inner; inner++)
+    {
+      x = swapped ? outer : inner;
+      y = swapped ? inner : outer;
+      index = curr+inner;
+      index_upleft = prev+inner-1;
+      index_up = swapped ? index-1 : prev+inner;
+      index_left = swapped ? prev+inner : index-1;
+
+      // Same recurrences as alignment_fill_matrices()
+      int substitution_penalty
+        = aligner_profile_row(&aligner->profile, y-1)[x-1];
+
+      if(substitution_penalty == PROFILE_NO_MATCH)
+        match_scores[index] = min;
+      else
+        match_scores[index]
+          = MAX4(match_scores[index_upleft] + substitution_penalty,
+                 gap_a_scores[index_upleft] + substitution_penalty,
+                 gap_b_scores[index_upleft] + substitution_penalty,
+                 min);
+
+      if(x == len_a && scoring->no_end_gap_penalty)
+        gap_a_scores[index] = MAX3(match_scores[index_up],
+                                   gap_a_scores[index_up],
+                                   gap_b_scores[index_up]);
+      else if(!scoring->no_gaps_in_a || x == len_a)
+        gap_a_scores[index]
+          = MAX4(match_scores[index_up] + gap_open_penalty,
+                 gap_a_scores[index_up] + gap_extend_penalty,
+                 gap_b_scores[index_up] + gap_open_penalty,
+                 min);
+      else
+        gap_a_scores[index] = min;
+
+      if(y == len_b && scoring->no_end_gap_penalty)
+        gap_b_scores[index] = MAX3(match_scores[index_left],
+                                   gap_a_scores[index_left],
+                                   gap_b_scores[index_left]);
+      else if(!scoring->no_gaps_in_b || y == len_b)
+        gap_b_scores[index]
+          = MAX4(match_scores[index_left] + gap_open_penalty,
+                 gap_a_scores[index_left] + gap_open_penalty,
+                 gap_b_scores[index_left] + gap_extend_penalty,
+                 min);
+      else
+        gap_b_scores[index] = min;
+
+      // Local hits end on a match: keep the first best in row order
+      if(is_sw && (match_scores[index] > best ||
+                   (swapped && match_scores[index] == best && best > 0 &&
+                    (y < best_y || (y == best_y && x < best_x)))))
+      {
+        best = match_scores[index];
+        best_x = x;
+        best_y = y;
+      }
+    }
+
+    tmp = prev; prev = curr; curr = tmp;
+  }
+
+  if(!is_sw)
+  {
+    index = prev + len_inner;
+    best = MAX3(match_scores[index], gap_a_scores[index], gap_b_scores[index]);
+    best_x = len_a;
+    best_y = len_b;
+  }
+
+  if(end_x != NULL) *end_x = best_x;
+  if(end_y != NULL) *end_y = best_y;
+
+  return best;
+}
+
+// Same recurrences as alignment_fill_matrices() for a global alignment, but
+// rows alternate between two buffers and each cell only records the traceback
+// move that alignment_reverse_move() would make out of each matrix
+static void alignment_fill_compact(aligner_t *aligner)
+{
+  score_t *match_scores = aligner->match_scores;
+  score_t *gap_a_scores = aligner->gap_a_scores;
+  score_t *gap_b_scores = aligner->gap_b_scores;
+  uint8_t *traceback = aligner->traceback;
+  const scoring_t *scoring = aligner->scoring;
+  const size_t width = aligner->score_width;
+  const size_t len_i = aligner->score_width-1, len_j = aligner->score_height-1;
 
-  const score_t min = is_sw ? 0 : SCORE_MIN + abs(scoring->min_penalty);
+  const int gap_open_penalty = scoring->gap_extend + scoring->gap_open;
+  const int gap_extend_penalty = scoring->gap_extend;
+  const score_t min = SCORE_MIN + abs(scoring->min_penalty);
 
-  size_t seq_i, seq_j, len_i = score_width-1, len_j = score_height-1;
-  size_t index, index_left, index_up, index_upleft;
+  size_t i, j, curr, prev, index, index_left, index_up, index_upleft;
+  int gap_a_open, gap_a_extend, gap_b_open, gap_b_extend;
+  int substitution_penalty;
+  const score_t *sub_row;
+  uint8_t from_match, from_gap_a, from_gap_b;
 
-  // [0][0]
-  match_scores[0] = 0;
-  gap_a_scores[0] = 0;
-  gap_b_scores[0] = 0;
+  aligner_profile_load(&aligner->profile);
 
-  if(is_sw)
-  {
-    for(i = 1; i < score_width; i++)
-      match_scores[i] = gap_a_scores[i] = gap_b_scores[i] = 0;
-    for(j = 1, index = score_width; j < score_height; j++, index += score_width)
-      match_scores[index] = gap_a_scores[index] = gap_b_scores[index] = min;
+  for(i = 0; i < width; i++) {
+    alignment_score_border(scoring, 0, min, i, 0, &match_scores[i],
+                           &gap_a_scores[i], &gap_b_scores[i]);
   }
-  else
+
+  for(j = 1; j <= len_j; j++)
   {
-    // work along first row -> [i][0]
-    for(i = 1; i < score_width; i++)
-    {
-      match_scores[i] = min;
+    curr = (j & 1) * width;
+    prev = width - curr;
 
-      // Think carefully about which way round these are
-      gap_a_scores[i] = min;
-      gap_b_scores[i] = scoring->no_start_gap_penalty ? 0
-                        : scoring->gap_open + (int)i * scoring->gap_extend;
-    }
+    alignment_score_border(scoring, 0, min, 0, j, &match_scores[curr],
+                           &gap_a_scores[curr], &gap_b_scores[curr]);
 
-    // work down first column -> [0][j]
-    for(j = 1, index = score_width; j < score_height; j++, index += score_width)
-    {
-      match_scores[index] = min;
+    sub_row = aligner_profile_row(&aligner->profile, j-1);
 
-      // Think carefully about which way round these are
-      gap_a_scores[index] = scoring->no_start_gap_penalty ? 0
-                            : scoring->gap_open + (int)j * scoring->gap_extend;
-      gap_b_scores[index] = min;
+    // Gaps end free in the last row
+    gap_b_open = gap_b_extend = 0;
+    if(j < len_j || !scoring->no_end_gap_penalty) {
+      gap_b_open = gap_open_penalty;
+      gap_b_extend = gap_extend_penalty;
     }
-  }
 
-  // start at position [1][1]
-  index_upleft = 0;
-  index_up = 1;
-  index_left = score_width;
-  index = score_width+1;
-
-  for(seq_j = 0; seq_j < len_j; seq_j++)
-  {
-    for(seq_i = 0; seq_i < len_i; seq_i++)
+    for(i = 1; i <= len_i; i++)
     {
-      // Update match_scores[i][j] with position [i-1][j-1]
-      // substitution penalty
-      bool is_match;
-      int substitution_penalty;
+      index = curr+i;
+      index_left = index-1;
+      index_up = prev+i;
+      index_upleft = index_up-1;
+      substitution_penalty = sub_row[i-1];
 
-      scoring_lookup(scoring, aligner->seq_a[seq_i], aligner->seq_b[seq_j],
-                     &substitution_penalty, &is_match);
+      // Gaps end free in the last column
+      gap_a_open = gap_a_extend = 0;
+      if(i < len_i || !scoring->no_end_gap_penalty) {
+        gap_a_open = gap_open_penalty;
+        gap_a_extend = gap_extend_penalty;
+      }
 
-      if(scoring->no_mismatches && !is_match)
+      // match_scores[i][j] from [i-1][j-1]
+      if(substitution_penalty == PROFILE_NO_MATCH)
       {
         match_scores[index] = min;
+        from_match = TRACE_NONE;
       }
       else
       {
-        // substitution
-        // 1) continue alignment
-        // 2) close gap in seq_a
-        // 3) close gap in seq_b
         match_scores[index]
           = MAX4(match_scores[index_upleft] + substitution_penalty,
                  gap_a_scores[index_upleft] + substitution_penalty,
                  gap_b_scores[index_upleft] + substitution_penalty,
                  min);
+        from_match
+          = alignment_trace_source(match_scores[index],
+                                   match_scores[index_upleft],
+                                   gap_a_scores[index_upleft],
+                                   gap_b_scores[index_upleft],
+                                   substitution_penalty, substitution_penalty,
+                                   substitution_penalty,
+                                   !scoring->no_gaps_in_a || i == 1,
+                                   !scoring->no_gaps_in_b || j == 1);
       }
 
-      // Long arithmetic since some INTs are set to min and penalty is -ve
-      // (adding as ints would cause an integer overflow)
-
-      // Update gap_a_scores[i][j] from position [i][j-1]
-      if(seq_i == len_i-1 && scoring->no_end_gap_penalty)
+      // gap_a_scores[i][j] from [i][j-1]
+      if(i == len_i && scoring->no_end_gap_penalty)
       {
         gap_a_scores[index] = MAX3(match_scores[index_up],
                                    gap_a_scores[index_up],
                                    gap_b_scores[index_up]);
       }
-      else if(!scoring->no_gaps_in_a || seq_i == len_i-1)
+      else if(!scoring->no_gaps_in_a || i == len_i)
       {
         gap_a_scores[index]
           = MAX4(match_scores[index_up] + gap_open_penalty,
@@ -136,14 +1172,23 @@ static void alignment_fill_matrices(aligner_t *aligner, char is_sw)
       else
         gap_a_scores[index] = min;
 
-      // Update gap_b_scores[i][j] from position [i-1][j]
-      if(seq_j == len_j-1 && scoring->no_end_gap_penalty)
+      from_gap_a
+        = alignment_trace_source(gap_a_scores[index],
+                                 match_scores[index_up],
+                                 gap_a_scores[index_up],
+                                 gap_b_scores[index_up],
+                                 gap_a_open, gap_a_extend, gap_a_open,
+                                 !scoring->no_gaps_in_a || i == len_i,
+                                 !scoring->no_gaps_in_b || j == 1);
+
+      // gap_b_scores[i][j] from [i-1][j]
+      if(j == len_j && scoring->no_end_gap_penalty)
       {
         gap_b_scores[index] = MAX3(match_scores[index_left],
                                    gap_a_scores[index_left],
                                    gap_b_scores[index_left]);
       }
-      else if(!scoring->no_gaps_in_b || seq_j == len_j-1)
+      else if(!scoring->no_gaps_in_b || j == len_j)
       {
         gap_b_scores[index]
           = MAX4(match_scores[index_left] + gap_open_penalty,
@@ -154,44 +1199,109 @@ static void alignment_fill_matrices(aligner_t *aligner, char is_sw)
       else
         gap_b_scores[index] = min;
 
-      index++;
-      index_left++;
-      index_up++;
-      index_upleft++;
-    }
+      from_gap_b
+        = alignment_trace_source(gap_b_scores[index],
+                                 match_scores[index_left],
+                                 gap_a_scores[index_left],
+                                 gap_b_scores[index_left],
+                                 gap_b_open, gap_b_open, gap_b_extend,
+                                 !scoring->no_gaps_in_a || i == 1,
+                                 !scoring->no_gaps_in_b || j == len_j);
 
-    index++;
-    index_left++;
-    index_up++;
-    index_upleft++;
+      *traceback++ = (uint8_t)(from_match << (2*MATCH) |
+                               from_gap_a << (2*GAP_A) |
+                               from_gap_b << (2*GAP_B));
+    }
   }
 }
 
-void aligner_align(aligner_t *aligner,
-                   const char *seq_a, const char *seq_b,
-                   size_t len_a, size_t len_b,
-                   const scoring_t *scoring, char is_sw)
+void aligner_align_compact(aligner_t *aligner,
+                           const char *seq_a, const char *seq_b,
+                           size_t len_a, size_t len_b,
+                           const scoring_t *scoring)
 {
   aligner->scoring = scoring;
   aligner->seq_a = seq_a;
   aligner->seq_b = seq_b;
   aligner->score_width = len_a+1;
   aligner->score_height = len_b+1;
+  aligner->row_step = aligner->score_width;
+  aligner->col_offset = 0;
+  aligner->band_lo = -(long)len_b;
+  aligner->band_hi = (long)len_a;
+  aligner->banded = false;
+  aligner->compact = true;
 
-  size_t new_capacity = aligner->score_width * aligner->score_height;
+  aligner_encode(aligner, seq_a, seq_b, len_a, len_b, scoring);
+  aligner_reserve(aligner, 2 * aligner->score_width);
+  aligner_reserve_traceback(aligner, len_a * len_b);
+  alignment_fill_compact(aligner);
+}
 
-  if(aligner->capacity < new_capacity)
+void aligner_align_banded(aligner_t *aligner,
+                          const char *seq_a, const char *seq_b,
+                          size_t len_a, size_t len_b,
+                          const scoring_t *scoring, char is_sw, size_t band)
+{
+  long band_lo = MIN2(0, (long)len_a - (long)len_b) - (long)band;
+  long band_hi = MAX2(0, (long)len_a - (long)len_b) + (long)band;
+
+  if(band >= len_a + len_b ||
+     (band_lo <= -(long)len_b && band_hi >= (long)len_a))
   {
-    aligner->capacity = ROUNDUP2POW(new_capacity);
-    size_t mem = sizeof(score_t) * aligner->capacity;
-    aligner->match_scores = realloc(aligner->match_scores, mem);
-    aligner->gap_a_scores = realloc(aligner->gap_a_scores, mem);
-    aligner->gap_b_scores = realloc(aligner->gap_b_scores, mem);
+    // Band covers the whole matrix
+    aligner_align(aligner, seq_a, seq_b, len_a, len_b, scoring, is_sw);
+    return;
   }
 
+  aligner->scoring = scoring;
+  aligner->seq_a = seq_a;
+  aligner->seq_b = seq_b;
+  aligner->score_width = len_a+1;
+  aligner->score_height = len_b+1;
+  aligner->band_lo = MAX2(band_lo, -(long)len_b);
+  aligner->band_hi = MIN2(band_hi, (long)len_a);
+  aligner->banded = true;
+  aligner->compact = false;
+
+  // Stored row: band plus a cell of min either side
+  size_t stored_width = (size_t)(aligner->band_hi - aligner->band_lo) + 3;
+  aligner->row_step = stored_width - 1;
+  aligner->col_offset = (size_t)(1 - aligner->band_lo);
+
+  aligner_encode(aligner, seq_a, seq_b, len_a, len_b, scoring);
+  aligner_reserve(aligner, aligner->score_height * stored_width);
+  aligner_reserve_traceback(aligner, aligner_num_cells(aligner));
   alignment_fill_matrices(aligner, is_sw);
 }
 
+bool aligner_band_touched(const aligner_t *aligner, enum Matrix matrix,
+                          size_t x, size_t y, char is_sw)
+{
+  if(!aligner->banded) return false;
+
+  long len_a = (long)aligner->score_width-1, len_b = (long)aligner->score_height-1;
+
+  // Band edges that are also the edges of the matrix cut nothing off
+  long lo = aligner->band_lo > -len_b ? aligner->band_lo : LONG_MIN;
+  long hi = aligner->band_hi < len_a ? aligner->band_hi : LONG_MAX;
+
+  const score_t *scores[3] = {aligner->match_scores, aligner->gap_a_scores,
+                              aligner->gap_b_scores};
+
+  while(1)
+  {
+    long diag = (long)x - (long)y;
+    if(diag <= lo || diag >= hi) return true;
+    if(x == 0 || y == 0 ||
+       (is_sw && scores[matrix][aligner_index(aligner, x, y)] == 0)) break;
+    alignment_traceback_move(&matrix, &x, &y, aligner);
+  }
+
+  // Global alignments finish along the first row or column to [0][0]
+  return !is_sw && ((x == 0 && hi <= 0) || (y == 0 && lo >= 0));
+}
+
 void aligner_destroy(aligner_t *aligner)
 {
   if(aligner->capacity > 0) {
@@ -199,6 +1309,37 @@ void aligner_destroy(aligner_t *aligner)
     free(aligner->gap_a_scores);
     free(aligner->gap_b_scores);
   }
+  free(aligner->traceback);
+  free(aligner->moves);
+  free(aligner->profile.seq);
+  free(aligner->profile.codes_a);
+  free(aligner->profile.codes_b);
+  free(aligner->profile.table);
+  free(aligner->profile.rows);
+}
+
+void aligner_set_threads(aligner_t *aligner, size_t nthreads)
+{
+  aligner->nthreads = nthreads;
+}
+
+uint8_t* aligner_moves(aligner_t *aligner, size_t n)
+{
+  if(n > aligner->moves_capacity)
+  {
+    aligner->moves_capacity = ROUNDUP2POW(n);
+    aligner->moves = realloc(aligner->moves, aligner->moves_capacity);
+    if(aligner->moves == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+  return aligner->moves;
+}
+
+void aligner_profile_reset(aligner_t *aligner)
+{
+  aligner->profile.loaded = false;
 }
 
 
@@ -213,6 +1354,8 @@ alignment_t* alignment_create(size_t capacity)
   result->result_a[0] = result->result_b[0] = '\0';
   result->pos_a = result->pos_b = result->len_a = result->len_b = 0;
   result->score = 0;
+  memset(&result->cigar, 0, sizeof(result->cigar));
+  result->cigar_only = false;
   return result;
 }
 
@@ -236,9 +1379,142 @@ void alignment_free(alignment_t* result)
 {
   free(result->result_a);
   free(result->result_b);
+  free(result->cigar.ops);
   free(result);
 }
 
+void alignment_cigar_reset(alignment_cigar_t *cigar)
+{
+  cigar->n = cigar->nm = 0;
+}
+
+void alignment_cigar_add(alignment_cigar_t *cigar, char op, size_t len)
+{
+  uint32_t code = strchr(ALIGN_CIGAR_OPS, op) - ALIGN_CIGAR_OPS;
+
+  if(len == 0) return;
+  if(op == 'X' || op == 'I' || op == 'D') cigar->nm += len;
+
+  if(cigar->n > 0 && (cigar->ops[cigar->n-1] & 0xf) == code)
+  {
+    cigar->ops[cigar->n-1] += (uint32_t)len << 4;
+    return;
+  }
+
+  if(cigar->n == cigar->capacity)
+  {
+    cigar->capacity = cigar->capacity ? cigar->capacity*2 : 64;
+    cigar->ops = realloc(cigar->ops, cigar->capacity * sizeof(uint32_t));
+    if(cigar->ops == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  cigar->ops[cigar->n++] = (uint32_t)len << 4 | code;
+}
+
+void alignment_cigar_reverse(alignment_cigar_t *cigar)
+{
+  size_t i, j;
+  uint32_t tmp;
+
+  for(i = 0, j = cigar->n; i + 1 < j; i++, j--)
+  {
+    tmp = cigar->ops[i];
+    cigar->ops[i] = cigar->ops[j-1];
+    cigar->ops[j-1] = tmp;
+  }
+}
+
+static inline bool _cigar_is_match(char a, char b, bool case_sensitive)
+{
+  return a == b || (!case_sensitive && tolower(a) == tolower(b));
+}
+
+void alignment_cigar_from_strings(alignment_cigar_t *cigar,
+                                  const char *alignment_a,
+                                  const char *alignment_b,
+                                  bool case_sensitive)
+{
+  size_t i;
+  alignment_cigar_reset(cigar);
+
+  for(i = 0; alignment_a[i] != '\0'; i++)
+  {
+    if(alignment_a[i] == '-') alignment_cigar_add(cigar, 'D', 1);
+    else if(alignment_b[i] == '-') alignment_cigar_add(cigar, 'I', 1);
+    else if(_cigar_is_match(alignment_a[i], alignment_b[i], case_sensitive))
+      alignment_cigar_add(cigar, '=', 1);
+    else alignment_cigar_add(cigar, 'X', 1);
+  }
+}
+
+void alignment_from_moves(alignment_t *result, const uint8_t *moves, size_t n,
+                          const char *seq_a, const char *seq_b,
+                          bool case_sensitive)
+{
+  size_t i, run = 0;
+  char op, run_op = 0;
+
+  result->length = n;
+
+  if(!result->cigar_only)
+  {
+    alignment_ensure_capacity(result, n);
+    char *alignment_a = result->result_a, *alignment_b = result->result_b;
+
+    for(i = n; i > 0; alignment_a++, alignment_b++)
+    {
+      switch(moves[--i])
+      {
+        case MATCH: *alignment_a = *seq_a++; *alignment_b = *seq_b++; break;
+        case GAP_A: *alignment_a = '-'; *alignment_b = *seq_b++; break;
+        default: *alignment_a = *seq_a++; *alignment_b = '-'; break;
+      }
+    }
+
+    *alignment_a = *alignment_b = '\0';
+    return;
+  }
+
+  alignment_ensure_capacity(result, 0);
+  alignment_cigar_reset(&result->cigar);
+  result->result_a[0] = result->result_b[0] = '\0';
+
+  for(i = n; i > 0; )
+  {
+    switch(moves[--i])
+    {
+      case MATCH:
+        op = _cigar_is_match(*seq_a++, *seq_b++, case_sensitive) ? '=' : 'X';
+        break;
+      case GAP_A: op = 'D'; seq_b++; break;
+      default: op = 'I'; seq_a++; break;
+    }
+
+    if(op != run_op) {
+      if(run > 0) alignment_cigar_add(&result->cigar, run_op, run);
+      run_op = op;
+      run = 0;
+    }
+    run++;
+  }
+
+  if(run > 0) alignment_cigar_add(&result->cigar, run_op, run);
+}
+
+void alignment_cigar_fprint(FILE *out, const alignment_cigar_t *cigar)
+{
+  size_t i;
+
+  if(cigar->n == 0) putc('*', out);
+
+  for(i = 0; i < cigar->n; i++)
+    fprintf(out, "%u%c", alignment_cigar_len(cigar, i),
+            alignment_cigar_op(cigar, i));
+}
+
 
 // Backtrack through scoring matrices
 void alignment_reverse_move(enum Matrix *curr_matrix, score_t *curr_score,
@@ -248,12 +1524,11 @@ void alignment_reverse_move(enum Matrix *curr_matrix, score_t *curr_score,
   size_t seq_x = (*score_x)-1, seq_y = (*score_y)-1;
   size_t len_i = aligner->score_width-1, len_j = aligner->score_height-1;
 
-  bool is_match;
-  int match_penalty;
   const scoring_t *scoring = aligner->scoring;
+  int match_penalty = aligner_substitution(aligner, seq_x, seq_y);
 
-  scoring_lookup(scoring, aligner->seq_a[seq_x], aligner->seq_b[seq_y],
-                 &match_penalty, &is_match);
+  // --nomismatches: no path comes into MATCH here
+  bool forbidden = (*curr_matrix == MATCH && match_penalty == PROFILE_NO_MATCH);
 
   int gap_a_open_penalty, gap_b_open_penalty;
   int gap_a_extend_penalty, gap_b_extend_penalty;
@@ -281,7 +1556,7 @@ void alignment_reverse_move(enum Matrix *curr_matrix, score_t *curr_score,
       prev_gap_b_penalty = match_penalty;
       (*score_x)--;
       (*score_y)--;
-      (*arr_index) -= aligner->score_width + 1;
+      (*arr_index) -= aligner->row_step + 1;
       break;
 
     case GAP_A:
@@ -289,7 +1564,7 @@ void alignment_reverse_move(enum Matrix *curr_matrix, score_t *curr_score,
       prev_gap_a_penalty = gap_a_extend_penalty;
       prev_gap_b_penalty = gap_a_open_penalty;
       (*score_y)--;
-      (*arr_index) -= aligner->score_width;
+      (*arr_index) -= aligner->row_step;
       break;
 
     case GAP_B:
@@ -308,19 +1583,22 @@ void alignment_reverse_move(enum Matrix *curr_matrix, score_t *curr_score,
 
   // *arr_index = ARR_2D_INDEX(aligner->score_width, *score_x, *score_y);
 
-  if((!scoring->no_gaps_in_a || *score_x == 0 || *score_x == len_i) &&
+  if(!forbidden &&
+     (!scoring->no_gaps_in_a || *score_x == 0 || *score_x == len_i) &&
      aligner->gap_a_scores[*arr_index] + prev_gap_a_penalty == *curr_score)
   {
     *curr_matrix = GAP_A;
     *curr_score = aligner->gap_a_scores[*arr_index];
   }
-  else if((!scoring->no_gaps_in_b || *score_y == 0 || *score_y == len_j) &&
+  else if(!forbidden &&
+          (!scoring->no_gaps_in_b || *score_y == 0 || *score_y == len_j) &&
           aligner->gap_b_scores[*arr_index] + prev_gap_b_penalty == *curr_score)
   {
     *curr_matrix = GAP_B;
     *curr_score = aligner->gap_b_scores[*arr_index];
   }
-  else if(aligner->match_scores[*arr_index] + prev_match_penalty == *curr_score)
+  else if(!forbidden &&
+          aligner->match_scores[*arr_index] + prev_match_penalty == *curr_score)
   {
     *curr_matrix = MATCH;
     *curr_score = aligner->match_scores[*arr_index];
@@ -329,9 +1607,9 @@ void alignment_reverse_move(enum Matrix *curr_matrix, score_t *curr_score,
   {
     alignment_print_matrices(aligner);
 
-    fprintf(stderr, "[%s:%zu,%zu]: %i [ismatch: %i] '%c' '%c'\n",
+    fprintf(stderr, "[%s:%zu,%zu]: %i [forbidden: %i] '%c' '%c'\n",
             MATRIX_NAME(*curr_matrix), *score_x, *score_y, *curr_score,
-            is_match, aligner->seq_a[seq_x], aligner->seq_b[seq_y]);
+            forbidden, aligner->seq_a[seq_x], aligner->seq_b[seq_y]);
     fprintf(stderr, " Penalties match: %i gap_open: %i gap_extend: %i\n",
             prev_match_penalty, prev_gap_a_penalty, prev_gap_b_penalty);
     fprintf(stderr, " Expected MATCH: %i GAP_A: %i GAP_B: %i\n",
@@ -349,49 +1627,73 @@ void alignment_reverse_move(enum Matrix *curr_matrix, score_t *curr_score,
   }
 }
 
-
-void alignment_print_matrices(const aligner_t *aligner)
+void alignment_traceback_move(enum Matrix *curr_matrix,
+                              size_t *score_x, size_t *score_y,
+                              const aligner_t *aligner)
 {
-  const score_t* match_scores = aligner->match_scores;
-  const score_t* gap_a_scores = aligner->gap_a_scores;
-  const score_t* gap_b_scores = aligner->gap_b_scores;
-
-  size_t i, j;
-
-  printf("seq_a: %.*s\nseq_b: %.*s\n",
-         (int)aligner->score_width-1, aligner->seq_a,
-         (int)aligner->score_height-1, aligner->seq_b);
+  size_t index = aligner->compact
+    ? (*score_y-1) * (aligner->score_width-1) + *score_x-1
+    : aligner_index(aligner, *score_x, *score_y);
+  uint8_t from = (aligner->traceback[index] >> (2 * *curr_matrix)) & 3;
 
-  printf("match_scores:\n");
-  for(j = 0; j < aligner->score_height; j++)
+  switch(*curr_matrix)
   {
-    printf("%3i:", (int)j);
-    for(i = 0; i < aligner->score_width; i++)
-    {
-      printf("\t%3i", (int)ARR_LOOKUP(match_scores, aligner->score_width, i, j));
-    }
-    putc('\n', stdout);
+    case MATCH: (*score_x)--; (*score_y)--; break;
+    case GAP_A: (*score_y)--; break;
+    case GAP_B: (*score_x)--; break;
+    default:
+      fprintf(stderr, "Program error: invalid matrix in traceback_move()\n");
+      fprintf(stderr, "Please submit a bug report to: turner.isaac@gmail.com\n");
+      exit(EXIT_FAILURE);
   }
-  printf("gap_a_scores:\n");
-  for(j = 0; j < aligner->score_height; j++)
+
+  if(from == TRACE_NONE)
   {
-    printf("%3i:", (int)j);
-    for(i = 0; i < aligner->score_width; i++)
-    {
-      printf("\t%3i", (int)ARR_LOOKUP(gap_a_scores, aligner->score_width, i, j));
-    }
-    putc('\n', stdout);
+    fprintf(stderr,
+"Program error: traceback fail (traceback_move) at %zu,%zu\n"
+"  If you think this is a bug, please report it to: turner.isaac@gmail.com\n",
+            *score_x, *score_y);
+    exit(EXIT_FAILURE);
   }
-  printf("gap_b_scores:\n");
+
+  *curr_matrix = (enum Matrix)from;
+}
+
+
+static void alignment_print_matrix(const aligner_t *aligner,
+                                   const score_t *scores)
+{
+  size_t i, j;
+  long diag;
+
   for(j = 0; j < aligner->score_height; j++)
   {
     printf("%3i:", (int)j);
     for(i = 0; i < aligner->score_width; i++)
     {
-      printf("\t%3i", (int)ARR_LOOKUP(gap_b_scores, aligner->score_width, i, j));
+      // Cells outside the band are not stored
+      diag = (long)i - (long)j;
+      if(diag < aligner->band_lo || diag > aligner->band_hi)
+        printf("\t  .");
+      else
+        printf("\t%3i", (int)scores[aligner_index(aligner, i, j)]);
     }
     putc('\n', stdout);
   }
+}
+
+void alignment_print_matrices(const aligner_t *aligner)
+{
+  printf("seq_a: %.*s\nseq_b: %.*s\n",
+         (int)aligner->score_width-1, aligner->seq_a,
+         (int)aligner->score_height-1, aligner->seq_b);
+
+  printf("match_scores:\n");
+  alignment_print_matrix(aligner, aligner->match_scores);
+  printf("gap_a_scores:\n");
+  alignment_print_matrix(aligner, aligner->gap_a_scores);
+  printf("gap_b_scores:\n");
+  alignment_print_matrix(aligner, aligner->gap_b_scores);
 
   printf("match: %i mismatch: %i gapopen: %i gapexend: %i\n",
          aligner->scoring->match, aligner->scoring->mismatch,
@@ -399,27 +1701,35 @@ void alignment_print_matrices(const aligner_t *aligner)
   printf("\n");
 }
 
-void alignment_colour_print_against(const char *alignment_a,
-                                    const char *alignment_b,
-                                    char case_sensitive)
+// Characters of a spacer line rendered before writing them out
+#define ALIGN_PRINT_CHUNK 4096
+
+void alignment_colour_fprint_against(FILE *out,
+                                     const char *alignment_a,
+                                     const char *alignment_b,
+                                     char case_sensitive)
 {
-  int i;
+  size_t i, start = 0;
   char red = 0, green = 0;
+  const char *code1, *code2;
 
+  // Characters between colour changes are written as one span
   for(i = 0; alignment_a[i] != '\0'; i++)
   {
+    code1 = code2 = NULL;
+
     if(alignment_b[i] == '-')
     {
       if(!red)
       {
-        fputs(align_col_indel, stdout);
+        code1 = align_col_indel;
         red = 1;
       }
     }
     else if(red)
     {
       red = 0;
-      fputs(align_col_stop, stdout);
+      code1 = align_col_stop;
     }
 
     if(((case_sensitive && alignment_a[i] != alignment_b[i]) ||
@@ -428,47 +1738,96 @@ void alignment_colour_print_against(const char *alignment_a,
     {
       if(!green)
       {
-        fputs(align_col_mismatch, stdout);
+        code2 = align_col_mismatch;
         green = 1;
       }
     }
     else if(green)
     {
       green = 0;
-      fputs(align_col_stop, stdout);
+      code2 = align_col_stop;
     }
 
-    putc(alignment_a[i], stdout);
+    if(code1 != NULL || code2 != NULL)
+    {
+      fwrite(alignment_a + start, 1, i - start, out);
+      if(code1 != NULL) fputs(code1, out);
+      if(code2 != NULL) fputs(code2, out);
+      start = i;
+    }
   }
 
+  fwrite(alignment_a + start, 1, i - start, out);
+
   if(green || red)
   {
     // Stop all colours
-    fputs(align_col_stop, stdout);
+    fputs(align_col_stop, out);
   }
 }
 
+void alignment_colour_print_against(const char *alignment_a,
+                                    const char *alignment_b,
+                                    char case_sensitive)
+{
+  alignment_colour_fprint_against(stdout, alignment_a, alignment_b,
+                                  case_sensitive);
+}
+
+// Bytes of x equal to '-'
+#define ALIGN_HAS_GAP(x) \
+  ((((x) ^ 0x2d2d2d2d2d2d2d2dULL) - 0x0101010101010101ULL) & \
+   ~((x) ^ 0x2d2d2d2d2d2d2d2dULL) & 0x8080808080808080ULL)
+
 // Order of alignment_a / alignment_b is not important
-void alignment_print_spacer(const char* alignment_a, const char* alignment_b,
-                            const scoring_t* scoring)
+void alignment_fprint_spacer(FILE *out,
+                             const char* alignment_a, const char* alignment_b,
+                             const scoring_t* scoring)
 {
-  int i;
+  char buf[ALIGN_PRINT_CHUNK];
+  size_t i, n, len = strlen(alignment_a);
+  uint64_t word_a, word_b;
 
-  for(i = 0; alignment_a[i] != '\0'; i++)
+  for(; len > 0; alignment_a += n, alignment_b += n, len -= n)
   {
-    if(alignment_a[i] == '-' || alignment_b[i] == '-')
-    {
-      putc(' ', stdout);
-    }
-    else if(alignment_a[i] == alignment_b[i] ||
-            (!scoring->case_sensitive &&
-             tolower(alignment_a[i]) == tolower(alignment_b[i])))
-    {
-      putc('|', stdout);
-    }
-    else
+    n = MIN2(len, ALIGN_PRINT_CHUNK);
+
+    for(i = 0; i < n; i++)
     {
-      putc('*', stdout);
+      // Eight identical characters without a gap are all matches
+      if(i + 8 <= n)
+      {
+        memcpy(&word_a, alignment_a + i, 8);
+        memcpy(&word_b, alignment_b + i, 8);
+        if(word_a == word_b && !ALIGN_HAS_GAP(word_a)) {
+          memset(buf + i, '|', 8);
+          i += 7;
+          continue;
+        }
+      }
+
+      if(alignment_a[i] == '-' || alignment_b[i] == '-')
+      {
+        buf[i] = ' ';
+      }
+      else if(alignment_a[i] == alignment_b[i] ||
+              (!scoring->case_sensitive &&
+               tolower(alignment_a[i]) == tolower(alignment_b[i])))
+      {
+        buf[i] = '|';
+      }
+      else
+      {
+        buf[i] = '*';
+      }
     }
+
+    fwrite(buf, 1, n, out);
   }
 }
+
+void alignment_print_spacer(const char* alignment_a, const char* alignment_b,
+                            const scoring_t* scoring)
+{
+  alignment_fprint_spacer(stdout, alignment_a, alignment_b, scoring);
+}
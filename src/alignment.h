@@ -8,7 +8,9 @@
 #ifndef ALIGNMENT_HEADER_SEEN
 #define ALIGNMENT_HEADER_SEEN
 
+#include <stdio.h> // FILE
 #include <string.h> // memset
+#include <stdbool.h>
 #include "alignment_scoring.h"
 
 #ifndef ROUNDUP2POW
@@ -20,6 +22,35 @@
   }
 #endif
 
+// Sequences are encoded into small integer codes before they are aligned:
+// each character (case folded unless scoring->case_sensitive) gets the next
+// code the first time it is seen, and table[i*ncodes+j] is the score of code i
+// in seq_a against code j in seq_b, or PROFILE_NO_MATCH where --nomismatches
+// forbids the pair.  rows[j*len+x] is the query profile: the score of seq_a[x]
+// against code j.  The fills and traceback only use these, never
+// scoring_lookup().  Codes and rows are kept while the query (seq_a, compared
+// by content) and case sensitivity stay the same, so aligning one seq_a
+// against many seq_b builds them once.  The table is checked against the
+// scoring on every alignment (ncodes^2 lookups), so a scoring_t changed in
+// place, or another one at the same address, is picked up.
+typedef struct
+{
+  char *seq;
+  size_t len, seq_capacity;
+  bool loaded, case_sensitive;
+  int codes[256]; // -1 if not seen yet
+  char symbols[256]; // a character with each code
+  size_t ncodes;
+  uint8_t *codes_a, *codes_b;
+  size_t codes_a_capacity, codes_b_capacity;
+  score_t *table;
+  size_t table_codes; // ncodes when table was built
+  score_t *rows;
+  size_t nrows, rows_capacity;
+} aligner_profile_t;
+
+#define PROFILE_NO_MATCH SCORE_MIN
+
 typedef struct
 {
   const scoring_t* scoring;
@@ -27,8 +58,60 @@ typedef struct
   size_t score_width, score_height; // width=len(seq_a)+1, height=len(seq_b)+1
   score_t *match_scores, *gap_a_scores, *gap_b_scores;
   size_t capacity;
+  // Cell (x,y) is at index y*row_step + x + col_offset.  Full matrices have
+  // row_step = score_width and col_offset = 0.  Banded matrices only store the
+  // cells with band_lo <= x-y <= band_hi, plus one cell either side set to
+  // the minimum score.
+  size_t row_step, col_offset;
+  long band_lo, band_hi;
+  bool banded;
+  // A byte per cell saying which matrix each of the three matrices was
+  // reached from (2 bits each, TRACE_NONE if none).  Full and banded fills
+  // store it at the cell's index in the score matrices.  Compact fills keep
+  // only two rows of scores, so (x,y) with x,y > 0 is at
+  // traceback[(y-1)*(score_width-1) + x-1] (see aligner_align_compact)
+  uint8_t *traceback;
+  size_t traceback_capacity;
+  bool compact;
+  // Threads filling the full matrices (see aligner_set_threads())
+  size_t nthreads;
+  // Matrix of each step of the last traceback, from its end backwards
+  uint8_t *moves;
+  size_t moves_capacity;
+  aligner_profile_t profile;
 } aligner_t;
 
+#define aligner_index(a,x,y) ((y)*(a)->row_step + (x) + (a)->col_offset)
+
+// Number of cells stored for each matrix
+static inline size_t aligner_num_cells(const aligner_t *aligner)
+{
+  return aligner->score_height * (aligner->row_step + aligner->banded);
+}
+
+// Coordinates (x,y) of the cell at index
+static inline void aligner_coords(const aligner_t *aligner, size_t index,
+                                  size_t *x, size_t *y)
+{
+  size_t stored_width = aligner->row_step + aligner->banded;
+  *y = index / stored_width;
+  *x = index % stored_width + (aligner->banded ? *y : 0) - aligner->col_offset;
+}
+
+// Run-length encoded alignment of seq_a (the query) against seq_b (the
+// reference).  Each op is length << 4 | code as in BAM, code indexing
+// ALIGN_CIGAR_OPS: '=' match, 'X' mismatch, 'I' a base only in seq_a and 'D'
+// a base only in seq_b.  Matches are case insensitive unless
+// scoring->case_sensitive, as in alignment_print_spacer().
+#define ALIGN_CIGAR_OPS "MIDNSHP=X"
+
+typedef struct
+{
+  uint32_t *ops;
+  size_t n, capacity;
+  size_t nm; // mismatches and gap bases (SAM NM tag)
+} alignment_cigar_t;
+
 // Store alignment result here
 typedef struct
 {
@@ -37,11 +120,18 @@ typedef struct
   size_t pos_a, pos_b; // position of first base (0-based)
   size_t len_a, len_b; // number of bases in alignment
   score_t score;
+  // With cigar_only set, alignments fill in cigar and leave result_a and
+  // result_b empty, so memory and output don't grow with the gapped strings
+  alignment_cigar_t cigar;
+  bool cigar_only;
 } alignment_t;
 
 // Matrix names
 enum Matrix { MATCH,GAP_A,GAP_B };
 
+// Traceback bits for a cell with no path into a matrix
+#define TRACE_NONE 3
+
 #define MATRIX_NAME(x) ((x) == MATCH ? "MATCH" : ((x) == GAP_A ? "GAP_A" : "GAP_B"))
 
 #ifdef __cplusplus
@@ -53,28 +143,116 @@ extern const char align_col_mismatch[], align_col_indel[], align_col_context[],
                   align_col_stop[];
 
 #define aligner_init(a) (memset(a, 0, sizeof(aligner_t)))
+// Point aligner at a pair of sequences and make room for their matrices,
+// without filling them in
+void aligner_load(aligner_t *aligner,
+                  const char *seq_a, const char *seq_b,
+                  size_t len_a, size_t len_b,
+                  const scoring_t *scoring);
 void aligner_align(aligner_t *aligner,
                    const char *seq_a, const char *seq_b,
                    size_t len_a, size_t len_b,
                    const scoring_t *scoring, char is_sw);
+// Score of the best alignment without filling the matrices, keeping only two
+// rows (along the shorter sequence) of each.  Scores are the same as a full
+// fill followed by traceback; for local alignments (is_sw) the end of the first
+// best hit in row order is returned in end_x,end_y (matrix coordinates, so one
+// past the last base; 0,0 if nothing scores > 0).  Reuses the aligner's memory,
+// so any matrices filled before are lost.
+score_t aligner_score(aligner_t *aligner,
+                      const char *seq_a, const char *seq_b,
+                      size_t len_a, size_t len_b,
+                      const scoring_t *scoring, char is_sw,
+                      size_t *end_x, size_t *end_y);
+
+// Global alignment (no is_sw) storing only the traceback bits, so using
+// len_a*len_b bytes rather than three matrices of score_t.  The end cell's
+// scores are the last row of the two kept: index
+// (len_b&1)*score_width + len_a.  Follow the path with
+// alignment_traceback_move.
+void aligner_align_compact(aligner_t *aligner,
+                           const char *seq_a, const char *seq_b,
+                           size_t len_a, size_t len_b,
+                           const scoring_t *scoring);
+
+// Only fill cells within `band` diagonals of those joining the start and end
+// of the matrices: band_lo = MIN(0,len_a-len_b)-band,
+// band_hi = MAX(0,len_a-len_b)+band.  Uses O((len_a+len_b)*band) memory.
+void aligner_align_banded(aligner_t *aligner,
+                          const char *seq_a, const char *seq_b,
+                          size_t len_a, size_t len_b,
+                          const scoring_t *scoring, char is_sw, size_t band);
 void aligner_destroy(aligner_t *aligner);
+// Fill the full matrices of large pairs on nthreads threads (0 or 1 for just
+// the calling thread).  The matrices are cut into tiles, each filled once the
+// tiles above and to its left are, so anti-diagonals of tiles run in parallel.
+// Cells are computed as in a serial fill, so scores and tracebacks are the
+// same.  Applies to aligner_align() (needleman_wunsch_align2(),
+// smith_waterman_align2() and the hits they lead to), not to banded, compact
+// or score-only fills.
+void aligner_set_threads(aligner_t *aligner, size_t nthreads);
+// Room for a traceback of n steps in aligner->moves
+uint8_t* aligner_moves(aligner_t *aligner, size_t n);
+
+// Forget the query profile, so it is rebuilt on the next alignment
+void aligner_profile_reset(aligner_t *aligner);
+
+// Whether the path traced back from cell (x,y) in matrix touches the edge of
+// the band, where a better path may have been cut off.  Local (is_sw) paths
+// stop at the first zero score.
+bool aligner_band_touched(const aligner_t *aligner, enum Matrix matrix,
+                          size_t x, size_t y, char is_sw);
 
 // Constructors/Destructors for alignment
 alignment_t* alignment_create(size_t capacity);
 void alignment_ensure_capacity(alignment_t* result, size_t strlength);
 void alignment_free(alignment_t* result);
 
+void alignment_cigar_reset(alignment_cigar_t *cigar);
+// Append len of op (one of ALIGN_CIGAR_OPS), merging with the last op
+void alignment_cigar_add(alignment_cigar_t *cigar, char op, size_t len);
+void alignment_cigar_reverse(alignment_cigar_t *cigar);
+// CIGAR of a pair of gapped strings
+void alignment_cigar_from_strings(alignment_cigar_t *cigar,
+                                  const char *alignment_a,
+                                  const char *alignment_b,
+                                  bool case_sensitive);
+void alignment_cigar_fprint(FILE *out, const alignment_cigar_t *cigar);
+// Write a path recorded backwards as moves[0..n) (the enum Matrix of each
+// step) into result: its gapped strings, or just its CIGAR if cigar_only.
+// The path starts before seq_a[0] and seq_b[0].  Sets result->length.
+void alignment_from_moves(alignment_t *result, const uint8_t *moves, size_t n,
+                          const char *seq_a, const char *seq_b,
+                          bool case_sensitive);
+
+#define alignment_cigar_op(cigar,i) (ALIGN_CIGAR_OPS[(cigar)->ops[i] & 0xf])
+#define alignment_cigar_len(cigar,i) ((cigar)->ops[i] >> 4)
+
 void alignment_reverse_move(enum Matrix *curr_matrix, score_t *curr_score,
                             size_t *score_x, size_t *score_y,
                             size_t *arr_index, const aligner_t *aligner);
 
+// alignment_reverse_move() from the traceback bits the fill recorded, so
+// without reading any scores: step back from cell (x,y) in curr_matrix
+// (x,y > 0) to the cell and matrix it was reached from
+void alignment_traceback_move(enum Matrix *curr_matrix,
+                              size_t *score_x, size_t *score_y,
+                              const aligner_t *aligner);
+
 // Printing
 void alignment_print_matrices(const aligner_t *aligner);
 
+void alignment_colour_fprint_against(FILE *out,
+                                     const char *alignment_a,
+                                     const char *alignment_b,
+                                     char case_sensitive);
 void alignment_colour_print_against(const char *alignment_a,
                                     const char *alignment_b,
                                     char case_sensitive);
 
+void alignment_fprint_spacer(FILE *out,
+                             const char* alignment_a, const char* alignment_b,
+                             const scoring_t* scoring);
 void alignment_print_spacer(const char* alignment_a, const char* alignment_b,
                             const scoring_t* scoring);
 
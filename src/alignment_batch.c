@@ -0,0 +1,597 @@
+/*
+ alignment_batch.c
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+// Inter-sequence SIMD: each vector lane holds a cell from a different pair,
+// so short pairs get the full width of the vector however small their
+// matrices are.  The recurrences are exactly those of
+// alignment_fill_matrices(), and each cell records the move
+// alignment_reverse_move() would make out of it, so each pair is traced back
+// straight from the interleaved cells.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "alignment_batch.h"
+#include "alignment_macros.h"
+#include "alignment_simd.h"
+
+void aligner_batch_destroy(aligner_batch_t *batch)
+{
+  free(batch->mem);
+  free(batch->order);
+  memset(batch, 0, sizeof(*batch));
+}
+
+typedef struct
+{
+  size_t len_a, len_b, index;
+} batch_pair_t;
+
+static int _batch_pair_cmp(const void *aa, const void *bb)
+{
+  const batch_pair_t *a = aa, *b = bb;
+  if(a->len_b != b->len_b) return a->len_b < b->len_b ? -1 : 1;
+  if(a->len_a != b->len_a) return a->len_a < b->len_a ? -1 : 1;
+  return a->index < b->index ? -1 : (a->index > b->index);
+}
+
+// Sort pairs by length into batch->order, leaving room for as many again
+static void _batch_order(aligner_batch_t *batch,
+                         const size_t *lens_a, const size_t *lens_b, size_t n)
+{
+  size_t i;
+
+  if(batch->order_capacity < 2*n) {
+    batch->order_capacity = ROUNDUP2POW(2*n);
+    free(batch->order);
+    batch->order = malloc(batch->order_capacity * sizeof(size_t));
+    if(batch->order == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  batch_pair_t *pairs = malloc(n * sizeof(batch_pair_t));
+  if(n > 0 && pairs == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  for(i = 0; i < n; i++) {
+    pairs[i].len_a = lens_a[i];
+    pairs[i].len_b = lens_b[i];
+    pairs[i].index = i;
+  }
+
+  qsort(pairs, n, sizeof(batch_pair_t), _batch_pair_cmp);
+  for(i = 0; i < n; i++) batch->order[i] = pairs[i].index;
+
+  free(pairs);
+}
+
+#ifdef SEQ_ALIGN_SIMD
+
+// Bound on the magnitude of any score on a path through a pair's matrices
+static long _batch_score_bound(const scoring_t *scoring,
+                               size_t len_a, size_t len_b)
+{
+  return (long)(len_a + len_b + 2) *
+         (labs(scoring->max_penalty) + labs(scoring->min_penalty));
+}
+
+// Operations on the lanes of whichever width we are filling
+#define VSET1(x)    (bits == 16 ? simd_set1_i16(x) : simd_set1_i32(x))
+#define VADD(a,b)   (bits == 16 ? simd_adds_i16(a,b) : simd_add_i32(a,b))
+#define VMAX(a,b)   (bits == 16 ? simd_max_i16(a,b) : simd_max_i32(a,b))
+#define VCMPEQ(a,b) (bits == 16 ? simd_cmpeq_i16(a,b) : simd_cmpeq_i32(a,b))
+#define VCMPGT(a,b) (bits == 16 ? simd_cmpgt_i16(a,b) : simd_cmpgt_i32(a,b))
+#define LANE_SET(l,k,x) do { if(bits == 16) (l).i16[k] = (int16_t)(x); \
+                             else (l).i32[k] = (int32_t)(x); } while(0)
+#define LANE_GET(l,k) (bits == 16 ? (l).i16[k] : (l).i32[k])
+
+// alignment_trace_source() on every lane: traceback bits for a cell with
+// score, shifted into place for its matrix, given the score from each matrix
+// of the cell it came from (penalty added) and masks of the lanes that may
+// come from GAP_A and GAP_B
+static inline simd_t _batch_source(simd_t score, simd_t from_m, simd_t from_a,
+                                   simd_t from_b, simd_t ok_a, simd_t ok_b,
+                                   int shift, const size_t bits)
+{
+  simd_t src = VSET1(TRACE_NONE << shift);
+  src = simd_blend(VCMPEQ(from_m, score), VSET1(MATCH << shift), src);
+  src = simd_blend(simd_and(VCMPEQ(from_b, score), ok_b),
+                   VSET1(GAP_B << shift), src);
+  src = simd_blend(simd_and(VCMPEQ(from_a, score), ok_a),
+                   VSET1(GAP_A << shift), src);
+  return src;
+}
+
+// Keep where the traceback of each global alignment ending on row y starts,
+// as needleman_wunsch_traceback() picks it
+static inline void _batch_ends(aligner_batch_t *batch, size_t y,
+                               const simd_t *match, const simd_t *gap_a,
+                               const simd_t *gap_b, const size_t bits)
+{
+  simd_lanes_t m, a, b;
+  size_t k, x;
+
+  for(k = 0; k < batch->num_pairs; k++)
+  {
+    if(batch->len_b[k] != y) continue;
+
+    x = batch->len_a[k];
+    m.v = match[x];
+    a.v = gap_a[x];
+    b.v = gap_b[x];
+
+    batch->end_a[k] = x;
+    batch->end_b[k] = y;
+    batch->end_matrix[k] = MATCH;
+    batch->score[k] = LANE_GET(m, k);
+
+    if(LANE_GET(b, k) >= batch->score[k]) {
+      batch->end_matrix[k] = GAP_B;
+      batch->score[k] = LANE_GET(b, k);
+    }
+    if(LANE_GET(a, k) >= batch->score[k]) {
+      batch->end_matrix[k] = GAP_A;
+      batch->score[k] = LANE_GET(a, k);
+    }
+  }
+}
+
+// Fill pairs[0..n-1] (indices into seqs_a/seqs_b) at once, with the same
+// recurrences as alignment_fill_matrices(), keeping the traceback bits of
+// every cell and where each traceback starts.  Local alignments start from
+// the first hit smith_waterman_fetch() would return: the highest score in
+// MATCH, then leftmost, then topmost.  With 16 bit lanes, a score that may
+// have been clamped sets batch->saturated[] for its pair.  Inlined into a copy
+// for each lane width.
+static inline void _batch_fill(aligner_batch_t *batch,
+                               const char *const *seqs_a,
+                               const char *const *seqs_b,
+                               const size_t *lens_a, const size_t *lens_b,
+                               const size_t *pairs, size_t n,
+                               const scoring_t *scoring, char is_sw,
+                               const size_t bits)
+{
+  const size_t nlanes = SIMD_BYTES * 8 / bits;
+  size_t i, j, k, x, y, width = 1, height = 1;
+
+  batch->scoring = scoring;
+  batch->num_pairs = n;
+  batch->bits = bits;
+  batch->is_sw = is_sw;
+
+  for(k = 0; k < n; k++) {
+    batch->seq_a[k] = seqs_a[pairs[k]];
+    batch->seq_b[k] = seqs_b[pairs[k]];
+    batch->len_a[k] = lens_a[pairs[k]];
+    batch->len_b[k] = lens_b[pairs[k]];
+    batch->saturated[k] = false;
+    width = MAX2(width, batch->len_a[k]+1);
+    height = MAX2(height, batch->len_b[k]+1);
+  }
+
+  batch->width = width;
+  batch->height = height;
+
+  // Local scores are checked for saturation as we go, and the lanes also hold
+  // where the best hit ends.  Global scores can run off the bottom of the
+  // range, where they would be clamped indistinguishably from the floor, so
+  // only give a global alignment 16 bit lanes if no score on any path can get
+  // near it.
+  if(bits == 16) {
+    for(k = 0; k < n; k++) {
+      long bound = _batch_score_bound(scoring, batch->len_a[k], batch->len_b[k]);
+      if(is_sw)
+        batch->saturated[k] = 4 * labs(scoring->min_penalty) > INT16_MAX ||
+                              4 * labs(scoring->max_penalty) > INT16_MAX ||
+                              batch->len_a[k] >= INT16_MAX ||
+                              batch->len_b[k] >= INT16_MAX;
+      else
+        batch->saturated[k] = 3 * bound >= INT16_MAX;
+    }
+  }
+
+  // A profile for each character of any seq_b in the batch: lane k of vector
+  // x scores seq_a[k][x] against it.  One more profile for lanes past the end
+  // of their seq_b.
+  int slots[256];
+  size_t nprof = 0;
+
+  memset(slots, 0xff, sizeof(slots));
+  for(k = 0; k < n; k++) {
+    for(y = 0; y < batch->len_b[k]; y++) {
+      uint8_t c = (uint8_t)batch->seq_b[k][y];
+      if(slots[c] < 0) slots[c] = nprof++;
+    }
+  }
+
+  const size_t pad = nprof++, cols = width-1, cells = cols * (height-1);
+  size_t mem = (cells + 6*width + nprof*cols) * SIMD_BYTES;
+
+  if(batch->capacity < mem) {
+    batch->capacity = ROUNDUP2POW(mem);
+    free(batch->mem);
+    batch->mem = malloc(batch->capacity + SIMD_BYTES);
+    if(batch->mem == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  simd_t *traceback = SIMD_ALIGN(batch->mem);
+  simd_t *prev_m = traceback + cells, *prev_a = prev_m + width;
+  simd_t *prev_b = prev_a + width, *curr_m = prev_b + width;
+  simd_t *curr_a = curr_m + width, *curr_b = curr_a + width, *tmp;
+  simd_t *profiles = curr_b + width;
+  simd_lanes_t *prof;
+
+  // The lowest score a lane can hold marks a mismatch that is not allowed.
+  // Local alignments also give it to lanes past the end of a sequence, so
+  // padding never scores in MATCH.
+  const int32_t forbidden = bits == 16 ? INT16_MIN : INT32_MIN;
+  const bool check_forbidden = is_sw || scoring->no_mismatches;
+  const int32_t padding = check_forbidden ? forbidden : 0;
+  int substitution_penalty;
+  bool is_match;
+
+  for(i = 0; i < 256; i++)
+  {
+    if(slots[i] < 0) continue;
+    prof = (simd_lanes_t*)(profiles + slots[i] * cols);
+    for(x = 0; x < cols; x++) {
+      for(k = 0; k < nlanes; k++) {
+        substitution_penalty = padding;
+        if(k < n && x < batch->len_a[k]) {
+          scoring_lookup(scoring, batch->seq_a[k][x], (char)i,
+                         &substitution_penalty, &is_match);
+          if(scoring->no_mismatches && !is_match)
+            substitution_penalty = forbidden;
+        }
+        LANE_SET(prof[x], k, substitution_penalty);
+      }
+    }
+  }
+
+  prof = (simd_lanes_t*)(profiles + pad * cols);
+  for(x = 0; x < cols; x++)
+    for(k = 0; k < nlanes; k++) LANE_SET(prof[x], k, padding);
+
+  const score_t min = is_sw ? 0 : (bits == 16 ? INT16_MIN : SCORE_MIN) +
+                                  abs(scoring->min_penalty);
+  const simd_t vzero = simd_zero(), vones = VCMPEQ(vzero, vzero);
+  const simd_t vmin = VSET1(min), vone = VSET1(1);
+  const simd_t vopen = VSET1(scoring->gap_extend + scoring->gap_open);
+  const simd_t vextend = VSET1(scoring->gap_extend);
+  const simd_t vforbidden = VSET1(forbidden);
+  const simd_t vsaturated = VSET1(INT16_MAX);
+  simd_lanes_t len_a, len_b, lanes, row_slots;
+  simd_t last_col, last_row, ok_a_col, ok_a_last, ok_b_row, ok_b_last;
+  simd_t open_a, extend_a, open_b, extend_b, vx, sub, no_match;
+  simd_t from_m, from_a, from_b, new_m, new_a, new_b, src_m, src_a, src_b;
+  simd_t best = vzero, best_x = vzero, best_y = vzero;
+  simd_t row_best, row_x, better, saturated = vzero;
+
+  // Profile of each distinct character in the current row, and its lanes
+  const simd_t *row_prof[SIMD_LANES_I16];
+  simd_t row_mask[SIMD_LANES_I16];
+  size_t nrow;
+
+  // Unused lanes have empty sequences
+  for(k = 0; k < nlanes; k++) {
+    LANE_SET(len_a, k, k < n ? batch->len_a[k] : 0);
+    LANE_SET(len_b, k, k < n ? batch->len_b[k] : 0);
+  }
+
+  // first row
+  prev_m[0] = prev_a[0] = prev_b[0] = vzero;
+  for(x = 1; x < width; x++) {
+    if(is_sw) prev_m[x] = prev_a[x] = prev_b[x] = vzero;
+    else {
+      prev_m[x] = prev_a[x] = vmin;
+      prev_b[x] = VSET1(scoring->no_start_gap_penalty ? 0
+                        : scoring->gap_open + (int)x * scoring->gap_extend);
+    }
+  }
+
+  if(!is_sw) _batch_ends(batch, 0, prev_m, prev_a, prev_b, bits);
+
+  for(y = 1; y < height; y++)
+  {
+    for(k = 0; k < nlanes; k++) {
+      LANE_SET(row_slots, k, k < n && y <= batch->len_b[k]
+                             ? slots[(uint8_t)batch->seq_b[k][y-1]]
+                             : (int)pad);
+    }
+
+    for(k = nrow = 0; k < nlanes; k++) {
+      i = (size_t)LANE_GET(row_slots, k);
+      for(j = 0; j < nrow && row_prof[j] != profiles + i * cols; j++) {}
+      if(j == nrow) {
+        row_prof[nrow] = profiles + i * cols;
+        row_mask[nrow++] = VCMPEQ(row_slots.v, VSET1(i));
+      }
+    }
+
+    // first column
+    curr_m[0] = curr_b[0] = vmin;
+    curr_a[0] = vmin;
+    if(!is_sw) {
+      curr_a[0] = VSET1(scoring->no_start_gap_penalty ? 0
+                        : scoring->gap_open + (int)y * scoring->gap_extend);
+    }
+
+    // Gaps end free in the last row
+    last_row = VCMPEQ(VSET1(y), len_b.v);
+    open_b = vopen;
+    extend_b = vextend;
+    if(scoring->no_end_gap_penalty) {
+      open_b = simd_blend(last_row, vzero, vopen);
+      extend_b = simd_blend(last_row, vzero, vextend);
+    }
+
+    // Lanes that may step back into GAP_B from row y-1, and from row y
+    ok_b_row = !scoring->no_gaps_in_b || y == 1 ? vones : vzero;
+    ok_b_last = !scoring->no_gaps_in_b ? vones : last_row;
+
+    row_best = row_x = vx = vzero;
+
+    for(x = 1; x < width; x++)
+    {
+      vx = VADD(vx, vone);
+      last_col = VCMPEQ(vx, len_a.v);
+
+      // Lanes that may step back into GAP_A from column x-1, and from x
+      ok_a_col = !scoring->no_gaps_in_a || x == 1 ? vones : vzero;
+      ok_a_last = !scoring->no_gaps_in_a ? vones : last_col;
+
+      sub = row_prof[0][x-1];
+      for(j = 1; j < nrow; j++)
+        sub = simd_blend(row_mask[j], row_prof[j][x-1], sub);
+
+      // match_scores from [i-1][j-1]
+      from_m = VADD(prev_m[x-1], sub);
+      from_a = VADD(prev_a[x-1], sub);
+      from_b = VADD(prev_b[x-1], sub);
+      new_m = VMAX(VMAX(from_m, from_a), VMAX(from_b, vmin));
+      src_m = _batch_source(new_m, from_m, from_a, from_b,
+                            ok_a_col, ok_b_row, 2*MATCH, bits);
+      if(check_forbidden) {
+        no_match = VCMPEQ(sub, vforbidden);
+        new_m = simd_blend(no_match, vmin, new_m);
+        src_m = simd_blend(no_match, VSET1(TRACE_NONE << (2*MATCH)), src_m);
+      }
+
+      // gap_a_scores from [i][j-1], gaps ending free in the last column
+      open_a = vopen;
+      extend_a = vextend;
+      if(scoring->no_end_gap_penalty) {
+        open_a = simd_blend(last_col, vzero, vopen);
+        extend_a = simd_blend(last_col, vzero, vextend);
+      }
+      from_m = VADD(prev_m[x], open_a);
+      from_a = VADD(prev_a[x], extend_a);
+      from_b = VADD(prev_b[x], open_a);
+      new_a = VMAX(VMAX(from_m, from_a), VMAX(from_b, vmin));
+      if(scoring->no_gaps_in_a) new_a = simd_blend(last_col, new_a, vmin);
+      src_a = _batch_source(new_a, from_m, from_a, from_b,
+                            ok_a_last, ok_b_row, 2*GAP_A, bits);
+
+      // gap_b_scores from [i-1][j]
+      from_m = VADD(curr_m[x-1], open_b);
+      from_a = VADD(curr_a[x-1], open_b);
+      from_b = VADD(curr_b[x-1], extend_b);
+      new_b = VMAX(VMAX(from_m, from_a), VMAX(from_b, vmin));
+      if(scoring->no_gaps_in_b) new_b = simd_blend(last_row, new_b, vmin);
+      src_b = _batch_source(new_b, from_m, from_a, from_b,
+                            ok_a_col, ok_b_last, 2*GAP_B, bits);
+
+      if(is_sw)
+      {
+        // A local alignment starts where its score drops to 0
+        src_m = simd_blend(VCMPEQ(new_m, vzero),
+                           VSET1(TRACE_NONE << (2*MATCH)), src_m);
+        src_a = simd_blend(VCMPEQ(new_a, vzero),
+                           VSET1(TRACE_NONE << (2*GAP_A)), src_a);
+        src_b = simd_blend(VCMPEQ(new_b, vzero),
+                           VSET1(TRACE_NONE << (2*GAP_B)), src_b);
+
+        // Leftmost best in this row
+        better = VCMPGT(new_m, row_best);
+        row_best = VMAX(row_best, new_m);
+        row_x = simd_blend(better, vx, row_x);
+
+        // Local scores only go up, so a lane that hit the top has saturated
+        if(bits == 16) {
+          saturated = simd_or(saturated,
+                              simd_or(VCMPEQ(new_m, vsaturated),
+                                      simd_or(VCMPEQ(new_a, vsaturated),
+                                              VCMPEQ(new_b, vsaturated))));
+        }
+      }
+
+      curr_m[x] = new_m;
+      curr_a[x] = new_a;
+      curr_b[x] = new_b;
+      traceback[(y-1)*cols + x-1] = simd_or(src_m, simd_or(src_a, src_b));
+    }
+
+    if(is_sw) {
+      better = simd_or(VCMPGT(row_best, best),
+                       simd_and(VCMPEQ(row_best, best),
+                                VCMPGT(best_x, row_x)));
+      best = simd_blend(better, row_best, best);
+      best_x = simd_blend(better, row_x, best_x);
+      best_y = simd_blend(better, VSET1(y), best_y);
+    }
+    else _batch_ends(batch, y, curr_m, curr_a, curr_b, bits);
+
+    tmp = prev_m; prev_m = curr_m; curr_m = tmp;
+    tmp = prev_a; prev_a = curr_a; curr_a = tmp;
+    tmp = prev_b; prev_b = curr_b; curr_b = tmp;
+  }
+
+  if(is_sw)
+  {
+    simd_lanes_t score, end_a, end_b;
+    score.v = best;
+    end_a.v = best_x;
+    end_b.v = best_y;
+
+    // No hit scoring more than 0 leaves an empty path
+    for(k = 0; k < n; k++) {
+      batch->score[k] = LANE_GET(score, k);
+      batch->end_a[k] = (size_t)LANE_GET(end_a, k);
+      batch->end_b[k] = (size_t)LANE_GET(end_b, k);
+      batch->end_matrix[k] = MATCH;
+    }
+
+    if(bits == 16) {
+      lanes.v = saturated;
+      for(k = 0; k < n; k++) batch->saturated[k] |= (LANE_GET(lanes, k) != 0);
+    }
+  }
+  else if(bits == 16)
+  {
+    // A global alignment ending on the floor never had a real path: redo it
+    // so it reports the same score as aligner_align()
+    for(k = 0; k < n; k++) {
+      if(batch->score[k] < -_batch_score_bound(scoring, batch->len_a[k],
+                                               batch->len_b[k]))
+        batch->saturated[k] = true;
+    }
+  }
+}
+
+#undef VSET1
+#undef VADD
+#undef VMAX
+#undef VCMPEQ
+#undef VCMPGT
+#undef LANE_SET
+#undef LANE_GET
+
+// Trace back the k-th pair of the last batch into result, following the
+// traceback bits of each cell as alignment_traceback_move() does
+static void _batch_traceback(const aligner_batch_t *batch, size_t k,
+                             aligner_t *aligner, alignment_t *result)
+{
+  const size_t nlanes = SIMD_BYTES * 8 / batch->bits;
+  const size_t cols = batch->width-1;
+  const void *traceback = SIMD_ALIGN(batch->mem);
+  const char *seq_a = batch->seq_a[k], *seq_b = batch->seq_b[k];
+
+  size_t x = batch->end_a[k], y = batch->end_b[k], index, num_moves = 0;
+  enum Matrix curr_matrix = (enum Matrix)batch->end_matrix[k];
+  uint8_t *moves = aligner_moves(aligner, batch->len_a[k] + batch->len_b[k]);
+  int from;
+
+  while(x > 0 && y > 0)
+  {
+    index = ((y-1)*cols + x-1)*nlanes + k;
+    from = batch->bits == 16 ? ((const int16_t*)traceback)[index]
+                             : ((const int32_t*)traceback)[index];
+    from = (from >> (2*curr_matrix)) & 3;
+
+    if(from == TRACE_NONE)
+    {
+      // Local alignments stop on a score of 0
+      if(batch->is_sw) break;
+      fprintf(stderr, "%s:%i: Program error: traceback fail at %zu,%zu\n",
+              __FILE__, __LINE__, x, y);
+      exit(EXIT_FAILURE);
+    }
+
+    moves[num_moves++] = curr_matrix;
+
+    switch(curr_matrix)
+    {
+      case MATCH: x--; y--; break;
+      case GAP_A: y--; break;
+      default: x--; break;
+    }
+
+    curr_matrix = (enum Matrix)from;
+  }
+
+  if(batch->is_sw)
+  {
+    alignment_from_moves(result, moves, num_moves, seq_a + x, seq_b + y,
+                         batch->scoring->case_sensitive);
+    result->pos_a = x;
+    result->pos_b = y;
+    result->len_a = batch->end_a[k] - x;
+    result->len_b = batch->end_b[k] - y;
+  }
+  else
+  {
+    // Gap in A, then gap in B, at the start
+    memset(moves + num_moves, GAP_A, y);
+    num_moves += y;
+    memset(moves + num_moves, GAP_B, x);
+    num_moves += x;
+    alignment_from_moves(result, moves, num_moves, seq_a, seq_b,
+                         batch->scoring->case_sensitive);
+  }
+
+  result->score = batch->score[k];
+}
+
+#endif /* SEQ_ALIGN_SIMD */
+
+void aligner_batch_align(aligner_batch_t *batch,
+                         const char *const *seqs_a, const char *const *seqs_b,
+                         const size_t *lens_a, const size_t *lens_b, size_t n,
+                         const scoring_t *scoring, char is_sw,
+                         alignment_t **results, aligner_t *aligner,
+                         aligner_batch_fn fn, void *arg)
+{
+  size_t i;
+  _batch_order(batch, lens_a, lens_b, n);
+  const size_t *order = batch->order;
+
+  #ifdef SEQ_ALIGN_SIMD
+  size_t k, m, nredo = 0, *redo = batch->order + n;
+  (void)fn;
+  (void)arg;
+
+  // 16 bit scores first, keeping track of pairs that need redoing
+  for(i = 0; i < n; i += m)
+  {
+    m = MIN2(SIMD_LANES_I16, n-i);
+    _batch_fill(batch, seqs_a, seqs_b, lens_a, lens_b, order+i, m,
+                scoring, is_sw, 16);
+
+    for(k = 0; k < m; k++) {
+      if(batch->saturated[k]) redo[nredo++] = order[i+k];
+      else _batch_traceback(batch, k, aligner, results[order[i+k]]);
+    }
+  }
+
+  for(i = 0; i < nredo; i += m)
+  {
+    m = MIN2(SIMD_LANES_I32, nredo-i);
+    _batch_fill(batch, seqs_a, seqs_b, lens_a, lens_b, redo+i, m,
+                scoring, is_sw, 32);
+
+    for(k = 0; k < m; k++)
+      _batch_traceback(batch, k, aligner, results[redo[i+k]]);
+  }
+  #else
+  (void)results;
+  for(i = 0; i < n; i++) {
+    aligner_align(aligner, seqs_a[order[i]], seqs_b[order[i]],
+                  lens_a[order[i]], lens_b[order[i]], scoring, is_sw);
+    fn(aligner, order[i], arg);
+  }
+  #endif
+}
@@ -0,0 +1,72 @@
+/*
+ alignment_batch.h
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+#ifndef ALIGNMENT_BATCH_HEADER_SEEN
+#define ALIGNMENT_BATCH_HEADER_SEEN
+
+#include <string.h> // memset
+#include "alignment.h"
+
+// Most pairs a single batch can hold
+#define ALIGNER_BATCH_MAX 64
+
+// Workspace for aligning several pairs at once, one pair per SIMD lane.
+// Vectors are interleaved: one holds the same cell of every pair, padded out
+// to the longest sequences in the batch.  Only two rows of scores are kept,
+// plus a vector per cell of the traceback bits of each lane (as in
+// aligner_align_compact), so each pair is traced back in place.
+typedef struct
+{
+  char *mem;
+  size_t capacity;
+  size_t *order, order_capacity; // pairs sorted by length, then pairs to redo
+  // Last batch filled
+  const scoring_t *scoring;
+  const char *seq_a[ALIGNER_BATCH_MAX], *seq_b[ALIGNER_BATCH_MAX];
+  size_t len_a[ALIGNER_BATCH_MAX], len_b[ALIGNER_BATCH_MAX];
+  bool saturated[ALIGNER_BATCH_MAX];
+  // Where each traceback starts: cell (end_a,end_b) in matrix end_matrix
+  size_t end_a[ALIGNER_BATCH_MAX], end_b[ALIGNER_BATCH_MAX];
+  uint8_t end_matrix[ALIGNER_BATCH_MAX];
+  score_t score[ALIGNER_BATCH_MAX];
+  size_t num_pairs, width, height, bits;
+  char is_sw;
+} aligner_batch_t;
+
+// Without SIMD support, called once per pair with its matrices filled in
+// aligner, as if by aligner_align(), to read out its result.  i is the index
+// of the pair.
+typedef void (*aligner_batch_fn)(aligner_t *aligner, size_t i, void *arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define aligner_batch_init(b) (memset(b, 0, sizeof(aligner_batch_t)))
+void aligner_batch_destroy(aligner_batch_t *batch);
+
+// Align n pairs, seqs_a[i] against seqs_b[i], into results[i].  Pairs are
+// sorted by length so that pairs of a similar size share a batch, and are
+// filled with 16 bit scores where they fit: pairs whose scores saturate are
+// filled again with 32 bits.  Global alignments (no is_sw) are those of
+// needleman_wunsch_align2(), local ones the first hit smith_waterman_fetch()
+// would return, or an empty result with score 0 if there is none.  aligner
+// holds the path of each traceback.  Without SIMD support each pair is just
+// passed through aligner_align() and then to fn.
+void aligner_batch_align(aligner_batch_t *batch,
+                         const char *const *seqs_a, const char *const *seqs_b,
+                         const size_t *lens_a, const size_t *lens_b, size_t n,
+                         const scoring_t *scoring, char is_sw,
+                         alignment_t **results, aligner_t *aligner,
+                         aligner_batch_fn fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ALIGNMENT_BATCH_HEADER_SEEN */
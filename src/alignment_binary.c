@@ -0,0 +1,141 @@
+/*
+ alignment_binary.c
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+// request decent POSIX version
+#define _XOPEN_SOURCE 700
+#define _BSD_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alignment_binary.h"
+
+struct binary_reader_t
+{
+  char *data;
+  size_t size, offset;
+};
+
+// Bytes of CIGAR following a record, padded to keep records 8 byte aligned
+#define binary_cigar_bytes(n) ((((size_t)(n)+1)/2)*2*sizeof(uint32_t))
+
+void binary_write_header(FILE *out)
+{
+  binary_header_t header;
+  memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+  header.version = BINARY_VERSION;
+  header.byte_order = BINARY_BYTE_ORDER;
+  fwrite(&header, sizeof(header), 1, out);
+}
+
+void binary_write_record(FILE *out, size_t index, const alignment_t *result)
+{
+  binary_record_t rec;
+  size_t n = result->cigar_only ? result->cigar.n : 0;
+
+  rec.index = index;
+  rec.score = result->score;
+  rec.n_cigar = (uint32_t)n;
+  rec.pos_a = result->pos_a;
+  rec.pos_b = result->pos_b;
+  rec.len_a = result->len_a;
+  rec.len_b = result->len_b;
+
+  fwrite(&rec, sizeof(rec), 1, out);
+
+  if(n > 0)
+  {
+    const uint32_t pad = 0;
+    fwrite(result->cigar.ops, sizeof(uint32_t), n, out);
+    if(n & 1) fwrite(&pad, sizeof(pad), 1, out);
+  }
+}
+
+void binary_write_score(FILE *out, size_t index, score_t score,
+                        size_t len_a, size_t len_b)
+{
+  binary_record_t rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.index = index;
+  rec.score = score;
+  rec.len_a = len_a;
+  rec.len_b = len_b;
+  fwrite(&rec, sizeof(rec), 1, out);
+}
+
+binary_reader_t* binary_reader_open(const char *path)
+{
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if(fd < 0) return NULL;
+
+  if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+     (size_t)st.st_size < sizeof(binary_header_t)) {
+    close(fd);
+    return NULL;
+  }
+
+  size_t size = (size_t)st.st_size;
+  char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if(data == MAP_FAILED) return NULL;
+
+  const binary_header_t *header = (const binary_header_t*)data;
+
+  if(memcmp(header->magic, BINARY_MAGIC, sizeof(header->magic)) != 0 ||
+     header->version != BINARY_VERSION ||
+     header->byte_order != BINARY_BYTE_ORDER)
+  {
+    munmap(data, size);
+    return NULL;
+  }
+
+  binary_reader_t *bin = malloc(sizeof(binary_reader_t));
+  if(bin == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+
+  bin->data = data;
+  bin->size = size;
+  bin->offset = sizeof(binary_header_t);
+  return bin;
+}
+
+bool binary_reader_next(binary_reader_t *bin, const binary_record_t **rec,
+                        const uint32_t **cigar)
+{
+  size_t remaining = bin->size - bin->offset;
+
+  if(remaining < sizeof(binary_record_t)) return false;
+
+  const binary_record_t *r = (const binary_record_t*)(bin->data + bin->offset);
+  size_t bytes = sizeof(binary_record_t) + binary_cigar_bytes(r->n_cigar);
+
+  if(remaining < bytes) return false;
+
+  *rec = r;
+  *cigar = (const uint32_t*)(r + 1);
+  bin->offset += bytes;
+  return true;
+}
+
+void binary_reader_close(binary_reader_t *bin)
+{
+  munmap(bin->data, bin->size);
+  free(bin);
+}
@@ -0,0 +1,64 @@
+/*
+ alignment_binary.h
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+#ifndef ALIGNMENT_BINARY_HEADER_SEEN
+#define ALIGNMENT_BINARY_HEADER_SEEN
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "alignment.h"
+
+// --binary-out stream: a 16 byte header then one record per alignment, each
+// followed by its CIGAR ops (as in alignment_cigar_t) padded to a multiple of
+// 8 bytes.  Every record starts 8 byte aligned so a mapped file can be read in
+// place.  Integers are in the writer's byte order, see BINARY_BYTE_ORDER.
+#define BINARY_MAGIC "SQALNBIN"
+#define BINARY_VERSION 1
+#define BINARY_BYTE_ORDER 0x01020304
+
+typedef struct
+{
+  char magic[8];
+  uint32_t version, byte_order;
+} binary_header_t;
+
+typedef struct
+{
+  uint64_t index; // pair index in the input
+  int32_t score;
+  uint32_t n_cigar; // 0 if written without a CIGAR
+  uint64_t pos_a, pos_b, len_a, len_b;
+} binary_record_t;
+
+void binary_write_header(FILE *out);
+
+// Write result as pair number index.  The CIGAR is included if result was
+// made with cigar_only set.
+void binary_write_record(FILE *out, size_t index, const alignment_t *result);
+
+// Record with just a score, as written by --scoreonly
+void binary_write_score(FILE *out, size_t index, score_t score,
+                        size_t len_a, size_t len_b);
+
+// Reads a --binary-out file in place through mmap()
+typedef struct binary_reader_t binary_reader_t;
+
+// Returns NULL if path can't be mapped or doesn't start with a valid header
+// in this machine's byte order
+binary_reader_t* binary_reader_open(const char *path);
+
+// Point rec and cigar (rec->n_cigar ops) at the next record in the mapped
+// file.  They are valid until binary_reader_close().  Returns false at the end
+// of the file or if the last record is truncated.
+bool binary_reader_next(binary_reader_t *bin, const binary_record_t **rec,
+                        const uint32_t **cigar);
+
+void binary_reader_close(binary_reader_t *bin);
+
+#endif
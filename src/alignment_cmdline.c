@@ -17,11 +17,16 @@
 #include <stdio.h>
 #include <limits.h> // INT_MIN
 #include <stdarg.h> // for va_list
+#include <pthread.h>
+#include <time.h> // clock_gettime
+#include <unistd.h> // close
 
 #include "seq_file/seq_file.h"
 
 #include "alignment.h"
 #include "alignment_cmdline.h"
+#include "alignment_gzip.h"
+#include "alignment_mmap.h"
 #include "alignment_scoring_load.h"
 
 // File loading
@@ -122,6 +127,8 @@ static void print_usage(enum SeqAlignCmdType cmd_type, score_t defaults[4],
 "                         [default: match * MAX(0.2 * length, 2)]\n"
 "    --maxhits <hits>     Maximum number of results per alignment\n"
 "                         [default: no limit]\n"
+"    --linear             Find hits in linear memory (Waterman-Eggert), each\n"
+"                         avoiding the cells of those before it\n"
 "\n"
 "    --context <n>        Print <n> bases of context\n"
 "    --printseq           Print sequences before local alignments\n");
@@ -135,19 +142,34 @@ static void print_usage(enum SeqAlignCmdType cmd_type, score_t defaults[4],
 "    --freeendgap         No penalty for gap at end of alignment\n"
 "\n"
 "    --printscores        Print optimal alignment scores\n"
-"    --zam                A funky type of output\n");
+"    --zam                A funky type of output\n"
+"    --linear             Align in linear memory (for long sequences)\n"
+"    --compact            Keep 1 byte of traceback per cell, not the matrices\n");
   }
 
   fprintf(stderr,
+"    --scoreonly          Only print the score of the best alignment\n"
+"    --band <w|auto>      Only align within <w> diagonals of the ends.  'auto'\n"
+"                         starts at %i and widens while the best alignment\n"
+"                         touches the edge of the band\n"
+"    --threads <n>        Align pairs from files on <n> threads [default: 1]\n"
+"    --fillthreads <n>    Fill each pair's matrices on <n> threads [default: 1]\n"
+"    --stats              Print time spent reading, aligning and writing\n"
 "    --printmatrices      Print dynamic programming matrices\n"
 "    --printfasta         Print fasta header lines\n"
 "    --pretty             Print with a descriptor line\n"
 "    --colour             Print with colour\n"
+"    --format <f>         Print as text (default), cigar, paf or sam.  Other\n"
+"                         formats give one line per alignment, with CIGAR\n"
+"                         '='/'X' ops and NM/AS tags\n"
+"    --binary-out         Write fixed size binary records (see\n"
+"                         alignment_binary.h) instead of text\n"
 "\n"
 "  Experimental Options:\n"
 "    --nogapsin1          No gaps allowed within the first sequence\n"
 "    --nogapsin2          No gaps allowed within the second sequence\n"
-"    --nogaps             No gaps allowed in either sequence\n");
+"    --nogaps             No gaps allowed in either sequence\n",
+          CMDLINE_AUTO_BAND);
 
   fprintf(stderr,
 "    --nomismatches       No mismatches allowed%s\n",
@@ -185,6 +207,7 @@ cmdline_t* cmdline_new(int argc, char **argv, scoring_t *scoring,
   cmd->file_paths1 = malloc(sizeof(char*) * cmd->file_list_capacity);
   cmd->file_paths2 = malloc(sizeof(char*) * cmd->file_list_capacity);
   cmd->seq1 = cmd->seq2 = NULL;
+  cmd->nthreads = cmd->fill_threads = 1;
   // All values initially 0
 
   // Store defaults
@@ -322,6 +345,30 @@ cmdline_t* cmdline_new(int argc, char **argv, scoring_t *scoring,
           usage("--zam only valid with Needleman-Wunsch");
         cmd->zam_stle_output = true;
       }
+      else if(strcasecmp(argv[argi], "--linear") == 0)
+      {
+        if(cmd_type == SEQ_ALIGN_LCS_CMD)
+          usage("--linear only valid with Needleman-Wunsch or Smith-Waterman");
+        cmd->linear_space = true;
+      }
+      else if(strcasecmp(argv[argi], "--compact") == 0)
+      {
+        if(cmd_type != SEQ_ALIGN_NW_CMD)
+          usage("--compact only valid with Needleman-Wunsch");
+        cmd->compact = true;
+      }
+      else if(strcasecmp(argv[argi], "--scoreonly") == 0)
+      {
+        cmd->score_only = true;
+      }
+      else if(strcasecmp(argv[argi], "--stats") == 0)
+      {
+        cmd->print_stats = true;
+      }
+      else if(strcasecmp(argv[argi], "--binary-out") == 0)
+      {
+        cmd->binary_out = true;
+      }
       else if(strcasecmp(argv[argi], "--stdin") == 0)
       {
         // Similar to --file argument below
@@ -388,6 +435,51 @@ cmdline_t* cmdline_new(int argc, char **argv, scoring_t *scoring,
 
         argi++;
       }
+      else if(strcasecmp(argv[argi], "--band") == 0)
+      {
+        if(strcasecmp(argv[argi+1], "auto") == 0)
+        {
+          cmd->band = CMDLINE_AUTO_BAND;
+          cmd->band_widen = true;
+        }
+        else if(!parse_entire_uint(argv[argi+1], &cmd->band))
+          usage("Invalid --band <w> argument (must be >= 0 or 'auto')");
+
+        cmd->band_set = true;
+
+        argi++;
+      }
+      else if(strcasecmp(argv[argi], "--threads") == 0)
+      {
+        if(!parse_entire_uint(argv[argi+1], &cmd->nthreads) ||
+           cmd->nthreads == 0)
+          usage("Invalid --threads <n> argument (must be > 0)");
+
+        argi++;
+      }
+      else if(strcasecmp(argv[argi], "--fillthreads") == 0)
+      {
+        if(!parse_entire_uint(argv[argi+1], &cmd->fill_threads) ||
+           cmd->fill_threads == 0)
+          usage("Invalid --fillthreads <n> argument (must be > 0)");
+
+        argi++;
+      }
+      else if(strcasecmp(argv[argi], "--format") == 0)
+      {
+        if(strcasecmp(argv[argi+1], "text") == 0)
+          cmd->format = SEQ_ALIGN_FORMAT_TEXT;
+        else if(strcasecmp(argv[argi+1], "cigar") == 0)
+          cmd->format = SEQ_ALIGN_FORMAT_CIGAR;
+        else if(strcasecmp(argv[argi+1], "paf") == 0)
+          cmd->format = SEQ_ALIGN_FORMAT_PAF;
+        else if(strcasecmp(argv[argi+1], "sam") == 0)
+          cmd->format = SEQ_ALIGN_FORMAT_SAM;
+        else
+          usage("Unknown --format choice, not one of text|cigar|paf|sam");
+
+        argi++;
+      }
       else if(strcasecmp(argv[argi], "--context") == 0)
       {
         if(cmd_type != SEQ_ALIGN_SW_CMD)
@@ -528,6 +620,69 @@ cmdline_t* cmdline_new(int argc, char **argv, scoring_t *scoring,
           "--zam");
   }
 
+  if(cmd->linear_space && cmd->print_matrices)
+  {
+    usage("Cannot use --printmatrices with --linear");
+  }
+
+  if(cmd->score_only &&
+     (cmd->print_matrices || cmd->band_set || cmd->linear_space ||
+      cmd->zam_stle_output))
+  {
+    usage("Cannot use --printmatrices, --band, --linear or --zam with "
+          "--scoreonly");
+  }
+
+  if(cmd->linear_space && cmd->band_set)
+  {
+    usage("Cannot use --band with --linear");
+  }
+
+  if(cmd->compact &&
+     (cmd->print_matrices || cmd->band_set || cmd->linear_space ||
+      cmd->score_only))
+  {
+    usage("Cannot use --printmatrices, --band, --linear or --scoreonly with "
+          "--compact");
+  }
+
+  if(cmd->format != SEQ_ALIGN_FORMAT_TEXT &&
+     (cmd->print_matrices || cmd->zam_stle_output || cmd->score_only ||
+      cmd->print_pretty || cmd->print_colour || cmd->print_fasta ||
+      cmd->print_scores || cmd->print_seq || cmd->print_context))
+  {
+    usage("Cannot use --printmatrices, --zam, --scoreonly, --pretty, --colour, "
+          "--printfasta, --printscores, --printseq or --context with --format");
+  }
+
+  if(cmd->binary_out &&
+     (cmd->format != SEQ_ALIGN_FORMAT_TEXT || cmd->print_matrices ||
+      cmd->zam_stle_output || cmd->print_pretty || cmd->print_colour ||
+      cmd->print_fasta || cmd->print_scores || cmd->print_seq ||
+      cmd->print_context || cmd->interactive))
+  {
+    usage("Cannot use --format, --printmatrices, --zam, --pretty, --colour, "
+          "--printfasta, --printscores, --printseq, --context or --stdin with "
+          "--binary-out");
+  }
+
+  if(cmd->binary_out && isatty(fileno(stdout)))
+  {
+    usage("Not writing --binary-out to a terminal, redirect stdout");
+  }
+
+  if(cmd->nthreads > 1 && (cmd->print_matrices || cmd->interactive))
+  {
+    usage("Cannot use --printmatrices or --stdin with --threads");
+  }
+
+  // Scoring is fixed from here on
+  scoring_compile(scoring);
+
+  // Flush output as the buffer fills, unless someone is watching
+  if(!cmd->interactive && !isatty(fileno(stdout)))
+    setvbuf(stdout, NULL, _IOFBF, CMDLINE_OUTPUT_BUFFER);
+
   return cmd;
 }
 
@@ -567,60 +722,464 @@ char* cmdline_get_file2(cmdline_t *cmd, size_t i)
   return cmd->file_paths2[i];
 }
 
-static seq_file_t* open_seq_file(const char *path, bool use_zlib)
+// An input file.  Uncompressed files are read in place through mmap, gzip is
+// decompressed on background threads when not reading interactively.
+typedef struct
 {
-  return (strcmp(path,"-") != 0 || use_zlib) ? seq_open(path)
-                                             : seq_dopen(fileno(stdin), false, false, 0);
+  const char *path;
+  seq_file_t *sf;
+  gzip_reader_t *gz;
+  mmap_reader_t *map;
+} align_input_t;
+
+static bool align_input_open(align_input_t *in, const char *path,
+                             bool use_zlib, size_t nthreads)
+{
+  memset(in, 0, sizeof(align_input_t));
+  in->path = path;
+
+  if(strcmp(path,"-") == 0)
+  {
+    in->sf = use_zlib ? seq_open(path)
+                      : seq_dopen(fileno(stdin), false, false, 0);
+  }
+  else if((in->map = mmap_reader_open(path)) != NULL)
+  {
+    return true;
+  }
+  else if(nthreads > 0 && (in->gz = gzip_reader_open(path, nthreads)) != NULL)
+  {
+    if((in->sf = seq_dopen(gzip_reader_fd(in->gz), false, false, 0)) == NULL) {
+      close(gzip_reader_fd(in->gz));
+      gzip_reader_close(in->gz);
+      in->gz = NULL;
+    }
+  }
+  else
+  {
+    in->sf = seq_open(path);
+  }
+
+  return in->sf != NULL;
 }
 
-// If seq2 is NULL, read pair of entries from first file
-// Otherwise read an entry from each
-void align_from_file(const char *path1, const char *path2,
-                     void (align)(read_t *r1, read_t *r2),
-                     bool use_zlib)
+static void align_input_close(align_input_t *in)
 {
-  seq_file_t *sf1, *sf2;
-
-  if((sf1 = open_seq_file(path1, use_zlib)) == NULL)
+  if(in->map != NULL)
   {
-    fprintf(stderr, "Alignment Error: couldn't open file %s\n", path1);
-    fflush(stderr);
+    mmap_reader_close(in->map);
     return;
   }
 
-  if(path2 == NULL)
+  seq_close(in->sf);
+
+  if(in->gz != NULL && !gzip_reader_close(in->gz))
   {
-    sf2 = sf1;
+    fprintf(stderr, "Alignment Error: corrupt gzip input %s\n", in->path);
+    fflush(stderr);
   }
-  else if((sf2 = open_seq_file(path2, use_zlib)) == NULL)
+}
+
+// Read into view, which may point into the file or into buf
+static bool align_input_read(align_input_t *in, read_t *view, read_t *buf)
+{
+  if(in->map != NULL) return mmap_reader_read(in->map, view, buf);
+  if(seq_read(in->sf, buf) <= 0) return false;
+  *view = *buf;
+  return true;
+}
+
+// Pairs in flight per aligning thread
+#define ALIGN_JOBS_PER_THREAD 4
+
+// A pair read for the worker threads, and its output once aligned
+typedef struct
+{
+  read_t read1, read2; // buffers
+  read_t view1, view2; // the pair, in the buffers or the input files
+  size_t index;
+  char *output;
+  size_t output_len;
+  bool done;
+} align_job_t;
+
+// Pairs pass through three stages, each on its own thread(s):
+//   read:  a reader thread decodes pair i into jobs[i % njobs]
+//   align: workers align pairs next_job..num_read-1, printing into memory
+//   write: the calling thread writes pair num_written to stdout once done
+// The reader waits for pair i-njobs to be written before reusing its slot, so
+// at most njobs pairs are held at once and output stays in input order.
+typedef struct
+{
+  align_job_t *jobs;
+  size_t njobs, num_read, next_job, num_written;
+  bool finished;
+  align_input_t *in1, *in2;
+  align_pair_fn align;
+  pthread_mutex_t lock;
+  pthread_cond_t job_ready, job_done, slot_free;
+  double read_time, write_time; // seconds busy
+} align_pool_t;
+
+typedef struct
+{
+  align_pool_t *pool;
+  void *state;
+  double align_time; // seconds busy
+} align_worker_t;
+
+static double align_clock()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Read the next pair, returns false at the end of input
+static bool align_read_pair(align_input_t *in1, align_input_t *in2,
+                            read_t *view1, read_t *view2,
+                            read_t *read1, read_t *read2)
+{
+  if(!align_input_read(in1, view1, read1)) return false;
+
+  if(!align_input_read(in2, view2, read2))
   {
-    fprintf(stderr, "Alignment Error: couldn't open file %s\n", path1);
+    fprintf(stderr, "Alignment Error: Odd number of sequences - "
+                    "I read in pairs!\n");
     fflush(stderr);
-    return;
+    return false;
+  }
+
+  return true;
+}
+
+static void* align_reader_run(void *arg)
+{
+  align_pool_t *pool = (align_pool_t*)arg;
+  align_job_t *job;
+  double start;
+  bool more;
+
+  while(1)
+  {
+    // Wait for the slot's previous pair to be written out
+    pthread_mutex_lock(&pool->lock);
+    while(pool->num_read - pool->num_written == pool->njobs)
+      pthread_cond_wait(&pool->slot_free, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    job = &pool->jobs[pool->num_read % pool->njobs];
+
+    start = align_clock();
+    more = align_read_pair(pool->in1, pool->in2, &job->view1, &job->view2,
+                           &job->read1, &job->read2);
+    pool->read_time += align_clock() - start;
+
+    if(!more) break;
+
+    job->index = pool->num_read;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->num_read++;
+    pthread_cond_signal(&pool->job_ready);
+    pthread_mutex_unlock(&pool->lock);
   }
 
-  // fprintf(stderr, "File buffer %zu zlib: %i\n", sf1->in.size, seq_use_gzip(sf1));
+  pthread_mutex_lock(&pool->lock);
+  pool->finished = true;
+  pthread_cond_broadcast(&pool->job_ready);
+  pthread_cond_broadcast(&pool->job_done);
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+static void* align_worker_run(void *arg)
+{
+  align_worker_t *worker = (align_worker_t*)arg;
+  align_pool_t *pool = worker->pool;
+  align_job_t *job;
+  FILE *out;
+  double start;
+
+  while(1)
+  {
+    pthread_mutex_lock(&pool->lock);
+    while(pool->next_job == pool->num_read && !pool->finished)
+      pthread_cond_wait(&pool->job_ready, &pool->lock);
+
+    if(pool->next_job == pool->num_read) {
+      pthread_mutex_unlock(&pool->lock);
+      break;
+    }
+
+    job = &pool->jobs[pool->next_job++ % pool->njobs];
+    pthread_mutex_unlock(&pool->lock);
+
+    if((out = open_memstream(&job->output, &job->output_len)) == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+
+    start = align_clock();
+    pool->align(&job->view1, &job->view2, job->index, out, worker->state);
+    fclose(out);
+    worker->align_time += align_clock() - start;
+
+    pthread_mutex_lock(&pool->lock);
+    job->done = true;
+    pthread_cond_broadcast(&pool->job_done);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  return NULL;
+}
+
+// Write out pairs in input order as they are aligned until the reader has
+// finished and every pair it read has been written
+static void align_pool_write(align_pool_t *pool)
+{
+  align_job_t *job;
+  double start;
+  bool done;
+
+  while(1)
+  {
+    job = &pool->jobs[pool->num_written % pool->njobs];
+
+    pthread_mutex_lock(&pool->lock);
+    while(!job->done &&
+          !(pool->finished && pool->num_written == pool->num_read))
+      pthread_cond_wait(&pool->job_done, &pool->lock);
+    done = job->done;
+    pthread_mutex_unlock(&pool->lock);
+
+    if(!done) break;
+
+    start = align_clock();
+    fwrite(job->output, 1, job->output_len, stdout);
+    pool->write_time += align_clock() - start;
+
+    free(job->output);
+    job->output = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    job->done = false;
+    pool->num_written++;
+    pthread_cond_signal(&pool->slot_free);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+static size_t align_pairs_threaded(align_input_t *in1, align_input_t *in2,
+                                   align_pair_fn align, void **states,
+                                   size_t nthreads, align_stats_t *stats)
+{
+  align_pool_t pool;
+  memset(&pool, 0, sizeof(pool));
+  pool.njobs = nthreads * ALIGN_JOBS_PER_THREAD;
+  pool.in1 = in1;
+  pool.in2 = in2;
+  pool.align = align;
+  pool.jobs = calloc(pool.njobs, sizeof(align_job_t));
+  pthread_t reader, *threads = malloc(nthreads * sizeof(pthread_t));
+  align_worker_t *workers = calloc(nthreads, sizeof(align_worker_t));
+
+  if(pool.jobs == NULL || threads == NULL || workers == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t i;
+
+  for(i = 0; i < pool.njobs; i++) {
+    seq_read_alloc(&pool.jobs[i].read1);
+    seq_read_alloc(&pool.jobs[i].read2);
+  }
+
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.job_ready, NULL);
+  pthread_cond_init(&pool.job_done, NULL);
+  pthread_cond_init(&pool.slot_free, NULL);
+
+  if(pthread_create(&reader, NULL, align_reader_run, &pool) != 0) {
+    fprintf(stderr, "Error: couldn't start reader thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for(i = 0; i < nthreads; i++) {
+    workers[i].pool = &pool;
+    workers[i].state = states[i];
+    if(pthread_create(&threads[i], NULL, align_worker_run, &workers[i]) != 0) {
+      fprintf(stderr, "Error: couldn't start thread %zu\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  align_pool_write(&pool);
+
+  pthread_join(reader, NULL);
+  for(i = 0; i < nthreads; i++) pthread_join(threads[i], NULL);
+
+  stats->read += pool.read_time;
+  stats->write += pool.write_time;
+  for(i = 0; i < nthreads; i++) stats->align += workers[i].align_time;
+
+  pthread_cond_destroy(&pool.slot_free);
+  pthread_cond_destroy(&pool.job_done);
+  pthread_cond_destroy(&pool.job_ready);
+  pthread_mutex_destroy(&pool.lock);
+
+  for(i = 0; i < pool.njobs; i++) {
+    seq_read_dealloc(&pool.jobs[i].read1);
+    seq_read_dealloc(&pool.jobs[i].read2);
+  }
+
+  free(pool.jobs);
+  free(threads);
+  free(workers);
+
+  return pool.num_read;
+}
 
-  read_t read1, read2;
+static size_t align_pairs(align_input_t *in1, align_input_t *in2,
+                          align_pair_fn align, void *state,
+                          align_stats_t *stats)
+{
+  read_t read1, read2, view1, view2;
   seq_read_alloc(&read1);
   seq_read_alloc(&read2);
 
-  // Loop while we can read a sequence from the first file
-  unsigned long alignments;
+  // Loop while we can read a pair
+  size_t alignments;
+  double start = align_clock(), end;
 
-  for(alignments = 0; seq_read(sf1, &read1) > 0; alignments++)
+  for(alignments = 0;
+      align_read_pair(in1, in2, &view1, &view2, &read1, &read2);
+      alignments++)
   {
-    if(seq_read(sf2, &read2) <= 0)
-    {
-      fprintf(stderr, "Alignment Error: Odd number of sequences - "
-                      "I read in pairs!\n");
-      fflush(stderr);
+    end = align_clock();
+    stats->read += end - start;
+
+    (align)(&view1, &view2, alignments, stdout, state);
+
+    start = align_clock();
+    stats->align += start - end;
+  }
+
+  stats->read += align_clock() - start;
+
+  // Free memory
+  seq_read_dealloc(&read1);
+  seq_read_dealloc(&read2);
+
+  return alignments;
+}
+
+void align_stats_print(const align_stats_t *stats, FILE *out)
+{
+  double wall = stats->wall > 0 ? stats->wall : 1;
+  size_t nthreads = stats->nthreads > 0 ? stats->nthreads : 1;
+
+  fprintf(out, "Aligned %zu pairs in %.3fs, time busy:\n",
+          stats->pairs, stats->wall);
+  fprintf(out, "  read:  %5.1f%%\n", 100 * stats->read / wall);
+  fprintf(out, "  align: %5.1f%% (%zu thread%s)\n",
+          100 * stats->align / (wall * nthreads),
+          nthreads, nthreads == 1 ? "" : "s");
+  fprintf(out, "  write: %5.1f%%\n", 100 * stats->write / wall);
+}
+
+void cmdline_print_alignment(FILE *out, enum SeqAlignFormat format,
+                             const alignment_t *result,
+                             const char *name_a, const char *name_b,
+                             const char *seq_a, size_t len_a, size_t len_b,
+                             bool secondary)
+{
+  const alignment_cigar_t *cigar = &result->cigar;
+  size_t i, end_a = result->pos_a + result->len_a, nmatch = 0, block = 0;
+
+  if(name_a == NULL || name_a[0] == '\0') name_a = "*";
+  if(name_b == NULL || name_b[0] == '\0') name_b = "*";
+
+  switch(format)
+  {
+    case SEQ_ALIGN_FORMAT_CIGAR:
+      fprintf(out, "%zu\t%zu\t", result->pos_a, result->pos_b);
+      alignment_cigar_fprint(out, cigar);
+      break;
+
+    case SEQ_ALIGN_FORMAT_PAF:
+      for(i = 0; i < cigar->n; i++) {
+        block += alignment_cigar_len(cigar, i);
+        if(alignment_cigar_op(cigar, i) == '=')
+          nmatch += alignment_cigar_len(cigar, i);
+      }
+      fprintf(out, "%s\t%zu\t%zu\t%zu\t+\t%s\t%zu\t%zu\t%zu\t%zu\t%zu\t255"
+                   "\tcg:Z:",
+              name_a, len_a, result->pos_a, end_a,
+              name_b, len_b, result->pos_b, result->pos_b + result->len_b,
+              nmatch, block);
+      alignment_cigar_fprint(out, cigar);
+      break;
+
+    case SEQ_ALIGN_FORMAT_SAM:
+      // Bases of the query outside the alignment are soft clipped
+      fprintf(out, "%s\t%i\t%s\t%zu\t255\t",
+              name_a, secondary ? 256 : 0, name_b, result->pos_b + 1);
+      if(result->pos_a > 0) fprintf(out, "%zuS", result->pos_a);
+      alignment_cigar_fprint(out, cigar);
+      if(end_a < len_a) fprintf(out, "%zuS", len_a - end_a);
+      fputs("\t*\t0\t0\t", out);
+      if(len_a > 0) fwrite(seq_a, 1, len_a, out);
+      else putc('*', out);
+      fputs("\t*", out);
       break;
-    }
 
-    (align)(&read1, &read2);
+    default:
+      fprintf(stderr, "%s:%i: Program error: invalid format\n",
+              __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+  }
+
+  fprintf(out, "\tNM:i:%zu\tAS:i:%i\n", cigar->nm, result->score);
+}
+
+// If seq2 is NULL, read pair of entries from first file
+// Otherwise read an entry from each
+size_t align_from_file(const char *path1, const char *path2,
+                       align_pair_fn align, void **states, size_t nthreads,
+                       bool use_zlib, align_stats_t *stats)
+{
+  align_input_t in1, in2;
+
+  if(!align_input_open(&in1, path1, use_zlib, nthreads))
+  {
+    fprintf(stderr, "Alignment Error: couldn't open file %s\n", path1);
+    fflush(stderr);
+    return 0;
   }
 
+  if(path2 != NULL && !align_input_open(&in2, path2, use_zlib, nthreads))
+  {
+    fprintf(stderr, "Alignment Error: couldn't open file %s\n", path1);
+    fflush(stderr);
+    align_input_close(&in1);
+    return 0;
+  }
+
+  align_input_t *in2p = (path2 == NULL ? &in1 : &in2);
+
+  double start = align_clock();
+
+  size_t alignments = nthreads > 0
+    ? align_pairs_threaded(&in1, in2p, align, states, nthreads, stats)
+    : align_pairs(&in1, in2p, align, states[0], stats);
+
+  stats->wall += align_clock() - start;
+  stats->pairs += alignments;
+  if(nthreads > stats->nthreads) stats->nthreads = nthreads;
+
   // warn if no bases read
   if(alignments == 0)
   {
@@ -629,12 +1188,10 @@ void align_from_file(const char *path1, const char *path2,
   }
 
   // Close files
-  seq_close(sf1);
+  align_input_close(&in1);
 
   if(path2 != NULL)
-    seq_close(sf2);
+    align_input_close(&in2);
 
-  // Free memory
-  seq_read_dealloc(&read1);
-  seq_read_dealloc(&read2);
+  return alignments;
 }
@@ -18,8 +18,18 @@
 #include "seq_file/seq_file.h"
 #include "alignment.h"
 
+// Starting band width for --band auto
+#define CMDLINE_AUTO_BAND 16
+
+// Bytes of stdout buffered when not interactive
+#define CMDLINE_OUTPUT_BUFFER (1<<20)
+
 enum SeqAlignCmdType {SEQ_ALIGN_SW_CMD, SEQ_ALIGN_NW_CMD, SEQ_ALIGN_LCS_CMD};
 
+// --format: gapped strings, or one CIGAR/PAF/SAM line per alignment
+enum SeqAlignFormat {SEQ_ALIGN_FORMAT_TEXT, SEQ_ALIGN_FORMAT_CIGAR,
+                     SEQ_ALIGN_FORMAT_PAF, SEQ_ALIGN_FORMAT_SAM};
+
 typedef struct
 {
   // file inputs
@@ -40,12 +50,26 @@ typedef struct
   bool freestartgap_set, freeendgap_set;
   bool print_matrices, print_scores;
   bool zam_stle_output;
+  bool linear_space, compact;
+
+  // Only print the best score
+  bool score_only;
+
+  // Banded alignment
+  unsigned int band;
+  bool band_set, band_widen;
 
   // Turns off zlib for stdin
   bool interactive;
 
+  // Threads aligning pairs read from files, and filling each pair's matrices
+  unsigned int nthreads, fill_threads;
+  bool print_stats;
+
   // General output
   bool print_fasta, print_pretty, print_colour;
+  enum SeqAlignFormat format;
+  bool binary_out;
 
   // Experimental
   bool no_gaps_in1, no_gaps_in2;
@@ -67,8 +91,43 @@ size_t cmdline_get_num_of_file_pairs(cmdline_t* cmd);
 char* cmdline_get_file1(cmdline_t* cmd, size_t i);
 char* cmdline_get_file2(cmdline_t* cmd, size_t i);
 
-void align_from_file(const char *path1, const char *path2,
-                     void (align)(read_t *r1, read_t *r2),
-                     bool use_zlib);
+// Align one pair read from a file, printing to out.  Sequences may point into
+// the input file so are not null terminated: use seq.end for their lengths.
+// index counts the pairs read by this call to align_from_file(), state is that
+// of the thread running it (one of the states passed to align_from_file())
+typedef void (*align_pair_fn)(read_t *r1, read_t *r2, size_t index,
+                              FILE *out, void *state);
+
+// Seconds spent reading, aligning and writing pairs, summed over calls to
+// align_from_file().  align is summed over threads.
+typedef struct
+{
+  size_t pairs, nthreads;
+  double wall, read, align, write;
+} align_stats_t;
+
+// Read pairs from path1 (and path2 if not NULL) and call align on each.
+// Pairs are read, aligned and written on separate threads: one reader,
+// nthreads aligners each passing its own states[i], and the calling thread
+// writing output to stdout in input order.  With nthreads == 0 each pair is
+// read, aligned and printed in turn on the calling thread with states[0]
+// (for interactive input).  Adds timings to stats, returns the number of
+// pairs read.
+size_t align_from_file(const char *path1, const char *path2,
+                       align_pair_fn align, void **states, size_t nthreads,
+                       bool use_zlib, align_stats_t *stats);
+
+// Print the fraction of time each stage was busy
+void align_stats_print(const align_stats_t *stats, FILE *out);
+
+// Print a CIGAR, PAF or SAM line for result, which must have been made with
+// result->cigar_only set.  seq_a (the query, of length len_a) is aligned
+// against seq_b (the target, of length len_b).  Names may be NULL.  secondary
+// flags all but the first hit of a pair in SAM.
+void cmdline_print_alignment(FILE *out, enum SeqAlignFormat format,
+                             const alignment_t *result,
+                             const char *name_a, const char *name_b,
+                             const char *seq_a, size_t len_a, size_t len_b,
+                             bool secondary);
 
 #endif
@@ -0,0 +1,393 @@
+/*
+ alignment_gzip.c
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+// A feeder thread reads BGZF blocks into a ring of jobs, inflating threads
+// decompress them, and the feeder writes the results to the pipe in order.
+// Each block is a complete deflate stream with its own CRC, so blocks can be
+// inflated independently.  Plain gzip has no such boundaries so is inflated
+// by the feeder alone, which still takes it off the thread parsing reads.
+
+// request decent POSIX version
+#define _XOPEN_SOURCE 700
+#define _BSD_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h> // pipe, write, close
+#include <signal.h> // pthread_sigmask
+#include <pthread.h>
+#include <zlib.h>
+
+#include "alignment_gzip.h"
+
+// BGZF blocks are at most 64KB compressed or uncompressed
+#define BGZF_BLOCK_SIZE 65536
+// Blocks in flight per inflating thread
+#define BGZF_JOBS_PER_THREAD 8
+// Bytes per write to the pipe from plain gzip
+#define GZIP_CHUNK_SIZE 65536
+
+typedef struct
+{
+  unsigned char in[BGZF_BLOCK_SIZE], out[BGZF_BLOCK_SIZE];
+  size_t in_len, out_len;
+  uint32_t crc, isize; // from the block footer
+  bool done, corrupt;
+} bgzf_job_t;
+
+// Block i is in jobs[i % njobs].  Blocks next_job..num_read-1 are waiting to
+// be inflated; the feeder writes block num_written once it's done.
+struct gzip_reader_t
+{
+  FILE *in; // BGZF input
+  gzFile gz; // plain gzip input
+  int in_fd, out_fd; // read and write ends of the pipe
+  bool bgzf, corrupt;
+
+  bgzf_job_t *jobs;
+  size_t njobs, num_read, next_job, num_written;
+  bool finished;
+
+  size_t nthreads;
+  pthread_t feeder, *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t job_ready, job_done;
+};
+
+static uint32_t gzip_le32(const unsigned char *p)
+{
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Read the header of a BGZF block.  Returns the number of bytes left in the
+// block (deflate data and footer), 0 at the end of the file or -1 if this is
+// not a BGZF block.
+static long bgzf_read_header(FILE *fh)
+{
+  unsigned char head[12], sub[4];
+  size_t n = fread(head, 1, sizeof(head), fh);
+
+  if(n == 0) return 0;
+  if(n < sizeof(head) || head[0] != 31 || head[1] != 139 || head[2] != 8 ||
+     head[3] != 4) return -1;
+
+  // Find the 'BC' subfield holding the block size
+  size_t xlen = head[10] | (size_t)head[11] << 8, slen, pos = 0;
+  long bsize = -1;
+
+  while(pos + sizeof(sub) <= xlen)
+  {
+    if(fread(sub, 1, sizeof(sub), fh) != sizeof(sub)) return -1;
+    slen = sub[2] | (size_t)sub[3] << 8;
+    pos += sizeof(sub) + slen;
+
+    if(sub[0] == 'B' && sub[1] == 'C' && slen == 2) {
+      if(fread(sub, 1, 2, fh) != 2) return -1;
+      bsize = sub[0] | (long)sub[1] << 8;
+    }
+    else if(fseek(fh, (long)slen, SEEK_CUR) != 0) return -1;
+  }
+
+  if(pos != xlen || bsize < 0) return -1;
+
+  // BSIZE is the size of the whole block minus one
+  long remaining = bsize + 1 - (long)(sizeof(head) + xlen);
+  return remaining >= 8 ? remaining : -1;
+}
+
+static bool bgzf_inflate(z_stream *strm, bgzf_job_t *job)
+{
+  inflateReset(strm);
+  strm->next_in = job->in;
+  strm->avail_in = job->in_len;
+  strm->next_out = job->out;
+  strm->avail_out = BGZF_BLOCK_SIZE;
+
+  if(inflate(strm, Z_FINISH) != Z_STREAM_END) return false;
+
+  job->out_len = BGZF_BLOCK_SIZE - strm->avail_out;
+  return job->out_len == job->isize &&
+         crc32(crc32(0L, Z_NULL, 0), job->out, job->out_len) == job->crc;
+}
+
+static bool gzip_write_all(int fd, const void *ptr, size_t len)
+{
+  const char *buf = (const char*)ptr;
+  ssize_t n;
+
+  while(len > 0)
+  {
+    if((n = write(fd, buf, len)) < 0) {
+      if(errno == EINTR) continue;
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+// Writes fail with EPIPE once the reader has closed its end of the pipe
+static void gzip_block_sigpipe()
+{
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+static void* bgzf_inflate_run(void *arg)
+{
+  gzip_reader_t *gz = (gzip_reader_t*)arg;
+  bgzf_job_t *job;
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+
+  if(inflateInit2(&strm, -15) != Z_OK) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  while(1)
+  {
+    pthread_mutex_lock(&gz->lock);
+    while(gz->next_job == gz->num_read && !gz->finished)
+      pthread_cond_wait(&gz->job_ready, &gz->lock);
+
+    if(gz->next_job == gz->num_read) {
+      pthread_mutex_unlock(&gz->lock);
+      break;
+    }
+
+    job = &gz->jobs[gz->next_job++ % gz->njobs];
+    pthread_mutex_unlock(&gz->lock);
+
+    job->corrupt = !bgzf_inflate(&strm, job);
+
+    pthread_mutex_lock(&gz->lock);
+    job->done = true;
+    pthread_cond_broadcast(&gz->job_done);
+    pthread_mutex_unlock(&gz->lock);
+  }
+
+  inflateEnd(&strm);
+  return NULL;
+}
+
+static void* bgzf_feed_run(void *arg)
+{
+  gzip_reader_t *gz = (gzip_reader_t*)arg;
+  bgzf_job_t *job;
+  bool eof = false;
+  long remaining;
+
+  gzip_block_sigpipe();
+
+  while(1)
+  {
+    // Keep the ring full of blocks
+    if(!eof && gz->num_read - gz->num_written < gz->njobs)
+    {
+      job = &gz->jobs[gz->num_read % gz->njobs];
+      remaining = bgzf_read_header(gz->in);
+
+      if(remaining == 0) eof = true;
+      else if(remaining < 0 ||
+              fread(job->in, 1, remaining, gz->in) != (size_t)remaining) {
+        gz->corrupt = eof = true;
+      }
+      else {
+        job->in_len = remaining - 8;
+        job->crc = gzip_le32(job->in + job->in_len);
+        job->isize = gzip_le32(job->in + job->in_len + 4);
+
+        pthread_mutex_lock(&gz->lock);
+        gz->num_read++;
+        pthread_cond_signal(&gz->job_ready);
+        pthread_mutex_unlock(&gz->lock);
+      }
+      continue;
+    }
+
+    if(gz->num_written == gz->num_read) break;
+
+    // Write out the oldest block once inflated
+    job = &gz->jobs[gz->num_written % gz->njobs];
+
+    pthread_mutex_lock(&gz->lock);
+    while(!job->done) pthread_cond_wait(&gz->job_done, &gz->lock);
+    pthread_mutex_unlock(&gz->lock);
+
+    if(job->corrupt) { gz->corrupt = true; break; }
+    if(!gzip_write_all(gz->out_fd, job->out, job->out_len)) break;
+
+    pthread_mutex_lock(&gz->lock);
+    job->done = false;
+    gz->num_written++;
+    pthread_mutex_unlock(&gz->lock);
+  }
+
+  pthread_mutex_lock(&gz->lock);
+  gz->finished = true;
+  pthread_cond_broadcast(&gz->job_ready);
+  pthread_mutex_unlock(&gz->lock);
+
+  close(gz->out_fd);
+  return NULL;
+}
+
+static void* gzip_feed_run(void *arg)
+{
+  gzip_reader_t *gz = (gzip_reader_t*)arg;
+  char buf[GZIP_CHUNK_SIZE];
+  int n, err = Z_OK;
+
+  gzip_block_sigpipe();
+
+  while((n = gzread(gz->gz, buf, sizeof(buf))) > 0 &&
+        gzip_write_all(gz->out_fd, buf, n)) {}
+
+  // Truncated input reads as the end of file with an error set
+  if(n == 0) gzerror(gz->gz, &err);
+  gz->corrupt = (n < 0 || err != Z_OK);
+
+  close(gz->out_fd);
+  return NULL;
+}
+
+// SAM/BAM is left to seq_open(), which reads it through htslib
+static bool gzip_holds_sam_bam(const char *path)
+{
+  char head[4];
+  gzFile fh = gzopen(path, "r");
+  if(fh == NULL) return true;
+  int n = gzread(fh, head, sizeof(head));
+  gzclose(fh);
+  return n == sizeof(head) &&
+         (memcmp(head, "BAM\1", 4) == 0 || memcmp(head, "@HD\t", 4) == 0 ||
+          memcmp(head, "@SQ\t", 4) == 0);
+}
+
+gzip_reader_t* gzip_reader_open(const char *path, size_t nthreads)
+{
+  FILE *fh = fopen(path, "r");
+  unsigned char magic[2];
+  int fds[2];
+
+  if(fh == NULL) return NULL;
+
+  if(fread(magic, 1, 2, fh) != 2 || magic[0] != 31 || magic[1] != 139 ||
+     gzip_holds_sam_bam(path) || pipe(fds) != 0)
+  {
+    fclose(fh);
+    return NULL;
+  }
+
+  gzip_reader_t *gz = calloc(1, sizeof(gzip_reader_t));
+  if(gz == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  gz->in_fd = fds[0];
+  gz->out_fd = fds[1];
+
+  rewind(fh);
+  gz->bgzf = (bgzf_read_header(fh) > 0);
+  rewind(fh);
+
+  size_t i;
+  void* (*feed)(void*) = gzip_feed_run;
+
+  if(gz->bgzf)
+  {
+    gz->in = fh;
+    gz->nthreads = nthreads > 0 ? nthreads : 1;
+    gz->njobs = gz->nthreads * BGZF_JOBS_PER_THREAD;
+    gz->jobs = malloc(gz->njobs * sizeof(bgzf_job_t));
+    gz->threads = malloc(gz->nthreads * sizeof(pthread_t));
+
+    if(gz->jobs == NULL || gz->threads == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+
+    for(i = 0; i < gz->njobs; i++) gz->jobs[i].done = false;
+
+    pthread_mutex_init(&gz->lock, NULL);
+    pthread_cond_init(&gz->job_ready, NULL);
+    pthread_cond_init(&gz->job_done, NULL);
+
+    for(i = 0; i < gz->nthreads; i++) {
+      if(pthread_create(&gz->threads[i], NULL, bgzf_inflate_run, gz) != 0) {
+        fprintf(stderr, "Error: couldn't start thread %zu\n", i);
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    feed = bgzf_feed_run;
+  }
+  else
+  {
+    fclose(fh);
+
+    if((gz->gz = gzopen(path, "r")) == NULL) {
+      close(fds[0]);
+      close(fds[1]);
+      free(gz);
+      return NULL;
+    }
+
+    gzbuffer(gz->gz, GZIP_CHUNK_SIZE);
+  }
+
+  if(pthread_create(&gz->feeder, NULL, feed, gz) != 0) {
+    fprintf(stderr, "Error: couldn't start decompression thread\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return gz;
+}
+
+int gzip_reader_fd(const gzip_reader_t *gz)
+{
+  return gz->in_fd;
+}
+
+bool gzip_reader_close(gzip_reader_t *gz)
+{
+  size_t i;
+
+  // The read end is closed, so the feeder stops at its next write
+  pthread_join(gz->feeder, NULL);
+
+  if(gz->bgzf)
+  {
+    for(i = 0; i < gz->nthreads; i++) pthread_join(gz->threads[i], NULL);
+
+    pthread_cond_destroy(&gz->job_done);
+    pthread_cond_destroy(&gz->job_ready);
+    pthread_mutex_destroy(&gz->lock);
+
+    fclose(gz->in);
+    free(gz->jobs);
+    free(gz->threads);
+  }
+  else
+  {
+    gzclose(gz->gz);
+  }
+
+  bool ok = !gz->corrupt;
+  free(gz);
+  return ok;
+}
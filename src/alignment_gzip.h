@@ -0,0 +1,31 @@
+/*
+ alignment_gzip.h
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+#ifndef ALIGNMENT_GZIP_HEADER_SEEN
+#define ALIGNMENT_GZIP_HEADER_SEEN
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Decompresses a gzip file on background threads into a pipe.  BGZF files
+// (gzip made of independent blocks, as written by bgzip) are inflated a block
+// per job on nthreads threads; other gzip files are inflated on one thread.
+typedef struct gzip_reader_t gzip_reader_t;
+
+// Returns NULL if path can't be opened, isn't gzip compressed or holds
+// SAM/BAM (which seq_open() reads itself)
+gzip_reader_t* gzip_reader_open(const char *path, size_t nthreads);
+
+// Read end of the pipe the decompressed data is written to.  The caller
+// closes it when done (e.g. through seq_close()), before gzip_reader_close().
+int gzip_reader_fd(const gzip_reader_t *gz);
+
+// Stop and join the threads.  Returns false if the input was corrupt.
+bool gzip_reader_close(gzip_reader_t *gz);
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ alignment_linear.h
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+#ifndef ALIGNMENT_LINEAR_HEADER_SEEN
+#define ALIGNMENT_LINEAR_HEADER_SEEN
+
+#include "alignment.h"
+
+// Mark the cells x0..x1 of row y a path may not pass through in any matrix:
+// sets out[x-x0] to 1 if cell (x,y) is blocked, 0 if not
+typedef void (*align_blocked_f)(void *arg, size_t y, size_t x0, size_t x1,
+                                uint8_t *out);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Best path from cell (x0,y0) to (x1,y1), both in MATCH, scored with the
+// moves of a local alignment: none may end on row or column 0, nor on a cell
+// blocked() (if not NULL) marks.  Writes the gapped strings
+// into result and sets its length; the caller fills in the score and
+// positions.  Memory is linear in x1-x0 (Myers & Miller, as
+// needleman_wunsch_align_linear()).
+void alignment_linear_path(const char *seq_a, const char *seq_b,
+                           size_t len_a, size_t len_b,
+                           const scoring_t *scoring,
+                           align_blocked_f blocked, void *blocked_arg,
+                           size_t x0, size_t y0, size_t x1, size_t y1,
+                           alignment_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ alignment_mmap.c
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+// request decent POSIX version
+#define _XOPEN_SOURCE 700
+#define _BSD_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alignment_mmap.h"
+
+enum MmapFormat {MMAP_FASTA, MMAP_FASTQ, MMAP_PLAIN};
+
+struct mmap_reader_t
+{
+  char *data, *pos, *end;
+  size_t size;
+  enum MmapFormat format;
+};
+
+// Get the next line, without its line ending.  Returns false at end of file.
+static bool mmap_next_line(mmap_reader_t *map, char **line, size_t *len)
+{
+  if(map->pos == map->end) return false;
+
+  char *nl = memchr(map->pos, '\n', map->end - map->pos);
+  char *stop = (nl != NULL ? nl : map->end);
+
+  *line = map->pos;
+  *len = stop - map->pos;
+  if(*len > 0 && stop[-1] == '\r') (*len)--;
+
+  map->pos = (nl != NULL ? nl + 1 : map->end);
+  return true;
+}
+
+static void mmap_set_view(StrBuf *view, char *str, size_t len)
+{
+  view->b = str;
+  view->end = len;
+}
+
+bool mmap_reader_read(mmap_reader_t *map, read_t *view, read_t *buf)
+{
+  char *line, *first = NULL;
+  size_t len, first_len = 0, nlines = 0;
+
+  strbuf_reset(&buf->name);
+  strbuf_reset(&buf->seq);
+  strbuf_reset(&buf->qual);
+  *view = *buf;
+
+  // Skip blank lines between entries
+  do {
+    if(!mmap_next_line(map, &line, &len)) return false;
+  } while(len == 0);
+
+  if(map->format == MMAP_PLAIN)
+  {
+    mmap_set_view(&view->seq, line, len);
+    return true;
+  }
+
+  // Header line
+  strbuf_append_strn(&buf->name, line + 1, len - 1);
+  view->name = buf->name;
+
+  if(map->format == MMAP_FASTQ)
+  {
+    if(mmap_next_line(map, &line, &len)) mmap_set_view(&view->seq, line, len);
+    if(mmap_next_line(map, &line, &len) && // '+' line
+       mmap_next_line(map, &line, &len)) mmap_set_view(&view->qual, line, len);
+    return true;
+  }
+
+  // FASTA sequence runs until the next header line
+  while(map->pos < map->end && *map->pos != '>')
+  {
+    mmap_next_line(map, &line, &len);
+    if(len == 0) continue;
+
+    if(nlines == 0) {
+      first = line;
+      first_len = len;
+    }
+    else {
+      if(nlines == 1) strbuf_append_strn(&buf->seq, first, first_len);
+      strbuf_append_strn(&buf->seq, line, len);
+    }
+
+    nlines++;
+  }
+
+  if(nlines == 1) mmap_set_view(&view->seq, first, first_len);
+  else view->seq = buf->seq;
+
+  return true;
+}
+
+mmap_reader_t* mmap_reader_open(const char *path)
+{
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if(fd < 0) return NULL;
+
+  if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  size_t size = (size_t)st.st_size;
+  char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if(data == MAP_FAILED) return NULL;
+
+  // Detect the format from the first non-blank character.  gzip, BAM and SAM
+  // are left to seq_open().
+  char *c = data, *end = data + size;
+  while(c < end && (*c == '\n' || *c == '\r')) c++;
+
+  enum MmapFormat format = MMAP_PLAIN;
+
+  if(c == end || (size >= 2 && data[0] == 31 && (unsigned char)data[1] == 139) ||
+     (end - c >= 4 && (memcmp(c, "@HD\t", 4) == 0 ||
+                       memcmp(c, "@SQ\t", 4) == 0)))
+  {
+    munmap(data, size);
+    return NULL;
+  }
+  else if(*c == '>') format = MMAP_FASTA;
+  else if(*c == '@') format = MMAP_FASTQ;
+
+  mmap_reader_t *map = malloc(sizeof(mmap_reader_t));
+  if(map == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+
+  map->data = map->pos = data;
+  map->end = end;
+  map->size = size;
+  map->format = format;
+  return map;
+}
+
+void mmap_reader_close(mmap_reader_t *map)
+{
+  munmap(map->data, map->size);
+  free(map);
+}
@@ -0,0 +1,32 @@
+/*
+ alignment_mmap.h
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+#ifndef ALIGNMENT_MMAP_HEADER_SEEN
+#define ALIGNMENT_MMAP_HEADER_SEEN
+
+#include <stdbool.h>
+#include "seq_file/seq_file.h"
+
+// Reads uncompressed FASTA, FASTQ (four lines per entry) or plain (one
+// sequence per line) files in place through mmap()
+typedef struct mmap_reader_t mmap_reader_t;
+
+// Returns NULL if path can't be mapped (e.g. isn't a regular file) or isn't
+// one of the formats above, in which case use seq_open()
+mmap_reader_t* mmap_reader_open(const char *path);
+
+// Read the next entry into view.  Sequence and quality point into the mapped
+// file and are NOT null terminated: use seq.end/qual.end for their lengths.
+// A FASTA sequence split over several lines is joined into buf->seq instead.
+// The name is copied into buf->name.  view is valid until the next read from
+// the same buf.  Returns false at the end of the file.
+bool mmap_reader_read(mmap_reader_t *map, read_t *view, read_t *buf);
+
+void mmap_reader_close(mmap_reader_t *map);
+
+#endif
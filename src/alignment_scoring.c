@@ -48,25 +48,28 @@ void scoring_init(scoring_t* scoring,
 
   scoring->min_penalty = MIN2(match, mismatch);
   scoring->max_penalty = MAX2(match, mismatch);
-  if(!no_gaps_in_a || !no_gaps_in_b) {
-    scoring->min_penalty = MIN3(scoring->min_penalty,gap_open+gap_extend,gap_extend);
-    scoring->max_penalty = MAX3(scoring->max_penalty,gap_open+gap_extend,gap_extend);
-  }
+  // Even with no_gaps_in_a/b, gaps are still allowed at the end of a sequence
+  scoring->min_penalty = MIN3(scoring->min_penalty,gap_open+gap_extend,gap_extend);
+  scoring->max_penalty = MAX3(scoring->max_penalty,gap_open+gap_extend,gap_extend);
+
+  scoring->compiled = false;
 }
 
 void scoring_add_wildcard(scoring_t* scoring, char c, int score)
 {
   if(!scoring->case_sensitive) c = tolower(c);
-  set_wildcard_bit(scoring,c);
-  scoring->wildscores[(size_t)c] = score;
+  set_wildcard_bit(scoring,(uint8_t)c);
+  scoring->wildscores[(uint8_t)c] = score;
+  scoring->compiled = false;
   scoring->min_penalty = MIN2(scoring->min_penalty, score);
   scoring->max_penalty = MAX2(scoring->max_penalty, score);
 }
 
 void scoring_add_mutation(scoring_t* scoring, char a, char b, int score)
 {
-  scoring->swap_scores[(size_t)a][(size_t)b] = score;
-  set_swap_bit(scoring,a,b);
+  scoring->swap_scores[(uint8_t)a][(uint8_t)b] = score;
+  set_swap_bit(scoring,(uint8_t)a,(uint8_t)b);
+  scoring->compiled = false;
   scoring->min_penalty = MIN2(scoring->min_penalty, score);
   scoring->max_penalty = MAX2(scoring->max_penalty, score);
 }
@@ -112,13 +115,13 @@ void scoring_print(const scoring_t* scoring)
 
 
 // a, b must be lowercase if !scoring->case_sensitive
-static char _scoring_check_wildcards(const scoring_t* scoring, char a, char b,
-                                     int* score)
+static char _scoring_check_wildcards(const scoring_t* scoring,
+                                     uint8_t a, uint8_t b, int* score)
 {
   // Check if either characters are wildcards
   int tmp_score = INT_MAX;
-  if(get_wildcard_bit(scoring,a)) tmp_score = scoring->wildscores[(size_t)a];
-  if(get_wildcard_bit(scoring,b)) tmp_score = MIN2(scoring->wildscores[(size_t)b],tmp_score);
+  if(get_wildcard_bit(scoring,a)) tmp_score = scoring->wildscores[a];
+  if(get_wildcard_bit(scoring,b)) tmp_score = MIN2(scoring->wildscores[b],tmp_score);
   if(tmp_score != INT_MAX) {
     *score = tmp_score;
     return 1;
@@ -128,35 +131,25 @@ static char _scoring_check_wildcards(const scoring_t* scoring, char a, char b,
   return 0;
 }
 
-// Considered match if lc(a)==lc(b) or if a or b are wildcards
-// Always sets score and is_match
-void scoring_lookup(const scoring_t* scoring, char a, char b,
-                    int *score, bool *is_match)
+// Score of a against b (both already case folded), returns false if the pair
+// has no score
+static bool _scoring_resolve(const scoring_t* scoring, uint8_t a, uint8_t b,
+                             int *score, bool *is_match)
 {
-  if(!scoring->case_sensitive)
-  {
-    a = tolower(a);
-    b = tolower(b);
-  }
-
-  //#ifdef SEQ_ALIGN_VERBOSE
-  //printf(" scoring_lookup(%c,%c)\n", a, b);
-  //#endif
-
   *is_match = (a == b);
 
   if(scoring->no_mismatches && !*is_match)
   {
     // Check wildcards
     *is_match = _scoring_check_wildcards(scoring, a, b, score);
-    return;
+    return true;
   }
 
   // Look up in table
   if(get_swap_bit(scoring,a,b))
   {
-    *score = scoring->swap_scores[(size_t)a][(size_t)b];
-    return;
+    *score = scoring->swap_scores[a][b];
+    return true;
   }
 
   // Check wildcards
@@ -165,14 +158,162 @@ void scoring_lookup(const scoring_t* scoring, char a, char b,
   if(_scoring_check_wildcards(scoring, a, b, score))
   {
     *is_match = 1;
-    return;
+    return true;
   }
 
   // Use match/mismatch
   if(scoring->use_match_mismatch)
   {
     *score = (*is_match ? scoring->match : scoring->mismatch);
-    return;
+    return true;
+  }
+
+  return false;
+}
+
+static void _scoring_compile_pair(scoring_t *scoring, size_t index,
+                                  uint8_t a, uint8_t b)
+{
+  int score;
+  bool is_match, known = _scoring_resolve(scoring, a, b, &score, &is_match);
+  scoring->table[index] = known ? score : 0;
+  scoring->table_flags[index] = (is_match ? SCORING_MATCH : 0) |
+                                (known ? SCORING_KNOWN : 0);
+}
+
+// min_penalty and max_penalty from the fields as they are now, which callers
+// (e.g. the command line tools) may have set after scoring_init()
+static void _scoring_bounds(scoring_t *scoring)
+{
+  size_t a, b;
+  int lo = MIN2(scoring->gap_open + scoring->gap_extend, scoring->gap_extend);
+  int hi = MAX2(scoring->gap_open + scoring->gap_extend, scoring->gap_extend);
+
+  if(scoring->use_match_mismatch) {
+    lo = MIN3(lo, scoring->match, scoring->mismatch);
+    hi = MAX3(hi, scoring->match, scoring->mismatch);
+  }
+
+  for(a = 0; a < 256; a++)
+  {
+    if(get_wildcard_bit(scoring,a)) {
+      lo = MIN2(lo, scoring->wildscores[a]);
+      hi = MAX2(hi, scoring->wildscores[a]);
+    }
+    for(b = 0; b < 256; b++) {
+      if(get_swap_bit(scoring,a,b)) {
+        lo = MIN2(lo, scoring->swap_scores[a][b]);
+        hi = MAX2(hi, scoring->swap_scores[a][b]);
+      }
+    }
+  }
+
+  scoring->min_penalty = lo;
+  scoring->max_penalty = hi;
+}
+
+bool scoring_compile(scoring_t *scoring)
+{
+  bool named[256] = {false};
+  uint8_t symbols[SCORING_MAX_CODES];
+  size_t a, b, i, j, n = 1, other[2] = {256, 256};
+
+  scoring->compiled = false;
+  _scoring_bounds(scoring);
+
+  for(a = 0; a < 256; a++)
+    scoring->fold[a] = scoring->case_sensitive ? a : (uint8_t)tolower((int)a);
+
+  // Characters scoring_lookup() can find in a substitution or wildcard
+  for(a = 0; a < 256; a++)
+  {
+    if(scoring->fold[a] != a) continue;
+    if(get_wildcard_bit(scoring,a)) named[a] = true;
+    for(b = 0; b < 256; b++) {
+      if(scoring->fold[b] == b && get_swap_bit(scoring,a,b))
+        named[a] = named[b] = true;
+    }
+  }
+
+  memset(scoring->codes, 0, sizeof(scoring->codes));
+
+  for(a = 0; a < 256; a++)
+  {
+    if(scoring->fold[a] != a) continue;
+    if(named[a]) {
+      if(n == SCORING_MAX_CODES) return false;
+      symbols[n] = (uint8_t)a;
+      scoring->codes[a] = (uint8_t)n++;
+    }
+    else if(other[0] == 256) other[0] = a;
+    else if(other[1] == 256) other[1] = a;
+  }
+
+  for(a = 0; a < 256; a++) scoring->codes[a] = scoring->codes[scoring->fold[a]];
+
+  // Unnamed characters all score the same against named ones, and against
+  // each other depending only on whether they are equal
+  symbols[0] = (uint8_t)other[0];
+
+  for(i = 0; i < n; i++)
+    for(j = 0; j < n; j++)
+      _scoring_compile_pair(scoring, i*n+j, symbols[i], symbols[j]);
+
+  _scoring_compile_pair(scoring, 0, (uint8_t)other[0], (uint8_t)other[1]);
+  _scoring_compile_pair(scoring, n*n, (uint8_t)other[0], (uint8_t)other[0]);
+
+  scoring->ncodes = n;
+  scoring->compiled = true;
+  return true;
+}
+
+bool scoring_fits(const scoring_t *scoring, size_t len_a, size_t len_b)
+{
+  long step = MAX3(labs((long)scoring->min_penalty),
+                   labs((long)scoring->max_penalty), 1);
+  return len_a + len_b + 2 <= (size_t)(INT_MAX/2 / step);
+}
+
+void scoring_check_fits(const scoring_t *scoring, size_t len_a, size_t len_b)
+{
+  if(!scoring_fits(scoring, len_a, len_b)) {
+    fprintf(stderr, "Error: scores aligning %zu against %zu bases (steps of up "
+                    "to %i) may not fit in %zu bit scores, use smaller scores\n",
+            len_a, len_b,
+            MAX2(abs(scoring->min_penalty), abs(scoring->max_penalty)),
+            8*sizeof(score_t));
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Considered match if lc(a)==lc(b) or if a or b are wildcards
+// Always sets score and is_match
+void scoring_lookup(const scoring_t* scoring, char a, char b,
+                    int *score, bool *is_match)
+{
+  if(scoring->compiled)
+  {
+    uint8_t fa = scoring->fold[(uint8_t)a], fb = scoring->fold[(uint8_t)b];
+    size_t ca = scoring->codes[fa], cb = scoring->codes[fb];
+    size_t n = scoring->ncodes;
+    size_t index = ca*n + cb + (((ca|cb) == 0) & (fa == fb)) * n*n;
+
+    *score = scoring->table[index];
+    *is_match = scoring->table_flags[index] & SCORING_MATCH;
+    if(scoring->table_flags[index] & SCORING_KNOWN) return;
+    a = (char)fa;
+    b = (char)fb;
+  }
+  else
+  {
+    if(!scoring->case_sensitive)
+    {
+      a = tolower(a);
+      b = tolower(b);
+    }
+
+    if(_scoring_resolve(scoring, (uint8_t)a, (uint8_t)b, score, is_match))
+      return;
   }
 
   // Error
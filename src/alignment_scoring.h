@@ -16,6 +16,14 @@
 typedef int score_t;
 #define SCORE_MIN INT_MIN
 
+// Most characters named by substitutions and wildcards scoring_compile() takes
+#define SCORING_MAX_CODES 64
+#define SCORING_TABLE_SIZE (SCORING_MAX_CODES*SCORING_MAX_CODES+1)
+
+// scoring_t.table_flags
+#define SCORING_MATCH 1 // counts as a match (for no_mismatches)
+#define SCORING_KNOWN 2 // pair has a score
+
 typedef struct
 {
   int gap_open, gap_extend;
@@ -37,6 +45,16 @@ typedef struct
   uint32_t wildcards[256/32], swap_set[256][256/32];
   score_t wildscores[256], swap_scores[256][256];
   int min_penalty, max_penalty; // min, max {match/mismatch,gapopen etc.}
+
+  // Set by scoring_compile(): characters are case folded (fold) then given a
+  // code, 0 for any character not named by a substitution or wildcard.
+  // table[codes[a]*ncodes + codes[b]] is the score of a against b, except two
+  // equal unnamed characters, which are at table[ncodes*ncodes].
+  bool compiled;
+  uint8_t fold[256], codes[256];
+  size_t ncodes;
+  score_t table[SCORING_TABLE_SIZE];
+  uint8_t table_flags[SCORING_TABLE_SIZE];
 } scoring_t;
 
 #ifndef bitset32_get
@@ -69,9 +87,32 @@ void scoring_add_mutation(scoring_t* scoring, char a, char b, int score);
 
 void scoring_print(const scoring_t* scoring);
 
+/*
+ Resolve the substitutions, wildcards, match/mismatch and no_mismatches into
+ a dense table, so that scoring_lookup() is a couple of loads rather than a
+ chain of tests.  Call once the scoring is set up: changing it afterwards
+ (including its fields) needs another scoring_compile().  The compiled
+ scoring is only read, so may be shared between threads.  Returns false (and
+ leaves scoring_lookup() on the slow path) if more than SCORING_MAX_CODES
+ characters are named.
+*/
+bool scoring_compile(scoring_t *scoring);
+
 void scoring_lookup(const scoring_t* scoring, char a, char b,
                     int *score, bool *is_match);
 
+/*
+ Whether every score the fills can reach aligning len_a against len_b bases
+ fits in score_t, with room for the -infinity sentinels at SCORE_MIN/2: that
+ is (len_a+len_b+2) times the largest step (match, mismatch, gap open plus
+ extend or wildcard/substitution score) within INT_MAX/2.  The alignment
+ functions check this and report an error rather than return wrapped scores.
+*/
+bool scoring_fits(const scoring_t *scoring, size_t len_a, size_t len_b);
+
+// Print an error and exit if !scoring_fits()
+void scoring_check_fits(const scoring_t *scoring, size_t len_a, size_t len_b);
+
 // Some scoring systems
 void scoring_system_PAM30(scoring_t *scoring);
 void scoring_system_PAM70(scoring_t *scoring);
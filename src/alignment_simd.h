@@ -0,0 +1,147 @@
+/*
+ alignment_simd.h
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+#ifndef ALIGNMENT_SIMD_HEADER_SEEN
+#define ALIGNMENT_SIMD_HEADER_SEEN
+
+#include <stdint.h>
+
+// Thin wrappers around the vector instructions used by the SIMD kernels.
+// Built with AVX2 when the compiler targets it (e.g. -march=native), otherwise
+// SSE2, which every x86-64 CPU has.  Define SEQ_ALIGN_NO_SIMD to compile the
+// kernels out; callers then fall back to the scalar code.
+
+#if !defined(SEQ_ALIGN_NO_SIMD) && defined(__AVX2__)
+
+  #include <immintrin.h>
+  #define SEQ_ALIGN_SIMD 1
+
+  typedef __m256i simd_t;
+  #define SIMD_BYTES 32
+
+  #define simd_load(p)        _mm256_load_si256((const simd_t*)(p))
+  #define simd_store(p,v)     _mm256_store_si256((simd_t*)(p),(v))
+  #define simd_zero()         _mm256_setzero_si256()
+  #define simd_or(a,b)        _mm256_or_si256(a,b)
+  #define simd_any(v)         (_mm256_movemask_epi8(v) != 0) // any mask lane set
+  #define simd_nonzero(v)     (!_mm256_testz_si256(v,v))
+
+  #define simd_set1_i16(x)    _mm256_set1_epi16((short)(x))
+  #define simd_adds_i16(a,b)  _mm256_adds_epi16(a,b)
+  #define simd_subs_i16(a,b)  _mm256_subs_epi16(a,b)
+  #define simd_max_i16(a,b)   _mm256_max_epi16(a,b)
+  #define simd_cmpgt_i16(a,b) _mm256_cmpgt_epi16(a,b)
+  #define simd_cmpeq_i16(a,b) _mm256_cmpeq_epi16(a,b)
+
+  // Move every 16 bit lane up one place, shifting in zero
+  static inline simd_t simd_shl_i16(simd_t v) {
+    return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 14);
+  }
+
+  #define simd_set1_u8(x)     _mm256_set1_epi8((char)(x))
+  #define simd_adds_u8(a,b)   _mm256_adds_epu8(a,b)
+  #define simd_subs_u8(a,b)   _mm256_subs_epu8(a,b)
+  #define simd_max_u8(a,b)    _mm256_max_epu8(a,b)
+
+  // Move every byte up one place, shifting in zero
+  static inline simd_t simd_shl_u8(simd_t v) {
+    return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 15);
+  }
+
+  #define simd_set1_i32(x)    _mm256_set1_epi32(x)
+  #define simd_add_i32(a,b)   _mm256_add_epi32(a,b)
+  #define simd_sub_i32(a,b)   _mm256_sub_epi32(a,b)
+  #define simd_max_i32(a,b)   _mm256_max_epi32(a,b)
+  #define simd_cmpeq_i32(a,b) _mm256_cmpeq_epi32(a,b)
+  #define simd_cmpgt_i32(a,b) _mm256_cmpgt_epi32(a,b)
+  #define simd_and(a,b)       _mm256_and_si256(a,b)
+  #define simd_blend(m,a,b)   _mm256_blendv_epi8(b,a,m) // m ? a : b
+
+  // Move every 32 bit lane up one place, shifting x into the first lane
+  static inline simd_t simd_shl_i32(simd_t v, int x) {
+    v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0,0,1,2,3,4,5,6));
+    return _mm256_blend_epi32(v, _mm256_set1_epi32(x), 0x01);
+  }
+
+#elif !defined(SEQ_ALIGN_NO_SIMD) && defined(__SSE2__)
+
+  #include <emmintrin.h>
+  #define SEQ_ALIGN_SIMD 1
+
+  typedef __m128i simd_t;
+  #define SIMD_BYTES 16
+
+  #define simd_load(p)        _mm_load_si128((const simd_t*)(p))
+  #define simd_store(p,v)     _mm_store_si128((simd_t*)(p),(v))
+  #define simd_zero()         _mm_setzero_si128()
+  #define simd_or(a,b)        _mm_or_si128(a,b)
+  #define simd_any(v)         (_mm_movemask_epi8(v) != 0) // any mask lane set
+  #define simd_nonzero(v)     (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xffff)
+
+  #define simd_set1_i16(x)    _mm_set1_epi16((short)(x))
+  #define simd_adds_i16(a,b)  _mm_adds_epi16(a,b)
+  #define simd_subs_i16(a,b)  _mm_subs_epi16(a,b)
+  #define simd_max_i16(a,b)   _mm_max_epi16(a,b)
+  #define simd_cmpgt_i16(a,b) _mm_cmpgt_epi16(a,b)
+  #define simd_cmpeq_i16(a,b) _mm_cmpeq_epi16(a,b)
+
+  #define simd_shl_i16(v)     _mm_slli_si128(v, 2)
+
+  #define simd_set1_u8(x)     _mm_set1_epi8((char)(x))
+  #define simd_adds_u8(a,b)   _mm_adds_epu8(a,b)
+  #define simd_subs_u8(a,b)   _mm_subs_epu8(a,b)
+  #define simd_max_u8(a,b)    _mm_max_epu8(a,b)
+  #define simd_shl_u8(v)      _mm_slli_si128(v, 1)
+
+  #define simd_set1_i32(x)    _mm_set1_epi32(x)
+  #define simd_add_i32(a,b)   _mm_add_epi32(a,b)
+  #define simd_sub_i32(a,b)   _mm_sub_epi32(a,b)
+  #define simd_cmpeq_i32(a,b) _mm_cmpeq_epi32(a,b)
+  #define simd_cmpgt_i32(a,b) _mm_cmpgt_epi32(a,b)
+  #define simd_and(a,b)       _mm_and_si128(a,b)
+
+  #ifdef __SSE4_1__
+    #include <smmintrin.h>
+    #define simd_max_i32(a,b)   _mm_max_epi32(a,b)
+    #define simd_blend(m,a,b)   _mm_blendv_epi8(b,a,m) // m ? a : b
+  #else
+    static inline simd_t simd_blend(simd_t m, simd_t a, simd_t b) {
+      return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+    }
+    static inline simd_t simd_max_i32(simd_t a, simd_t b) {
+      return simd_blend(_mm_cmpgt_epi32(a, b), a, b);
+    }
+  #endif
+
+  // Move every 32 bit lane up one place, shifting x into the first lane
+  static inline simd_t simd_shl_i32(simd_t v, int x) {
+    return _mm_or_si128(_mm_slli_si128(v, 4), _mm_cvtsi32_si128(x));
+  }
+
+#endif
+
+#ifdef SEQ_ALIGN_SIMD
+  #define SIMD_LANES_U8  (SIMD_BYTES)
+  #define SIMD_LANES_I16 (SIMD_BYTES/2)
+  #define SIMD_LANES_I32 (SIMD_BYTES/4)
+
+  // For moving values between vectors and scalar code
+  typedef union
+  {
+    simd_t v;
+    uint8_t u8[SIMD_LANES_U8];
+    int16_t i16[SIMD_LANES_I16];
+    int32_t i32[SIMD_LANES_I32];
+  } simd_lanes_t;
+
+  // Round a pointer up to the next vector boundary
+  #define SIMD_ALIGN(p) \
+    ((void*)(((uintptr_t)(p) + SIMD_BYTES - 1) & ~(uintptr_t)(SIMD_BYTES - 1)))
+#endif
+
+#endif /* ALIGNMENT_SIMD_HEADER_SEEN */
@@ -0,0 +1,391 @@
+/*
+ alignment_striped.c
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+// Striped Smith-Waterman, after:
+//   Farrar M. "Striped Smith-Waterman speeds database searches six times over
+//   other SIMD implementations" Bioinformatics 23(2) 2007
+//
+// Only the best score and its end coordinates are computed, with saturating
+// 8 bit lanes, then 16 bit lanes if those overflow.  The recurrences are the same as alignment_fill_matrices():
+//   match(i,j) = MAX(0, max(match,gap_a,gap_b)(i-1,j-1) + substitution)
+//   gap_a(i,j) = MAX(0, max(match,gap_b)(i,j-1) + open, gap_a(i,j-1) + extend)
+//   gap_b(i,j) = MAX(0, max(match,gap_a)(i-1,j) + open, gap_b(i-1,j) + extend)
+// Writing H = max(match,gap_a,gap_b) these collapse to Farrar's E/F/H form as
+// long as opening a gap costs at least as much as extending one.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "alignment.h"
+#include "alignment_macros.h"
+#include "alignment_simd.h"
+#include "alignment_striped.h"
+
+void striped_destroy(striped_t *st)
+{
+  free(st->mem);
+  memset(st, 0, sizeof(*st));
+}
+
+#ifdef SEQ_ALIGN_SIMD
+
+static void* _striped_ensure_capacity(striped_t *st, size_t mem)
+{
+  if(st->capacity < mem)
+  {
+    st->capacity = ROUNDUP2POW(mem);
+    free(st->mem);
+    st->mem = malloc(st->capacity + SIMD_BYTES);
+    if(st->mem == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+  return SIMD_ALIGN(st->mem);
+}
+
+// Scoring this kernel can reproduce exactly
+static bool _striped_supported(const scoring_t *scoring)
+{
+  return !scoring->no_gaps_in_a && !scoring->no_gaps_in_b &&
+         scoring->gap_open <= 0 && scoring->gap_extend <= 0 &&
+         (long)scoring->gap_open + scoring->gap_extend > -INT16_MAX;
+}
+
+// Substitution score as a lane value, INT16_MIN for a forbidden mismatch
+// Returns false if the score does not fit in a lane
+static bool _striped_sub(const scoring_t *scoring, char a, char b, int16_t *s)
+{
+  bool is_match;
+  int score;
+  scoring_lookup(scoring, a, b, &score, &is_match);
+
+  if(scoring->no_mismatches && !is_match) { *s = INT16_MIN; return true; }
+  if(score <= -INT16_MAX || score >= INT16_MAX) return false;
+  *s = (int16_t)score;
+  return true;
+}
+
+// Returns false if the scores do not fit in 16 bits
+static bool _striped_sw_i16(striped_t *st,
+                            const char *seq_a, const char *seq_b,
+                            size_t len_a, size_t len_b,
+                            const scoring_t *scoring,
+                            const int *slots, size_t nslots,
+                            score_t *score, size_t *end_a, size_t *end_b)
+{
+  const size_t nlanes = SIMD_LANES_I16;
+  const size_t seglen = (len_a + nlanes - 1) / nlanes;
+  size_t i, j, k, l;
+
+  // profile, then H (two columns), E and a copy of H for the best column
+  simd_t *profile = _striped_ensure_capacity(st, (nslots+4)*seglen*SIMD_BYTES);
+  simd_t *pvHLoad = profile + nslots*seglen;
+  simd_t *pvHStore = pvHLoad + seglen;
+  simd_t *pvE = pvHStore + seglen;
+  simd_t *pvHBest = pvE + seglen, *tmp;
+
+  for(i = 0; i < 256; i++)
+  {
+    if(slots[i] < 0) continue;
+    int16_t *prof = (int16_t*)(profile + slots[i]*seglen);
+    for(k = 0; k < seglen; k++) {
+      for(l = 0; l < nlanes; l++) {
+        size_t pos = l*seglen + k;
+        // Padding past the end of seq_a can never score
+        prof[k*nlanes+l] = INT16_MIN;
+        if(pos < len_a && !_striped_sub(scoring, seq_a[pos], (char)i,
+                                        &prof[k*nlanes+l])) return false;
+      }
+    }
+  }
+
+  const simd_t vZero = simd_zero();
+  const simd_t vGapO = simd_set1_i16(-(scoring->gap_open + scoring->gap_extend));
+  const simd_t vGapE = simd_set1_i16(-scoring->gap_extend);
+  simd_t vH, vE, vF, vMaxCol;
+  simd_lanes_t colmax;
+  int16_t best = 0;
+  size_t best_j = 0;
+
+  memset(pvHStore, 0, seglen*SIMD_BYTES);
+  memset(pvE, 0, seglen*SIMD_BYTES);
+
+  for(j = 0; j < len_b; j++)
+  {
+    const simd_t *vP = profile + slots[(uint8_t)seq_b[j]]*seglen;
+
+    // H(i-1,j-1) for the first segment comes from the end of the last one
+    vH = simd_shl_i16(simd_load(pvHStore + seglen - 1));
+    tmp = pvHLoad; pvHLoad = pvHStore; pvHStore = tmp;
+
+    vF = vZero;
+    vMaxCol = vZero;
+
+    for(k = 0; k < seglen; k++)
+    {
+      // match_scores
+      vH = simd_adds_i16(vH, simd_load(vP + k));
+      vH = simd_max_i16(vH, vZero);
+      vMaxCol = simd_max_i16(vMaxCol, vH);
+
+      vE = simd_load(pvE + k);
+      vH = simd_max_i16(vH, vE);
+      vH = simd_max_i16(vH, vF);
+      simd_store(pvHStore + k, vH);
+
+      // gap_a for the next column, gap_b for the next row
+      vH = simd_subs_i16(vH, vGapO);
+      vE = simd_max_i16(simd_subs_i16(vE, vGapE), vH);
+      vF = simd_max_i16(simd_subs_i16(vF, vGapE), vH);
+      simd_store(pvE + k, vE);
+
+      vH = simd_load(pvHLoad + k);
+    }
+
+    // Lazy-F loop: carry gap_b across segment boundaries until it can no
+    // longer raise H or beat a gap opened from H in the next row
+    vF = simd_shl_i16(vF);
+    k = 0;
+    vH = simd_load(pvHStore);
+
+    while(simd_any(simd_or(simd_cmpgt_i16(vF, vH),
+                           simd_cmpgt_i16(simd_subs_i16(vF, vGapE),
+                                          simd_max_i16(simd_subs_i16(vH, vGapO),
+                                                       vZero)))))
+    {
+      vH = simd_max_i16(vH, vF);
+      simd_store(pvHStore + k, vH);
+      vH = simd_subs_i16(vH, vGapO);
+      simd_store(pvE + k, simd_max_i16(simd_load(pvE + k), vH));
+      vF = simd_subs_i16(vF, vGapE);
+
+      if(++k == seglen) { k = 0; vF = simd_shl_i16(vF); }
+      vH = simd_load(pvHStore + k);
+    }
+
+    colmax.v = vMaxCol;
+    int16_t m = 0;
+    for(l = 0; l < nlanes; l++) m = MAX2(m, colmax.i16[l]);
+
+    // A saturated lane means the 16 bit scores are no longer exact
+    if(m == INT16_MAX) return false;
+
+    if(m > best) {
+      // Keep the column to the left so we can recover match_scores later
+      best = m;
+      best_j = j;
+      memcpy(pvHBest, pvHLoad, seglen*SIMD_BYTES);
+    }
+  }
+
+  if(best == 0) return true;
+
+  // Find the first position in seq_a of the best cell in column best_j
+  const int16_t *hprev = (const int16_t*)pvHBest;
+  const int16_t *prof = (const int16_t*)(profile + slots[(uint8_t)seq_b[best_j]]*seglen);
+
+  for(i = 0; i < len_a; i++)
+  {
+    int diag = 0;
+    if(i > 0) diag = hprev[((i-1) % seglen)*nlanes + (i-1) / seglen];
+    int m = diag + prof[(i % seglen)*nlanes + i / seglen];
+    if(m == best) break;
+  }
+
+  *score = best;
+  *end_a = i;
+  *end_b = best_j;
+  return true;
+}
+
+
+// As _striped_sw_i16() but with twice as many lanes.  Lanes are unsigned, so
+// every score is held plus a bias that makes all substitution scores >= 0;
+// the floor of zero then comes for free from saturating subtraction.
+// Returns false if the scores do not fit in 8 bits.
+static bool _striped_sw_u8(striped_t *st,
+                           const char *seq_a, const char *seq_b,
+                           size_t len_a, size_t len_b,
+                           const scoring_t *scoring,
+                           const int *slots, size_t nslots,
+                           score_t *score, size_t *end_a, size_t *end_b)
+{
+  const int bias = -MIN2(scoring->min_penalty, 0);
+  const int gap_open = -(scoring->gap_open + scoring->gap_extend);
+
+  // A forbidden mismatch cannot be expressed as a biased score
+  if(scoring->no_mismatches || gap_open >= UINT8_MAX ||
+     bias + MAX2(scoring->max_penalty, 0) >= UINT8_MAX) return false;
+
+  const size_t nlanes = SIMD_LANES_U8;
+  const size_t seglen = (len_a + nlanes - 1) / nlanes;
+  size_t i, j, k, l;
+
+  // profile, then H (two columns), E and a copy of H for the best column
+  simd_t *profile = _striped_ensure_capacity(st, (nslots+4)*seglen*SIMD_BYTES);
+  simd_t *pvHLoad = profile + nslots*seglen;
+  simd_t *pvHStore = pvHLoad + seglen;
+  simd_t *pvE = pvHStore + seglen;
+  simd_t *pvHBest = pvE + seglen, *tmp;
+
+  for(i = 0; i < 256; i++)
+  {
+    if(slots[i] < 0) continue;
+    uint8_t *prof = (uint8_t*)(profile + slots[i]*seglen);
+    for(k = 0; k < seglen; k++) {
+      for(l = 0; l < nlanes; l++) {
+        size_t pos = l*seglen + k;
+        bool is_match;
+        int sub;
+        prof[k*nlanes+l] = 0;
+        if(pos < len_a) {
+          scoring_lookup(scoring, seq_a[pos], (char)i, &sub, &is_match);
+          prof[k*nlanes+l] = (uint8_t)(sub + bias);
+        }
+      }
+    }
+  }
+
+  const simd_t vZero = simd_zero();
+  const simd_t vBias = simd_set1_u8(bias);
+  const simd_t vGapO = simd_set1_u8(gap_open);
+  const simd_t vGapE = simd_set1_u8(-scoring->gap_extend);
+  simd_t vH, vE, vF, vMaxCol;
+  simd_lanes_t colmax;
+  int best = 0;
+  size_t best_j = 0;
+
+  memset(pvHStore, 0, seglen*SIMD_BYTES);
+  memset(pvE, 0, seglen*SIMD_BYTES);
+
+  for(j = 0; j < len_b; j++)
+  {
+    const simd_t *vP = profile + slots[(uint8_t)seq_b[j]]*seglen;
+
+    vH = simd_shl_u8(simd_load(pvHStore + seglen - 1));
+    tmp = pvHLoad; pvHLoad = pvHStore; pvHStore = tmp;
+
+    vF = vZero;
+    vMaxCol = vZero;
+
+    for(k = 0; k < seglen; k++)
+    {
+      vH = simd_subs_u8(simd_adds_u8(vH, simd_load(vP + k)), vBias);
+      vMaxCol = simd_max_u8(vMaxCol, vH);
+
+      vE = simd_load(pvE + k);
+      vH = simd_max_u8(vH, vE);
+      vH = simd_max_u8(vH, vF);
+      simd_store(pvHStore + k, vH);
+
+      vH = simd_subs_u8(vH, vGapO);
+      vE = simd_max_u8(simd_subs_u8(vE, vGapE), vH);
+      vF = simd_max_u8(simd_subs_u8(vF, vGapE), vH);
+      simd_store(pvE + k, vE);
+
+      vH = simd_load(pvHLoad + k);
+    }
+
+    // Lazy-F loop, with unsigned comparisons done by saturating subtraction
+    vF = simd_shl_u8(vF);
+    k = 0;
+    vH = simd_load(pvHStore);
+
+    while(simd_nonzero(simd_or(simd_subs_u8(vF, vH),
+                               simd_subs_u8(simd_subs_u8(vF, vGapE),
+                                            simd_subs_u8(vH, vGapO)))))
+    {
+      vH = simd_max_u8(vH, vF);
+      simd_store(pvHStore + k, vH);
+      vH = simd_subs_u8(vH, vGapO);
+      simd_store(pvE + k, simd_max_u8(simd_load(pvE + k), vH));
+      vF = simd_subs_u8(vF, vGapE);
+
+      if(++k == seglen) { k = 0; vF = simd_shl_u8(vF); }
+      vH = simd_load(pvHStore + k);
+    }
+
+    colmax.v = vMaxCol;
+    int m = 0;
+    for(l = 0; l < nlanes; l++) m = MAX2(m, colmax.u8[l]);
+
+    // Adding the bias may have saturated
+    if(m + bias >= UINT8_MAX) return false;
+
+    if(m > best) {
+      best = m;
+      best_j = j;
+      memcpy(pvHBest, pvHLoad, seglen*SIMD_BYTES);
+    }
+  }
+
+  if(best == 0) return true;
+
+  const uint8_t *hprev = (const uint8_t*)pvHBest;
+  const uint8_t *prof = (const uint8_t*)(profile + slots[(uint8_t)seq_b[best_j]]*seglen);
+
+  for(i = 0; i < len_a; i++)
+  {
+    int diag = 0;
+    if(i > 0) diag = hprev[((i-1) % seglen)*nlanes + (i-1) / seglen];
+    int m = diag + prof[(i % seglen)*nlanes + i / seglen] - bias;
+    if(m == best) break;
+  }
+
+  *score = best;
+  *end_a = i;
+  *end_b = best_j;
+  return true;
+}
+
+bool striped_sw_score(striped_t *st,
+                      const char *seq_a, const char *seq_b,
+                      size_t len_a, size_t len_b,
+                      const scoring_t *scoring,
+                      score_t *score, size_t *end_a, size_t *end_b)
+{
+  if(!_striped_supported(scoring)) return false;
+
+  *score = 0;
+  *end_a = *end_b = 0;
+  if(len_a == 0 || len_b == 0) return true;
+
+  // Give each character of seq_b a row in the query profile
+  int slots[256];
+  size_t j, nslots = 0;
+  memset(slots, 0xff, sizeof(slots));
+
+  for(j = 0; j < len_b; j++) {
+    uint8_t c = (uint8_t)seq_b[j];
+    if(slots[c] < 0) slots[c] = nslots++;
+  }
+
+  // Start with the narrowest lanes, moving up if the scores saturate
+  return _striped_sw_u8(st, seq_a, seq_b, len_a, len_b, scoring, slots, nslots,
+                        score, end_a, end_b) ||
+         _striped_sw_i16(st, seq_a, seq_b, len_a, len_b, scoring, slots, nslots,
+                         score, end_a, end_b);
+}
+
+#else
+
+bool striped_sw_score(striped_t *st,
+                      const char *seq_a, const char *seq_b,
+                      size_t len_a, size_t len_b,
+                      const scoring_t *scoring,
+                      score_t *score, size_t *end_a, size_t *end_b)
+{
+  (void)st; (void)seq_a; (void)seq_b; (void)len_a; (void)len_b;
+  (void)scoring; (void)score; (void)end_a; (void)end_b;
+  return false;
+}
+
+#endif /* SEQ_ALIGN_SIMD */
@@ -0,0 +1,47 @@
+/*
+ alignment_striped.h
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+#ifndef ALIGNMENT_STRIPED_HEADER_SEEN
+#define ALIGNMENT_STRIPED_HEADER_SEEN
+
+#include <string.h> // memset
+#include "alignment_scoring.h"
+
+// Workspace for the striped (Farrar 2007) score-only Smith-Waterman kernel.
+// seq_a is the query: it is striped across vector lanes and a profile of it is
+// built for each character that occurs in seq_b.
+typedef struct
+{
+  char *mem;
+  size_t capacity;
+} striped_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define striped_init(st) (memset(st, 0, sizeof(striped_t)))
+void striped_destroy(striped_t *st);
+
+// Best local alignment score and where it ends (0-based position of the last
+// base in seq_a and seq_b).  Ties go to the hit that ends first in seq_b, then
+// first in seq_a.  Returns false if the kernel cannot handle this input -- no
+// SIMD support, scoring it does not implement (--nogaps.., positive gap
+// scores) or scores too large for the lanes -- in which case the caller must
+// use the full dynamic programming matrices instead.
+bool striped_sw_score(striped_t *st,
+                      const char *seq_a, const char *seq_b,
+                      size_t len_a, size_t len_b,
+                      const scoring_t *scoring,
+                      score_t *score, size_t *end_a, size_t *end_b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ALIGNMENT_STRIPED_HEADER_SEEN */
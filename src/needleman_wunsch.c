@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include "needleman_wunsch.h"
+#include "alignment_macros.h"
 
 nw_aligner_t* needleman_wunsch_new()
 {
@@ -31,116 +32,145 @@ void needleman_wunsch_align(const char *a, const char *b,
   needleman_wunsch_align2(a, b, strlen(a), strlen(b), scoring, nw, result);
 }
 
-void needleman_wunsch_align2(const char *a, const char *b,
-                             size_t len_a, size_t len_b,
-                             const scoring_t *scoring,
-                             nw_aligner_t *nw, alignment_t *result)
+// Read the alignment out of filled matrices, returns the matrix it ends in
+static enum Matrix needleman_wunsch_traceback(nw_aligner_t *nw,
+                                              alignment_t *result)
 {
-  aligner_align(nw, a, b, len_a, len_b, scoring, 0);
-
-  // work backwards re-tracing optimal alignment, then shift sequences into place
+  // work backwards re-tracing optimal alignment, recording each step, then
+  // write the alignment out forwards in one go
 
   // note: longest_alignment = strlen(seq_a) + strlen(seq_b)
   size_t longest_alignment = nw->score_width-1 + nw->score_height-1;
-  alignment_ensure_capacity(result, longest_alignment);
+  uint8_t *moves = aligner_moves(nw, longest_alignment);
+  size_t num_moves = 0;
 
-  // Position of next alignment character in buffer (working backwards)
-  size_t next_char = longest_alignment-1;
-
-  size_t arr_size = nw->score_width * nw->score_height;
+  // Compact fills only keep the last two rows of scores
+  size_t end_index = nw->compact
+    ? ((nw->score_height-1) & 1) * nw->score_width + nw->score_width-1
+    : aligner_index(nw, nw->score_width-1, nw->score_height-1);
 
   // Get max score (and therefore current matrix)
   enum Matrix curr_matrix = MATCH;
-  score_t curr_score = nw->match_scores[arr_size-1];
+  score_t curr_score = nw->match_scores[end_index];
 
-  if(nw->gap_b_scores[arr_size-1] >= curr_score)
+  if(nw->gap_b_scores[end_index] >= curr_score)
   {
     curr_matrix = GAP_B;
-    curr_score = nw->gap_b_scores[arr_size-1];
+    curr_score = nw->gap_b_scores[end_index];
   }
 
-  if(nw->gap_a_scores[arr_size-1] >= curr_score)
+  if(nw->gap_a_scores[end_index] >= curr_score)
   {
     curr_matrix = GAP_A;
-    curr_score = nw->gap_a_scores[arr_size-1];
+    curr_score = nw->gap_a_scores[end_index];
   }
 
   #ifdef SEQ_ALIGN_VERBOSE
-    alignment_print_matrices(nw);
+    if(!nw->compact) alignment_print_matrices(nw);
   #endif
 
   result->score = curr_score;
-  char *alignment_a = result->result_a, *alignment_b = result->result_b;
+  enum Matrix end_matrix = curr_matrix;
 
   // coords in score matrices
   size_t score_x = nw->score_width-1, score_y = nw->score_height-1;
-  size_t arr_index = arr_size - 1;
 
-  for(; score_x > 0 && score_y > 0; next_char--)
+  // Follow the traceback bits recorded by the fill
+  while(score_x > 0 && score_y > 0)
   {
     #ifdef SEQ_ALIGN_VERBOSE
-    printf("matrix: %s (%lu,%lu) score: %i\n",
-           MATRIX_NAME(curr_matrix), score_x-1, score_y-1, curr_score);
+    printf("matrix: %s (%lu,%lu)\n",
+           MATRIX_NAME(curr_matrix), score_x-1, score_y-1);
     #endif
 
-    switch(curr_matrix)
-    {
-      case MATCH:
-        alignment_a[next_char] = nw->seq_a[score_x-1];
-        alignment_b[next_char] = nw->seq_b[score_y-1];
-        break;
-
-      case GAP_A:
-        alignment_a[next_char] = '-';
-        alignment_b[next_char] = nw->seq_b[score_y-1];
-        break;
-
-      case GAP_B:
-        alignment_a[next_char] = nw->seq_a[score_x-1];
-        alignment_b[next_char] = '-';
-        break;
-
-      default:
-        fprintf(stderr, "Program error: invalid matrix number\n");
-        fprintf(stderr, "Please submit a bug report to: turner.isaac@gmail.com\n");
-        exit(EXIT_FAILURE);
-    }
-
-    if(score_x > 0 && score_y > 0)
-    {
-      alignment_reverse_move(&curr_matrix, &curr_score,
-                             &score_x, &score_y, &arr_index, nw);
-    }
+    moves[num_moves++] = curr_matrix;
+    alignment_traceback_move(&curr_matrix, &score_x, &score_y, nw);
   }
 
-  // Gap in A
-  while(score_y > 0)
-  {
-    alignment_a[next_char] = '-';
-    alignment_b[next_char] = nw->seq_b[score_y-1];
-    next_char--;
-    score_y--;
-  }
+  // Gap in A, then gap in B, at the start
+  memset(moves + num_moves, GAP_A, score_y);
+  num_moves += score_y;
+  memset(moves + num_moves, GAP_B, score_x);
+  num_moves += score_x;
+
+  alignment_from_moves(result, moves, num_moves, nw->seq_a, nw->seq_b,
+                       nw->scoring->case_sensitive);
+
+  return end_matrix;
+}
+
+void needleman_wunsch_align2(const char *a, const char *b,
+                             size_t len_a, size_t len_b,
+                             const scoring_t *scoring,
+                             nw_aligner_t *nw, alignment_t *result)
+{
+  aligner_align(nw, a, b, len_a, len_b, scoring, 0);
+  needleman_wunsch_traceback(nw, result);
+}
 
-  // Gap in B
-  while(score_x > 0)
+void needleman_wunsch_align_compact(const char *a, const char *b,
+                                    size_t len_a, size_t len_b,
+                                    const scoring_t *scoring,
+                                    nw_aligner_t *nw, alignment_t *result)
+{
+  aligner_align_compact(nw, a, b, len_a, len_b, scoring);
+  needleman_wunsch_traceback(nw, result);
+}
+
+score_t needleman_wunsch_score(const char *a, const char *b,
+                               size_t len_a, size_t len_b,
+                               const scoring_t *scoring, nw_aligner_t *nw)
+{
+  return aligner_score(nw, a, b, len_a, len_b, scoring, 0, NULL, NULL);
+}
+
+void needleman_wunsch_align_banded(const char *a, const char *b,
+                                   size_t len_a, size_t len_b,
+                                   const scoring_t *scoring,
+                                   size_t band, bool widen,
+                                   nw_aligner_t *nw, alignment_t *result)
+{
+  enum Matrix end_matrix;
+  size_t end_index;
+
+  while(1)
   {
-    alignment_a[next_char] = nw->seq_a[score_x-1];
-    alignment_b[next_char] = '-';
-    next_char--;
-    score_x--;
-  }
+    aligner_align_banded(nw, a, b, len_a, len_b, scoring, 0, band);
+
+    // No path fits in the band at all (e.g. --nogapsin1 needs a gap down the
+    // first column): widen whether asked to or not
+    end_index = aligner_index(nw, len_a, len_b);
+    if(nw->banded && MAX3(nw->match_scores[end_index],
+                          nw->gap_a_scores[end_index],
+                          nw->gap_b_scores[end_index]) < SCORE_MIN/2)
+    {
+      band = band > 0 ? band*2 : 1;
+      continue;
+    }
+
+    end_matrix = needleman_wunsch_traceback(nw, result);
 
-  // Shift alignment strings back into 0th position in char arrays
-  int first_char = next_char+1;
-  int alignment_len = longest_alignment - first_char;
+    if(!widen || !aligner_band_touched(nw, end_matrix, len_a, len_b, 0))
+      break;
 
-  // Use memmove
-  memmove(alignment_a, alignment_a+first_char, alignment_len);
-  memmove(alignment_b, alignment_b+first_char, alignment_len);
+    band = band > 0 ? band*2 : 1;
+  }
+}
 
-  alignment_a[alignment_len] = '\0';
-  alignment_b[alignment_len] = '\0';
+static void _needleman_wunsch_batch_hit(aligner_t *aligner, size_t i,
+                                        void *arg)
+{
+  alignment_t **results = arg;
+  needleman_wunsch_traceback(aligner, results[i]);
+}
 
-  result->length = alignment_len;
+void needleman_wunsch_align_batch(const char *const *seqs_a,
+                                  const char *const *seqs_b,
+                                  const size_t *lens_a, const size_t *lens_b,
+                                  size_t n, const scoring_t *scoring,
+                                  nw_aligner_t *nw, aligner_batch_t *batch,
+                                  alignment_t **results)
+{
+  aligner_batch_align(batch, seqs_a, seqs_b, lens_a, lens_b, n, scoring, 0,
+                      results, nw, _needleman_wunsch_batch_hit, results);
 }
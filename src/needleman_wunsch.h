@@ -12,6 +12,7 @@
 
 #include "seq_align.h"
 #include "alignment.h"
+#include "alignment_batch.h"
 
 typedef aligner_t nw_aligner_t;
 
@@ -31,6 +32,50 @@ void needleman_wunsch_align2(const char *a, const char *b,
                              const scoring_t *scoring,
                              nw_aligner_t *nw, alignment_t *result);
 
+// Same alignment as needleman_wunsch_align2(), but only keeps one byte of
+// traceback per cell (plus two rows of scores) instead of three full score
+// matrices: len_a*len_b bytes rather than 12*len_a*len_b
+void needleman_wunsch_align_compact(const char *a, const char *b,
+                                    size_t len_a, size_t len_b,
+                                    const scoring_t *scoring,
+                                    nw_aligner_t *nw, alignment_t *result);
+
+// Score of the alignment needleman_wunsch_align2() would return, keeping only
+// two rows of the matrices: O(MIN(len_a,len_b)) memory and no traceback
+score_t needleman_wunsch_score(const char *a, const char *b,
+                               size_t len_a, size_t len_b,
+                               const scoring_t *scoring, nw_aligner_t *nw);
+
+// Only consider alignments within `band` diagonals of those joining the start
+// and end of the matrices (see aligner_align_banded()), in O(n*band) time and
+// memory.  With widen, the band is doubled until the best path no longer
+// touches its edge.
+void needleman_wunsch_align_banded(const char *a, const char *b,
+                                   size_t len_a, size_t len_b,
+                                   const scoring_t *scoring,
+                                   size_t band, bool widen,
+                                   nw_aligner_t *nw, alignment_t *result);
+
+// Same alignment as needleman_wunsch_align2() in O(len_a) memory rather than
+// O(len_a*len_b), for sequences too long for the full matrices.  Takes
+// roughly twice as long.  Where several alignments share the best score, the
+// one returned may differ from needleman_wunsch_align2()'s.
+void needleman_wunsch_align_linear(const char *a, const char *b,
+                                   size_t len_a, size_t len_b,
+                                   const scoring_t *scoring,
+                                   alignment_t *result);
+
+// Align n pairs, seqs_a[i] against seqs_b[i] into results[i], filling the
+// matrices of several pairs at once (one per SIMD lane).  Pairs are grouped
+// by length so lanes stay busy.  Results are the same as calling
+// needleman_wunsch_align2() on each pair.
+void needleman_wunsch_align_batch(const char *const *seqs_a,
+                                  const char *const *seqs_b,
+                                  const size_t *lens_a, const size_t *lens_b,
+                                  size_t n, const scoring_t *scoring,
+                                  nw_aligner_t *nw, aligner_batch_t *batch,
+                                  alignment_t **results);
+
 #ifdef __cplusplus
 }
 #endif
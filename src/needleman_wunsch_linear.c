@@ -0,0 +1,490 @@
+/*
+ needleman_wunsch_linear.c
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+// Global alignment in linear memory, after:
+//   Myers E.W. & Miller W. "Optimal alignments in linear space"
+//   CABIOS 4(1) 1988
+//
+// Scores for the middle row of a block are computed forwards from its top left
+// and backwards from its bottom right, keeping only two rows of each of the
+// three matrices.  The best cell and matrix on the middle row splits the block
+// in two, each solved the same way until they are small enough to fill in
+// full.  Moves are scored exactly as alignment_fill_matrices() scores them --
+// by their position in the whole matrix -- so free start/end gaps,
+// --nogapsin.. and --nomismatches all behave as they do in
+// needleman_wunsch_align2().
+//
+// alignment_linear_path() reuses this to recover local alignment paths for
+// smith_waterman_align_linear(), with moves into row or column 0 forbidden and
+// cells on earlier hits blocked.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "needleman_wunsch.h"
+#include "alignment_macros.h"
+#include "alignment_linear.h"
+
+// Below this many cells a block is filled in full and traced back
+#define NW_LINEAR_BLOCK_CELLS 4096
+
+// Unreachable.  Small enough that adding two of them cannot overflow.
+#define NEG_INF (LONG_MIN/4)
+
+// Matrix not chosen yet (only for the end of the whole alignment)
+#define ANY_MATRIX -1
+
+typedef struct
+{
+  const char *seq_a, *seq_b;
+  size_t len_a, len_b;
+  const scoring_t *scoring;
+  long *fwd, *bck, *block; // two rows forwards, two backwards, small blocks
+  size_t block_capacity;
+  // Blocked cells: two rows (fwd, bck) and small blocks, one byte per cell
+  uint8_t *rows_blocked, *block_blocked;
+  size_t block_blocked_capacity;
+  alignment_t *result;
+  // Local paths (alignment_linear_path): row and column 0 are the border
+  bool local;
+  align_blocked_f blocked;
+  void *blocked_arg;
+} nw_linear_t;
+
+static inline long _add(long a, long b)
+{
+  return a <= NEG_INF || b <= NEG_INF ? NEG_INF : a + b;
+}
+
+static inline long _max3(long a, long b, long c)
+{
+  return MAX3(a, b, c);
+}
+
+// Mark the blocked cells x0..x1 of row y in out
+static inline void _blocked_row(const nw_linear_t *nl, size_t y,
+                                size_t x0, size_t x1, uint8_t *out)
+{
+  if(nl->blocked != NULL) nl->blocked(nl->blocked_arg, y, x0, x1, out);
+  else memset(out, 0, x1-x0+1);
+}
+
+// Cost of a move that ends on cell (x,y) in matrix `to`, coming from the same
+// matrix (extend) or a different one (open).  NEG_INF if not allowed, as into
+// a blocked cell.
+static inline void _move_costs(const nw_linear_t *nl, size_t x, size_t y,
+                               enum Matrix to, bool blocked,
+                               long *open, long *extend)
+{
+  const scoring_t *scoring = nl->scoring;
+  const long gap_open = scoring->gap_open + scoring->gap_extend;
+  const long gap_extend = scoring->gap_extend;
+
+  if(blocked || (nl->local && (x == 0 || y == 0)))
+  {
+    *open = *extend = NEG_INF;
+  }
+  else if(to == MATCH)
+  {
+    bool is_match;
+    int substitution_penalty;
+
+    if(x == 0 || y == 0) { *open = *extend = NEG_INF; return; }
+    scoring_lookup(scoring, nl->seq_a[x-1], nl->seq_b[y-1],
+                   &substitution_penalty, &is_match);
+    *open = *extend = scoring->no_mismatches && !is_match ? NEG_INF
+                                                          : substitution_penalty;
+  }
+  else if(to == GAP_A)
+  {
+    // from [x][y-1]
+    if(y == 0) { *open = *extend = NEG_INF; }
+    else if(x == 0 && scoring->no_start_gap_penalty) { *open = *extend = 0; }
+    else if(x == 0) { *open = gap_open; *extend = gap_extend; }
+    else if(x == nl->len_a && scoring->no_end_gap_penalty) { *open = *extend = 0; }
+    else if(!scoring->no_gaps_in_a || x == nl->len_a) {
+      *open = gap_open; *extend = gap_extend;
+    }
+    else { *open = *extend = NEG_INF; }
+  }
+  else
+  {
+    // from [x-1][y]
+    if(x == 0) { *open = *extend = NEG_INF; }
+    else if(y == 0 && scoring->no_start_gap_penalty) { *open = *extend = 0; }
+    else if(y == 0) { *open = gap_open; *extend = gap_extend; }
+    else if(y == nl->len_b && scoring->no_end_gap_penalty) { *open = *extend = 0; }
+    else if(!scoring->no_gaps_in_b || y == nl->len_b) {
+      *open = gap_open; *extend = gap_extend;
+    }
+    else { *open = *extend = NEG_INF; }
+  }
+}
+
+// Score of arriving at (x,y) in each matrix, given the scores of the cells
+// up-left (diag), up and left.  Any of these may be NULL if outside the block.
+static inline void _forward_cell(const nw_linear_t *nl, size_t x, size_t y,
+                                 bool blocked, const long *diag,
+                                 const long *up, const long *left, long *out)
+{
+  long open, extend;
+
+  out[MATCH] = out[GAP_A] = out[GAP_B] = NEG_INF;
+
+  if(diag != NULL) {
+    _move_costs(nl, x, y, MATCH, blocked, &open, &extend);
+    out[MATCH] = _add(_max3(diag[MATCH], diag[GAP_A], diag[GAP_B]), open);
+  }
+  if(up != NULL) {
+    _move_costs(nl, x, y, GAP_A, blocked, &open, &extend);
+    out[GAP_A] = _max3(_add(up[MATCH], open), _add(up[GAP_A], extend),
+                       _add(up[GAP_B], open));
+  }
+  if(left != NULL) {
+    _move_costs(nl, x, y, GAP_B, blocked, &open, &extend);
+    out[GAP_B] = _max3(_add(left[MATCH], open), _add(left[GAP_A], open),
+                       _add(left[GAP_B], extend));
+  }
+}
+
+// Best score from (x,y) in each matrix to the end of the block, given the
+// scores of the cells down-right (diag), down and right (any may be NULL).
+// below and here mark the blocked cells of rows y+1 and y from column x.
+static inline void _backward_cell(const nw_linear_t *nl, size_t x, size_t y,
+                                  const uint8_t *below, const uint8_t *here,
+                                  const long *diag, const long *down,
+                                  const long *right, long *out)
+{
+  long open, extend, m, s;
+  enum Matrix from;
+
+  long to_match = NEG_INF, to_gap_a[2] = {NEG_INF, NEG_INF};
+  long to_gap_b[2] = {NEG_INF, NEG_INF};
+
+  if(diag != NULL) {
+    _move_costs(nl, x+1, y+1, MATCH, below[1], &open, &extend);
+    to_match = _add(diag[MATCH], open);
+  }
+  if(down != NULL) {
+    _move_costs(nl, x, y+1, GAP_A, below[0], &open, &extend);
+    to_gap_a[0] = _add(down[GAP_A], open);
+    to_gap_a[1] = _add(down[GAP_A], extend);
+  }
+  if(right != NULL) {
+    _move_costs(nl, x+1, y, GAP_B, here[1], &open, &extend);
+    to_gap_b[0] = _add(right[GAP_B], open);
+    to_gap_b[1] = _add(right[GAP_B], extend);
+  }
+
+  for(from = MATCH; from <= GAP_B; from++) {
+    m = to_match;
+    s = to_gap_a[from == GAP_A];
+    m = MAX2(m, s);
+    s = to_gap_b[from == GAP_B];
+    out[from] = MAX2(m, s);
+  }
+}
+
+// Fill rows y0..y1 of columns x0..x1 forwards from (x0,y0) in matrix s0,
+// leaving the scores of row y1 in `row` (3 per column)
+static long* _forward(nw_linear_t *nl, size_t x0, size_t y0, int s0,
+                      size_t x1, size_t y1)
+{
+  size_t x, y, w = x1-x0+1;
+  long *prev = nl->fwd, *curr = nl->fwd + 3*w, *tmp;
+  uint8_t *blocked = nl->rows_blocked;
+
+  for(y = y0; y <= y1; y++)
+  {
+    _blocked_row(nl, y, x0, x1, blocked);
+
+    for(x = x0; x <= x1; x++)
+    {
+      long *out = curr + 3*(x-x0);
+      if(y == y0 && x == x0) {
+        out[MATCH] = out[GAP_A] = out[GAP_B] = NEG_INF;
+        out[s0] = 0;
+        continue;
+      }
+      _forward_cell(nl, x, y, blocked[x-x0],
+                    x > x0 && y > y0 ? prev + 3*(x-x0-1) : NULL,
+                    y > y0 ? prev + 3*(x-x0) : NULL,
+                    x > x0 ? curr + 3*(x-x0-1) : NULL, out);
+    }
+    tmp = prev; prev = curr; curr = tmp;
+  }
+
+  return prev;
+}
+
+// Fill rows y1..y0 of columns x1..x0 backwards to (x1,y1) in matrix s1
+// (or any matrix), leaving the scores of row y0
+static long* _backward(nw_linear_t *nl, size_t x0, size_t y0,
+                       size_t x1, size_t y1, int s1)
+{
+  size_t x, y, w = x1-x0+1;
+  long *prev = nl->bck, *curr = nl->bck + 3*w, *tmp;
+  uint8_t *below = nl->rows_blocked, *here = nl->rows_blocked + w, *swap;
+
+  for(y = y1+1; y-- > y0; )
+  {
+    _blocked_row(nl, y, x0, x1, here);
+
+    for(x = x1+1; x-- > x0; )
+    {
+      long *out = curr + 3*(x-x0);
+      if(y == y1 && x == x1) {
+        out[MATCH] = out[GAP_A] = out[GAP_B] = s1 == ANY_MATRIX ? 0 : NEG_INF;
+        if(s1 != ANY_MATRIX) out[s1] = 0;
+        continue;
+      }
+      _backward_cell(nl, x, y, below + (x-x0), here + (x-x0),
+                     x < x1 && y < y1 ? prev + 3*(x-x0+1) : NULL,
+                     y < y1 ? prev + 3*(x-x0) : NULL,
+                     x < x1 ? curr + 3*(x-x0+1) : NULL, out);
+    }
+    tmp = prev; prev = curr; curr = tmp;
+    swap = below; below = here; here = swap;
+  }
+
+  return prev;
+}
+
+// Fill a small block in full and trace back from (x1,y1) in matrix s1
+static void _solve_block(nw_linear_t *nl, size_t x0, size_t y0, int s0,
+                         size_t x1, size_t y1, int s1)
+{
+  size_t x, y, w = x1-x0+1, h = y1-y0+1;
+  size_t ncells = 3*w*h;
+
+  if(nl->block_capacity < ncells) {
+    nl->block_capacity = ROUNDUP2POW(ncells);
+    free(nl->block);
+    nl->block = malloc(nl->block_capacity * sizeof(long));
+    if(nl->block == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if(nl->block_blocked_capacity < w*h) {
+    nl->block_blocked_capacity = ROUNDUP2POW(w*h);
+    free(nl->block_blocked);
+    nl->block_blocked = malloc(nl->block_blocked_capacity);
+    if(nl->block_blocked == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  long *block = nl->block;
+  uint8_t *blocked = nl->block_blocked;
+  #define CELL(xx,yy) (block + 3*(((yy)-y0)*w + (xx)-x0))
+  #define BLOCKED(xx,yy) (blocked[((yy)-y0)*w + (xx)-x0])
+
+  for(y = y0; y <= y1; y++) {
+    _blocked_row(nl, y, x0, x1, &BLOCKED(x0,y));
+    for(x = x0; x <= x1; x++) {
+      if(y == y0 && x == x0) {
+        long *out = CELL(x,y);
+        out[MATCH] = out[GAP_A] = out[GAP_B] = NEG_INF;
+        out[s0] = 0;
+        continue;
+      }
+      _forward_cell(nl, x, y, BLOCKED(x,y),
+                    x > x0 && y > y0 ? CELL(x-1,y-1) : NULL,
+                    y > y0 ? CELL(x,y-1) : NULL,
+                    x > x0 ? CELL(x-1,y) : NULL, CELL(x,y));
+    }
+  }
+
+  // End in the same matrix as needleman_wunsch_align2() would
+  int s = s1;
+  if(s == ANY_MATRIX) {
+    long *end = CELL(x1,y1);
+    s = MATCH;
+    if(end[GAP_B] >= end[s]) s = GAP_B;
+    if(end[GAP_A] >= end[s]) s = GAP_A;
+  }
+
+  // Trace back, writing moves backwards into the end of the result buffer
+  alignment_t *result = nl->result;
+  size_t start = result->length, end = result->capacity-1, len = 0;
+  long open, extend, score, prev;
+  int p;
+  x = x1; y = y1;
+
+  while(x > x0 || y > y0)
+  {
+    long *pcell;
+    score = CELL(x,y)[s];
+    _move_costs(nl, x, y, s, BLOCKED(x,y), &open, &extend);
+
+    if(s == MATCH) pcell = CELL(x-1,y-1);
+    else if(s == GAP_A) pcell = CELL(x,y-1);
+    else pcell = CELL(x-1,y);
+
+    // Same preference as alignment_reverse_move()
+    int order[3] = {GAP_A, GAP_B, MATCH};
+    for(p = 0; p < 3; p++) {
+      prev = _add(pcell[order[p]], order[p] == s ? extend : open);
+      if(prev == score) break;
+    }
+
+    if(p == 3) {
+      fprintf(stderr, "%s:%i: Program error: traceback failed\n",
+              __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+
+    result->result_a[end-len] = s == GAP_A ? '-' : nl->seq_a[x-1];
+    result->result_b[end-len] = s == GAP_B ? '-' : nl->seq_b[y-1];
+    len++;
+
+    if(s != GAP_A) x--;
+    if(s != GAP_B) y--;
+    s = order[p];
+  }
+
+  #undef CELL
+  #undef BLOCKED
+
+  memmove(result->result_a + start, result->result_a + end-len+1, len);
+  memmove(result->result_b + start, result->result_b + end-len+1, len);
+  result->length += len;
+}
+
+// Align the block from (x0,y0) in matrix s0 to (x1,y1) in matrix s1
+static void _solve(nw_linear_t *nl, size_t x0, size_t y0, int s0,
+                   size_t x1, size_t y1, int s1)
+{
+  size_t x, w = x1-x0+1, h = y1-y0+1;
+
+  if(h <= 2 || w*h <= NW_LINEAR_BLOCK_CELLS) {
+    _solve_block(nl, x0, y0, s0, x1, y1, s1);
+    return;
+  }
+
+  size_t mid = (y0+y1)/2;
+  const long *fwd = _forward(nl, x0, y0, s0, x1, mid);
+  const long *bck = _backward(nl, x0, mid, x1, y1, s1);
+
+  // Best place to cross the middle row
+  long score, best = NEG_INF;
+  size_t best_x = x0;
+  int s, best_s = MATCH;
+
+  for(x = x0; x <= x1; x++) {
+    for(s = MATCH; s <= GAP_B; s++) {
+      score = _add(fwd[3*(x-x0)+s], bck[3*(x-x0)+s]);
+      if(score > best) { best = score; best_x = x; best_s = s; }
+    }
+  }
+
+  _solve(nl, x0, y0, s0, best_x, mid, best_s);
+  _solve(nl, best_x, mid, best_s, x1, y1, s1);
+}
+
+void needleman_wunsch_align_linear(const char *a, const char *b,
+                                   size_t len_a, size_t len_b,
+                                   const scoring_t *scoring,
+                                   alignment_t *result)
+{
+  nw_linear_t nl = {.seq_a = a, .seq_b = b, .len_a = len_a, .len_b = len_b,
+                    .scoring = scoring, .result = result,
+                    .block = NULL, .block_capacity = 0,
+                    .block_blocked = NULL, .block_blocked_capacity = 0,
+                    .local = false, .blocked = NULL, .blocked_arg = NULL};
+
+  scoring_check_fits(scoring, len_a, len_b);
+
+  nl.fwd = malloc(12 * (len_a+1) * sizeof(long));
+  nl.rows_blocked = malloc(2 * (len_a+1));
+  if(nl.fwd == NULL || nl.rows_blocked == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+  nl.bck = nl.fwd + 6*(len_a+1);
+
+  // Score of the whole alignment, ending in whichever matrix traceback would
+  const long *end = _forward(&nl, 0, 0, MATCH, len_a, len_b) + 3*len_a;
+  long score = end[MATCH];
+  if(end[GAP_B] >= score) score = end[GAP_B];
+  if(end[GAP_A] >= score) score = end[GAP_A];
+
+  if(score <= NEG_INF) {
+    // No valid alignment (--nomismatches with --nogaps..): the full matrices
+    // clamp scores at a minimum instead, so leave it to them
+    free(nl.fwd);
+    free(nl.rows_blocked);
+    nw_aligner_t *nw = needleman_wunsch_new();
+    needleman_wunsch_align2(a, b, len_a, len_b, scoring, nw, result);
+    needleman_wunsch_free(nw);
+    return;
+  }
+
+  alignment_ensure_capacity(result, len_a + len_b);
+  result->length = 0;
+  result->score = (score_t)score;
+
+  _solve(&nl, 0, 0, MATCH, len_a, len_b, ANY_MATRIX);
+
+  result->result_a[result->length] = '\0';
+  result->result_b[result->length] = '\0';
+
+  // Divide and conquer solves the path out of order, so the CIGAR is made
+  // from the strings here rather than during traceback
+  if(result->cigar_only) {
+    alignment_cigar_from_strings(&result->cigar, result->result_a,
+                                 result->result_b, scoring->case_sensitive);
+    result->result_a[0] = result->result_b[0] = '\0';
+  }
+
+  free(nl.fwd);
+  free(nl.block);
+  free(nl.rows_blocked);
+  free(nl.block_blocked);
+}
+
+void alignment_linear_path(const char *a, const char *b,
+                           size_t len_a, size_t len_b,
+                           const scoring_t *scoring,
+                           align_blocked_f blocked, void *blocked_arg,
+                           size_t x0, size_t y0, size_t x1, size_t y1,
+                           alignment_t *result)
+{
+  nw_linear_t nl = {.seq_a = a, .seq_b = b, .len_a = len_a, .len_b = len_b,
+                    .scoring = scoring, .result = result,
+                    .block = NULL, .block_capacity = 0,
+                    .block_blocked = NULL, .block_blocked_capacity = 0,
+                    .local = true, .blocked = blocked,
+                    .blocked_arg = blocked_arg};
+
+  nl.fwd = malloc(12 * (x1-x0+1) * sizeof(long));
+  nl.rows_blocked = malloc(2 * (x1-x0+1));
+  if(nl.fwd == NULL || nl.rows_blocked == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+  nl.bck = nl.fwd + 6*(x1-x0+1);
+
+  alignment_ensure_capacity(result, (x1-x0) + (y1-y0));
+  result->length = 0;
+
+  _solve(&nl, x0, y0, MATCH, x1, y1, MATCH);
+
+  result->result_a[result->length] = '\0';
+  result->result_b[result->length] = '\0';
+
+  free(nl.fwd);
+  free(nl.block);
+  free(nl.rows_blocked);
+  free(nl.block_blocked);
+}
@@ -0,0 +1,304 @@
+/*
+ seed_extend.c
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+// X-drop extension after:
+//   Zhang Z. et al. "A greedy algorithm for aligning DNA sequences"
+//   J Comput Biol 7(1-2) 2000
+// with the Z-drop test from minimap2 (Li H. Bioinformatics 34(18) 2018).
+//
+// Rows run along seq_b, columns along seq_a, with the same three matrices as
+// alignment_fill_matrices().  Each row only holds the run of columns that are
+// still live: the next row starts at the first live column of this one and
+// stops once it is past the last live column and its cells have dropped off.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "seed_extend.h"
+#include "alignment_macros.h"
+
+// Dropped off or unreachable.  Adding a penalty cannot overflow.
+#define NEG_INF (SCORE_MIN/2)
+
+typedef struct
+{
+  size_t start, lo, hi; // columns lo..hi are at scores[3*start] onwards
+} ext_row_t;
+
+struct seed_extend_t
+{
+  score_t *scores; // MATCH, GAP_A, GAP_B for each cell
+  size_t num_cells, capacity;
+  ext_row_t *rows;
+  size_t rows_capacity;
+};
+
+seed_extend_t* seed_extend_new()
+{
+  seed_extend_t *ext = calloc(1, sizeof(seed_extend_t));
+  return ext;
+}
+
+void seed_extend_free(seed_extend_t *ext)
+{
+  free(ext->scores);
+  free(ext->rows);
+  free(ext);
+}
+
+static inline score_t* _new_cell(seed_extend_t *ext)
+{
+  if(ext->num_cells == ext->capacity) {
+    ext->capacity = ext->capacity ? ext->capacity*2 : 1024;
+    ext->scores = realloc(ext->scores, 3 * ext->capacity * sizeof(score_t));
+    if(ext->scores == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+  return ext->scores + 3 * ext->num_cells++;
+}
+
+static inline ext_row_t* _new_row(seed_extend_t *ext, size_t y)
+{
+  if(y == ext->rows_capacity) {
+    ext->rows_capacity = ext->rows_capacity ? ext->rows_capacity*2 : 256;
+    ext->rows = realloc(ext->rows, ext->rows_capacity * sizeof(ext_row_t));
+    if(ext->rows == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+  return ext->rows + y;
+}
+
+// Scores of cell (x) in row, or NULL if it was not kept
+static inline const score_t* _get_cell(const seed_extend_t *ext,
+                                       const ext_row_t *row, size_t x)
+{
+  if(x < row->lo || x > row->hi) return NULL;
+  return ext->scores + 3 * (row->start + x - row->lo);
+}
+
+static inline score_t _max_score(const score_t *cell)
+{
+  return MAX3(cell[MATCH], cell[GAP_A], cell[GAP_B]);
+}
+
+// Fill cell (x,y) from its neighbours (any may be NULL)
+static inline void _fill_cell(const char *seq_a, const char *seq_b,
+                              size_t x, size_t y, const scoring_t *scoring,
+                              const score_t *diag, const score_t *up,
+                              const score_t *left, score_t *cell)
+{
+  const score_t gap_open = scoring->gap_open + scoring->gap_extend;
+  const score_t gap_extend = scoring->gap_extend;
+
+  cell[MATCH] = cell[GAP_A] = cell[GAP_B] = NEG_INF;
+
+  if(diag != NULL)
+  {
+    bool is_match;
+    int substitution_penalty;
+    scoring_lookup(scoring, seq_a[x-1], seq_b[y-1],
+                   &substitution_penalty, &is_match);
+    if(!scoring->no_mismatches || is_match)
+      cell[MATCH] = _max_score(diag) + substitution_penalty;
+  }
+
+  // gap_a from [x][y-1]
+  if(up != NULL && !scoring->no_gaps_in_a)
+  {
+    cell[GAP_A] = MAX3(up[MATCH] + gap_open, up[GAP_A] + gap_extend,
+                       up[GAP_B] + gap_open);
+  }
+
+  // gap_b from [x-1][y]
+  if(left != NULL && !scoring->no_gaps_in_b)
+  {
+    cell[GAP_B] = MAX3(left[MATCH] + gap_open, left[GAP_A] + gap_open,
+                       left[GAP_B] + gap_extend);
+  }
+
+  cell[MATCH] = MAX2(cell[MATCH], NEG_INF);
+  cell[GAP_A] = MAX2(cell[GAP_A], NEG_INF);
+  cell[GAP_B] = MAX2(cell[GAP_B], NEG_INF);
+}
+
+// Write the alignment ending at (x,y) in matrix into result
+static void _traceback(const seed_extend_t *ext,
+                       const char *seq_a, const char *seq_b,
+                       size_t x, size_t y, enum Matrix matrix,
+                       const scoring_t *scoring, alignment_t *result)
+{
+  const score_t gap_open = scoring->gap_open + scoring->gap_extend;
+  const score_t gap_extend = scoring->gap_extend;
+  const enum Matrix order[3] = {GAP_A, GAP_B, MATCH};
+
+  size_t longest_alignment = x + y, next_char = longest_alignment;
+  alignment_ensure_capacity(result, longest_alignment);
+
+  result->len_a = x;
+  result->len_b = y;
+  result->pos_a = result->pos_b = 0;
+
+  score_t score = _get_cell(ext, &ext->rows[y], x)[matrix], cost = 0;
+  const score_t *prev;
+  int p;
+
+  while(x > 0 || y > 0)
+  {
+    next_char--;
+
+    if(matrix == MATCH) {
+      bool is_match;
+      int substitution_penalty;
+      scoring_lookup(scoring, seq_a[x-1], seq_b[y-1],
+                     &substitution_penalty, &is_match);
+      result->result_a[next_char] = seq_a[x-1];
+      result->result_b[next_char] = seq_b[y-1];
+      prev = _get_cell(ext, &ext->rows[y-1], x-1);
+      x--; y--;
+      cost = substitution_penalty;
+    }
+    else if(matrix == GAP_A) {
+      result->result_a[next_char] = '-';
+      result->result_b[next_char] = seq_b[y-1];
+      prev = _get_cell(ext, &ext->rows[y-1], x);
+      y--;
+    }
+    else {
+      result->result_a[next_char] = seq_a[x-1];
+      result->result_b[next_char] = '-';
+      prev = _get_cell(ext, &ext->rows[y], x-1);
+      x--;
+    }
+
+    // Same preference as alignment_reverse_move()
+    for(p = 0; p < 3; p++) {
+      if(matrix != MATCH) cost = order[p] == matrix ? gap_extend : gap_open;
+      if(prev != NULL && prev[order[p]] > NEG_INF &&
+         prev[order[p]] + cost == score) break;
+    }
+
+    if(p == 3) {
+      fprintf(stderr, "%s:%i: Program error: traceback failed\n",
+              __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+
+    matrix = order[p];
+    score = prev[matrix];
+  }
+
+  size_t length = longest_alignment - next_char;
+  memmove(result->result_a, result->result_a + next_char, length);
+  memmove(result->result_b, result->result_b + next_char, length);
+  result->result_a[length] = result->result_b[length] = '\0';
+  result->length = length;
+
+  if(result->cigar_only) {
+    alignment_cigar_from_strings(&result->cigar, result->result_a,
+                                 result->result_b, scoring->case_sensitive);
+    result->result_a[0] = result->result_b[0] = '\0';
+  }
+}
+
+score_t seed_extend_align(const char *seq_a, const char *seq_b,
+                          size_t len_a, size_t len_b,
+                          const scoring_t *scoring,
+                          score_t xdrop, score_t zdrop,
+                          seed_extend_t *ext, alignment_t *result)
+{
+  const score_t gap_extend = abs(scoring->gap_extend);
+
+  score_t best = 0, row_best, max;
+  size_t best_x = 0, best_y = 0, row_best_x, x, y, x_start, live_lo, live_hi;
+  const ext_row_t *prev = NULL;
+  ext_row_t *row;
+  score_t *cell;
+  bool live, any_live;
+
+  scoring_check_fits(scoring, len_a, len_b);
+
+  ext->num_cells = 0;
+
+  for(y = 0; y <= len_b; y++)
+  {
+    row = _new_row(ext, y);
+    prev = y > 0 ? row-1 : NULL;
+    row->start = ext->num_cells;
+    x_start = (y == 0 ? 0 : prev->lo);
+
+    row_best = NEG_INF;
+    row_best_x = x_start;
+    live_lo = live_hi = x_start;
+    any_live = false;
+
+    for(x = x_start; x <= len_a; x++)
+    {
+      cell = _new_cell(ext);
+
+      if(y == 0 && x == 0) {
+        cell[MATCH] = 0;
+        cell[GAP_A] = cell[GAP_B] = NEG_INF;
+      }
+      else {
+        _fill_cell(seq_a, seq_b, x, y, scoring,
+                   y > 0 && x > 0 ? _get_cell(ext, prev, x-1) : NULL,
+                   y > 0 ? _get_cell(ext, prev, x) : NULL,
+                   x > x_start ? cell-3 : NULL, cell);
+      }
+
+      max = _max_score(cell);
+      live = (max > NEG_INF && (long)max >= (long)best - xdrop);
+
+      if(live) {
+        if(!any_live) live_lo = x;
+        live_hi = x;
+        any_live = true;
+        if(max > row_best) { row_best = max; row_best_x = x; }
+        if(max > best) { best = max; best_x = x; best_y = y; }
+      }
+      else {
+        cell[MATCH] = cell[GAP_A] = cell[GAP_B] = NEG_INF;
+        // Past the previous row nothing can revive the cells to the right
+        if(y == 0 || x > prev->hi) break;
+      }
+    }
+
+    if(!any_live) break;
+
+    // Keep only the live run of the row
+    row->start += live_lo - x_start;
+    row->lo = live_lo;
+    row->hi = live_hi;
+    ext->num_cells = row->start + live_hi - live_lo + 1;
+
+    // Z-drop: the best of this row has fallen too far below the best overall,
+    // allowing for a gap between them
+    if(zdrop > 0 && best_y < y)
+    {
+      long diag_diff = ((long)row_best_x - (long)y) -
+                       ((long)best_x - (long)best_y);
+      if((long)best - row_best > zdrop + gap_extend * labs(diag_diff)) break;
+    }
+  }
+
+  // End in the same matrix as needleman_wunsch_align2() would
+  const score_t *end = _get_cell(ext, &ext->rows[best_y], best_x);
+  enum Matrix matrix = MATCH;
+  if(end[GAP_B] >= end[matrix]) matrix = GAP_B;
+  if(end[GAP_A] >= end[matrix]) matrix = GAP_A;
+
+  _traceback(ext, seq_a, seq_b, best_x, best_y, matrix, scoring, result);
+  result->score = best;
+
+  return best;
+}
@@ -0,0 +1,52 @@
+/*
+ seed_extend.h
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+#ifndef SEED_EXTEND_HEADER_SEEN
+#define SEED_EXTEND_HEADER_SEEN
+
+#include "seq_align.h"
+#include "alignment.h"
+
+typedef struct seed_extend_t seed_extend_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+seed_extend_t* seed_extend_new();
+void seed_extend_free(seed_extend_t *ext);
+
+/*
+ Extend an alignment rightwards from an anchor at the start of both seq_a and
+ seq_b (to extend leftwards, pass the sequences reversed).  The alignment is
+ anchored at its start and free at its end: result is the best scoring
+ alignment of a prefix of seq_a against a prefix of seq_b, and result->len_a,
+ result->len_b are where the extension ends.
+
+ Only cells scoring within xdrop of the best score seen so far are filled;
+ extension stops when a whole row has dropped off.  If zdrop > 0, extension
+ also stops when the best cell of a row falls more than
+   zdrop + |gap_extend| * (difference in diagonal)
+ below the best so far (Z-drop, as in minimap2), so a long gap does not
+ count against an alignment that picks up again.
+
+ Substitutions, wildcards and --nomismatches come from scoring; no_gaps_in_a
+ and no_gaps_in_b forbid gaps anywhere.  Free start/end gaps do not apply.
+ returns result->score
+*/
+score_t seed_extend_align(const char *seq_a, const char *seq_b,
+                          size_t len_a, size_t len_b,
+                          const scoring_t *scoring,
+                          score_t xdrop, score_t zdrop,
+                          seed_extend_t *ext, alignment_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEED_EXTEND_HEADER_SEEN */
@@ -12,11 +12,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-
-#include "sort_r/sort_r.h"
+#include <limits.h>
 
 #include "smith_waterman.h"
 #include "alignment_macros.h"
+#include "alignment_striped.h"
+#include "smith_waterman_linear.h"
 
 typedef struct {
   uint32_t *b; size_t l, s; // l is bits, s in uint32_t
@@ -45,67 +46,222 @@ static inline BitSet* bitset_set_length(BitSet *bs, size_t l) {
   return bs->b ? bs : NULL;
 }
 
-// For iterating through local alignments
+// A cell a local alignment can end on
+typedef struct
+{
+  score_t score;
+  size_t x, index;
+} sw_cell_t;
+
+// Cells are counted in this many bins of scores
+#define SW_SCORE_BINS 4096
+#define SW_FIRST_BATCH 256
+
+// For iterating through local alignments.  Rather than sorting every cell
+// with a positive score up front, cells are handed out a band of scores at a
+// time: a histogram of scores picks the band holding the next batch_size
+// cells, and only the cells in that band (not already on a hit) are collected
+// and sorted.  The batch grows fourfold on each refill, so memory and sorting
+// scale with the number of hits fetched rather than the size of the matrix.
 typedef struct
 {
   BitSet match_scores_mask;
-  size_t *sorted_match_indices, hits_capacity, num_of_hits, next_hit;
+  sw_cell_t *hits, *sorted; // sorted is scratch space for sorting hits
+  size_t hits_capacity, num_of_hits, next_hit, batch_size;
+  size_t *key_counts, key_counts_capacity;
+  // Cells in each bin of bin_width scores, from the first refill
+  size_t bin_counts[SW_SCORE_BINS];
+  score_t bin_width;
+  // Bins below next_bin are still to be handed out
+  size_t next_bin;
+  bool counted;
 } sw_history_t;
 
+// Pair loaded by smith_waterman_align_best(), aligned on the next fetch
+typedef struct
+{
+  const char *seq_a, *seq_b;
+  size_t len_a, len_b;
+  const scoring_t *scoring;
+  bool loaded;
+  long *rows; // two rows of the reverse pass, three scores per cell
+  size_t rows_capacity;
+} sw_best_t;
+
 // Store alignment here
 struct sw_aligner_t
 {
   aligner_t aligner;
   sw_history_t history;
+  striped_t striped;
+  sw_linear_t linear; // hits from smith_waterman_align_linear()
+  sw_best_t best;
 };
 
-// Sort indices by their matrix values
-// Struct used to pass data to sort_match_indices
-typedef struct
+static void _init_history(sw_history_t *hist)
+{
+  bitset_alloc(&hist->match_scores_mask, 256);
+  hist->hits_capacity = SW_FIRST_BATCH;
+  hist->hits = malloc(hist->hits_capacity * sizeof(*(hist->hits)));
+  hist->sorted = malloc(hist->hits_capacity * sizeof(*(hist->sorted)));
+}
+
+static inline size_t _cell_key(const sw_cell_t *cell, bool by_score, score_t hi)
 {
-  score_t *match_scores;
-  unsigned int score_width;
-} MatrixSort;
+  return by_score ? (size_t)(hi - 1 - cell->score) : cell->x;
+}
 
-// Function passed to sort_r
-int sort_match_indices(const void *aa, const void *bb, void *arg)
+// Stable counting sort of the hits on x, or on score (highest first) for
+// scores below hi.  nkeys is one more than the largest key.
+static void _sort_hits(sw_history_t *hist, size_t nkeys, bool by_score,
+                       score_t hi)
 {
-  const size_t *a = aa;
-  const size_t *b = bb;
-  const MatrixSort *tmp = arg;
+  size_t i, total, tmp, n = hist->num_of_hits;
+  sw_cell_t *swap;
+
+  if(nkeys > hist->key_counts_capacity) {
+    hist->key_counts_capacity = ROUNDUP2POW(nkeys);
+    hist->key_counts = realloc(hist->key_counts,
+                               hist->key_counts_capacity * sizeof(size_t));
+    if(!hist->key_counts) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  memset(hist->key_counts, 0, nkeys * sizeof(size_t));
+  for(i = 0; i < n; i++)
+    hist->key_counts[_cell_key(&hist->hits[i], by_score, hi)]++;
 
-  // Recover variables from the struct
-  const score_t *match_scores = tmp->match_scores;
-  size_t score_width = tmp->score_width;
+  for(i = total = 0; i < nkeys; i++) {
+    tmp = hist->key_counts[i];
+    hist->key_counts[i] = total;
+    total += tmp;
+  }
 
-  long diff = (long)match_scores[*b] - match_scores[*a];
+  for(i = 0; i < n; i++)
+    hist->sorted[hist->key_counts[_cell_key(&hist->hits[i], by_score, hi)]++] =
+      hist->hits[i];
 
-  // Sort by position (from left to right) on seq_a
-  if(diff == 0) return (*a % score_width) - (*b % score_width);
-  else return diff > 0 ? 1 : -1;
+  swap = hist->hits;
+  hist->hits = hist->sorted;
+  hist->sorted = swap;
 }
 
-static void _init_history(sw_history_t *hist)
+// Forget hits from a previous alignment
+static void _reset_history(sw_aligner_t *sw)
 {
-  bitset_alloc(&hist->match_scores_mask, 256);
-  hist->hits_capacity = 256;
-  size_t mem = hist->hits_capacity * sizeof(*(hist->sorted_match_indices));
-  hist->sorted_match_indices = malloc(mem);
+  sw_history_t *hist = &sw->history;
+  size_t arr_size = aligner_num_cells(&sw->aligner);
+
+  if(arr_size > hist->match_scores_mask.l)
+    bitset_set_length(&hist->match_scores_mask, ROUNDUP2POW(arr_size));
+
+  if(!hist->match_scores_mask.b) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  memset(hist->match_scores_mask.b, 0,
+         sizeof(uint32_t) * ((hist->match_scores_mask.l+31)/32));
+  hist->num_of_hits = hist->next_hit = 0;
+  hist->batch_size = SW_FIRST_BATCH;
+  hist->counted = false;
+  sw->linear.loaded = false;
+  sw->best.loaded = false;
 }
 
-static void _ensure_history_capacity(sw_history_t *hist, size_t arr_size)
+// Histogram of positive scores
+static void _count_scores(sw_aligner_t *sw)
 {
-  if(arr_size > hist->hits_capacity) {
-    hist->hits_capacity = ROUNDUP2POW(arr_size);
-    bitset_set_length(&hist->match_scores_mask, hist->hits_capacity);
+  const aligner_t *aligner = &sw->aligner;
+  sw_history_t *hist = &sw->history;
+  const score_t *scores = aligner->match_scores;
+  size_t pos, arr_size = aligner_num_cells(aligner);
+  score_t max = 0;
 
-    size_t mem = hist->hits_capacity * sizeof(*(hist->sorted_match_indices));
-    hist->sorted_match_indices = realloc(hist->sorted_match_indices, mem);
-    if(!hist->match_scores_mask.b || !hist->sorted_match_indices) {
-      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
-      exit(EXIT_FAILURE);
+  for(pos = 0; pos < arr_size; pos++)
+    max = MAX2(max, scores[pos]);
+
+  hist->bin_width = max / SW_SCORE_BINS + 1;
+  memset(hist->bin_counts, 0, sizeof(hist->bin_counts));
+
+  for(pos = 0; pos < arr_size; pos++)
+    if(scores[pos] > 0) hist->bin_counts[scores[pos] / hist->bin_width]++;
+
+  hist->next_bin = max / hist->bin_width + 1;
+  hist->counted = true;
+}
+
+// Collect and sort the cells in the next band of scores.  Returns false if
+// none remain.
+static bool _refill_hits(sw_aligner_t *sw)
+{
+  const aligner_t *aligner = &sw->aligner;
+  sw_history_t *hist = &sw->history;
+
+  if(!hist->counted) _count_scores(sw);
+
+  const score_t *scores = aligner->match_scores;
+  const uint32_t *mask = hist->match_scores_mask.b;
+  size_t stored_width = aligner->row_step + aligner->banded;
+  size_t i, y, index, n, lo_bin;
+  score_t lo, hi;
+
+  hist->num_of_hits = hist->next_hit = 0;
+
+  // Cells on earlier hits are skipped, so a band may turn out empty
+  while(hist->num_of_hits == 0 && hist->next_bin > 0)
+  {
+    // Lowest bin that makes up a batch
+    for(n = 0, lo_bin = hist->next_bin; lo_bin > 0 && n < hist->batch_size; )
+      n += hist->bin_counts[--lo_bin];
+
+    if(n > hist->hits_capacity) {
+      hist->hits_capacity = ROUNDUP2POW(n);
+      hist->hits = realloc(hist->hits, hist->hits_capacity * sizeof(sw_cell_t));
+      hist->sorted = realloc(hist->sorted,
+                             hist->hits_capacity * sizeof(sw_cell_t));
+      if(!hist->hits || !hist->sorted) {
+        fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    lo = MAX2((score_t)(lo_bin * hist->bin_width), 1);
+    hi = (score_t)(hist->next_bin * hist->bin_width);
+
+    for(y = index = 0; y < aligner->score_height; y++)
+    {
+      // x of the first cell stored in this row (see aligner_coords())
+      size_t row_x = (aligner->banded ? y : 0) - aligner->col_offset;
+
+      for(i = 0; i < stored_width; i++, index++)
+      {
+        if(scores[index] >= lo && scores[index] < hi &&
+           !bitset32_get(mask, index))
+        {
+          sw_cell_t *cell = &hist->hits[hist->num_of_hits++];
+          cell->score = scores[index];
+          cell->x = row_x + i;
+          cell->index = index;
+        }
+      }
     }
+
+    hist->next_bin = lo_bin;
+    hist->batch_size *= 4;
+  }
+
+  // Cells were collected in matrix order: sorting on x then score puts them
+  // in fetch order (highest score, then leftmost on seq_a, then first in the
+  // matrix)
+  if(hist->num_of_hits > 1) {
+    _sort_hits(hist, aligner->score_width, false, hi);
+    _sort_hits(hist, (size_t)(hi - lo), true, hi);
   }
+
+  return hist->num_of_hits > 0;
 }
 
 sw_aligner_t* smith_waterman_new()
@@ -118,8 +274,13 @@ sw_aligner_t* smith_waterman_new()
 void smith_waterman_free(sw_aligner_t *sw)
 {
   aligner_destroy(&(sw->aligner));
+  striped_destroy(&(sw->striped));
+  sw_linear_destroy(&(sw->linear));
+  free(sw->best.rows);
   bitset_dealloc(&sw->history.match_scores_mask);
-  free(sw->history.sorted_match_indices);
+  free(sw->history.hits);
+  free(sw->history.sorted);
+  free(sw->history.key_counts);
   free(sw);
 }
 
@@ -137,122 +298,311 @@ void smith_waterman_align(const char *a, const char *b,
 void smith_waterman_align2(const char *a, const char *b,
                            size_t len_a, size_t len_b,
                            const scoring_t *scoring, sw_aligner_t *sw)
+{
+  aligner_align(&sw->aligner, a, b, len_a, len_b, scoring, 1);
+  _reset_history(sw);
+}
+
+// Index of the cell the best hit ends on: highest score, then leftmost on
+// seq_a as in the sorted order from smith_waterman_align2()
+static size_t _best_cell(const aligner_t *aligner)
+{
+  size_t arr_size = aligner_num_cells(aligner);
+  size_t pos, x, y, best_pos = 0, best_x = 0;
+
+  for(pos = 0; pos < arr_size; pos++) {
+    aligner_coords(aligner, pos, &x, &y);
+    if(aligner->match_scores[pos] > aligner->match_scores[best_pos] ||
+       (aligner->match_scores[pos] == aligner->match_scores[best_pos] &&
+        x < best_x)) {
+      best_pos = pos;
+      best_x = x;
+    }
+  }
+
+  return best_pos;
+}
+
+void smith_waterman_align_banded(const char *a, const char *b,
+                                 size_t len_a, size_t len_b,
+                                 const scoring_t *scoring,
+                                 size_t band, bool widen, sw_aligner_t *sw)
 {
   aligner_t *aligner = &sw->aligner;
-  sw_history_t *hist = &sw->history;
-  aligner_align(aligner, a, b, len_a, len_b, scoring, 1);
+  size_t best_pos, x, y;
 
-  size_t arr_size = aligner->score_width * aligner->score_height;
-  _ensure_history_capacity(hist, arr_size);
+  while(1)
+  {
+    aligner_align_banded(aligner, a, b, len_a, len_b, scoring, 1, band);
 
-  // Set number of hits
-  memset(hist->match_scores_mask.b, 0, (hist->match_scores_mask.l+31)/32);
-  hist->num_of_hits = hist->next_hit = 0;
+    if(!widen) break;
 
-  size_t pos;
-  for(pos = 0; pos < arr_size; pos++) {
-    if(aligner->match_scores[pos] > 0)
-      hist->sorted_match_indices[hist->num_of_hits++] = pos;
+    best_pos = _best_cell(aligner);
+    aligner_coords(aligner, best_pos, &x, &y);
+
+    if(aligner->match_scores[best_pos] <= 0 ||
+       !aligner_band_touched(aligner, MATCH, x, y, 1))
+      break;
+
+    band = band > 0 ? band*2 : 1;
   }
 
-  // Now sort matched hits
-  MatrixSort tmp_struct = {aligner->match_scores, aligner->score_width};
-  sort_r(hist->sorted_match_indices, hist->num_of_hits,
-         sizeof(size_t), sort_match_indices, &tmp_struct);
+  _reset_history(sw);
 }
 
 // Return 1 if alignment was found, 0 otherwise
 static char _follow_hit(sw_aligner_t* sw, size_t arr_index,
                         alignment_t* result)
 {
-  const aligner_t *aligner = &(sw->aligner);
+  aligner_t *aligner = &(sw->aligner);
   const sw_history_t *hist = &(sw->history);
 
   // Follow path through matrix
-  size_t score_x = (size_t)ARR_2D_X(arr_index, aligner->score_width);
-  size_t score_y = (size_t)ARR_2D_Y(arr_index, aligner->score_width);
+  size_t score_x, score_y;
+  aligner_coords(aligner, arr_index, &score_x, &score_y);
 
   // Local alignments always (start and) end with a match
   enum Matrix curr_matrix = MATCH;
-  score_t curr_score = aligner->match_scores[arr_index];
+  const score_t *scores[3] = {aligner->match_scores, aligner->gap_a_scores,
+                              aligner->gap_b_scores};
 
-  // Store end arr_index and (x,y) coords for later
-  size_t end_arr_index = arr_index;
+  // Store end (x,y) coords and score for later
   size_t end_score_x = score_x;
   size_t end_score_y = score_y;
-  score_t end_score = curr_score;
+  score_t end_score = aligner->match_scores[arr_index];
 
-  size_t length;
+  // Record the path while marking it used, then write it out forwards.  Steps
+  // follow the traceback bits recorded by the fill, until the score drops to
+  // 0.
+  uint8_t *moves = aligner_moves(aligner, score_x + score_y);
+  size_t num_moves = 0;
 
-  for(length = 0; ; length++)
+  while(1)
   {
     if(bitset32_get(hist->match_scores_mask.b, arr_index)) return 0;
     bitset32_set(hist->match_scores_mask.b, arr_index);
 
-    if(curr_score == 0) break;
+    if(scores[curr_matrix][arr_index] == 0) break;
 
-    //printf(" %i (%i, %i)\n", length, score_x, score_y);
+    moves[num_moves++] = curr_matrix;
 
     // Find out where to go next
-    alignment_reverse_move(&curr_matrix, &curr_score,
-                           &score_x, &score_y, &arr_index, aligner);
+    alignment_traceback_move(&curr_matrix, &score_x, &score_y, aligner);
+    arr_index = aligner_index(aligner, score_x, score_y);
   }
 
   // We got a result!
-  // Allocate memory for the result
-  result->length = length;
+  alignment_from_moves(result, moves, num_moves,
+                       aligner->seq_a + score_x, aligner->seq_b + score_y,
+                       aligner->scoring->case_sensitive);
 
-  alignment_ensure_capacity(result, length);
+  result->score = end_score;
 
-  // Jump back to the end of the alignment
-  arr_index = end_arr_index;
-  score_x = end_score_x;
-  score_y = end_score_y;
-  curr_matrix = MATCH;
-  curr_score = end_score;
+  result->pos_a = score_x;
+  result->pos_b = score_y;
 
-  // Now follow backwards again to create alignment!
-  unsigned int i;
+  result->len_a = end_score_x - score_x;
+  result->len_b = end_score_y - score_y;
+
+  return 1;
+}
+
+void smith_waterman_align_linear(const char *a, const char *b,
+                                 size_t len_a, size_t len_b,
+                                 const scoring_t *scoring, sw_aligner_t *sw)
+{
+  sw_linear_load(&sw->linear, a, b, len_a, len_b, scoring);
+  sw->best.loaded = false;
+}
+
+void smith_waterman_align_best(const char *a, const char *b,
+                               size_t len_a, size_t len_b,
+                               const scoring_t *scoring, sw_aligner_t *sw)
+{
+  sw_best_t *best = &sw->best;
+  best->seq_a = a;
+  best->seq_b = b;
+  best->len_a = len_a;
+  best->len_b = len_b;
+  best->scoring = scoring;
+  best->loaded = true;
+  sw->linear.loaded = false;
+}
 
-  for(i = length-1; curr_score > 0; i--)
+// Unreachable in the reverse pass
+#define SW_NEG_INF (LONG_MIN/4)
+
+// Where the hit ending on cell (ex,ey) with score can start.  Walking back
+// from the end, each cell gets the best score of a path from it (in each
+// matrix) to the end in MATCH.  The traceback stops on a cell whose diagonal
+// step into the hit scores the whole hit, so the leftmost and topmost of those
+// cells bound it.  A path through cell (x,y) scoring below 0 from there would
+// need a part before it beating the best hit, and one below score - max *
+// MIN(x,y) (max being the best substitution score) more than the part before
+// it can score.  Such cells are dropped, and the pass stops once a row has
+// none left: it only covers the region of the hit.
+static void _best_hit_start(sw_aligner_t *sw, size_t ex, size_t ey,
+                            score_t score, size_t *sx, size_t *sy)
+{
+  sw_best_t *best = &sw->best;
+  const scoring_t *scoring = best->scoring;
+  const long gap_open = scoring->gap_open + scoring->gap_extend;
+  const long gap_extend = scoring->gap_extend;
+  const size_t width = ex+1;
+
+  if(6*width > best->rows_capacity) {
+    best->rows_capacity = ROUNDUP2POW(6*width);
+    free(best->rows);
+    best->rows = malloc(best->rows_capacity * sizeof(long));
+    if(best->rows == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  long *below = best->rows, *curr = best->rows + 3*width, *tmp;
+  long diag, down, right, floor, max_sub = 0, *out;
+  size_t x, y, x_hi, lo = ex, hi = ex, new_lo = 0, new_hi = 0;
+  int substitution_penalty;
+  bool is_match, live;
+
+  // Best substitution score of the characters before the end
+  bool in_a[256] = {false}, in_b[256] = {false};
+  size_t c, d;
+  for(x = 0; x < ex; x++) in_a[(uint8_t)best->seq_a[x]] = true;
+  for(y = 0; y < ey; y++) in_b[(uint8_t)best->seq_b[y]] = true;
+  for(c = 0; c < 256; c++) {
+    if(!in_a[c]) continue;
+    for(d = 0; d < 256; d++) {
+      if(!in_b[d]) continue;
+      scoring_lookup(scoring, (char)c, (char)d, &substitution_penalty,
+                     &is_match);
+      max_sub = MAX2(max_sub, substitution_penalty);
+    }
+  }
+
+  below[3*ex+MATCH] = 0;
+  below[3*ex+GAP_A] = below[3*ex+GAP_B] = SW_NEG_INF;
+  *sx = ex;
+  *sy = ey;
+
+  for(y = ey; y-- > 0; )
   {
-    switch(curr_matrix)
+    x_hi = MIN2(ex-1, hi);
+    live = false;
+
+    for(x = x_hi+1; x-- > 0; )
     {
-      case MATCH:
-        result->result_a[i] = aligner->seq_a[score_x-1];
-        result->result_b[i] = aligner->seq_b[score_y-1];
+      out = curr + 3*x;
+      diag = down = right = SW_NEG_INF;
+
+      // to (x+1,y+1) in MATCH, (x,y+1) in GAP_A or (x+1,y) in GAP_B
+      if(x+1 >= lo && x+1 <= hi) {
+        scoring_lookup(scoring, best->seq_a[x], best->seq_b[y],
+                       &substitution_penalty, &is_match);
+        if(!scoring->no_mismatches || is_match)
+          diag = below[3*(x+1)+MATCH] + substitution_penalty;
+      }
+      if(x > 0 && y > 0 && x >= lo && x <= hi && !scoring->no_gaps_in_a)
+        down = below[3*x+GAP_A];
+      if(x > 0 && y > 0 && x < x_hi && !scoring->no_gaps_in_b)
+        right = curr[3*(x+1)+GAP_B];
+
+      if(diag == score) {
+        *sx = MIN2(*sx, x);
+        *sy = y;
+      }
+
+      // Cells on row or column 0 can only start a path
+      if(x == 0 || y == 0) {
+        out[MATCH] = out[GAP_A] = out[GAP_B] = SW_NEG_INF;
+      }
+      else {
+        floor = MAX2(score - max_sub * (long)MIN2(x, y), 0);
+        out[MATCH] = MAX3(diag, down + gap_open, right + gap_open);
+        out[GAP_A] = MAX3(diag, down + gap_extend, right + gap_open);
+        out[GAP_B] = MAX3(diag, down + gap_open, right + gap_extend);
+        if(out[MATCH] < floor) out[MATCH] = SW_NEG_INF;
+        if(out[GAP_A] < floor) out[GAP_A] = SW_NEG_INF;
+        if(out[GAP_B] < floor) out[GAP_B] = SW_NEG_INF;
+      }
+
+      if(out[MATCH] >= 0 || out[GAP_A] >= 0 || out[GAP_B] >= 0) {
+        if(!live) new_hi = x;
+        new_lo = x;
+        live = true;
+      }
+      else if(x+1 < lo) {
+        // Cells further left can only reach dropped cells
         break;
+      }
+    }
 
-      case GAP_A:
-        result->result_a[i] = '-';
-        result->result_b[i] = aligner->seq_b[score_y-1];
-        break;
+    if(!live) break;
 
-      case GAP_B:
-        result->result_a[i] = aligner->seq_a[score_x-1];
-        result->result_b[i] = '-';
-        break;
+    lo = new_lo;
+    hi = new_hi;
+    tmp = below; below = curr; curr = tmp;
+  }
+}
 
-      default:
-      fprintf(stderr, "Program error: invalid matrix in _follow_hit()\n");
-      fprintf(stderr, "Please submit a bug report to: turner.isaac@gmail.com\n");
-      exit(EXIT_FAILURE);
-    }
+// Three passes for the best hit of the pair from smith_waterman_align_best()
+static int _fetch_best(sw_aligner_t *sw, alignment_t *result)
+{
+  sw_best_t *best = &sw->best;
+  const char *a = best->seq_a, *b = best->seq_b;
+  const scoring_t *scoring = best->scoring;
+  size_t len_b = best->len_b, sx, sy, ex, ey;
+  sw_hit_t hit, prefix;
+
+  best->loaded = false;
+
+  // The passes rely on gaps costing something
+  if(scoring->gap_open + scoring->gap_extend > 0 || scoring->gap_extend > 0) {
+    smith_waterman_align2(a, b, best->len_a, len_b, scoring, sw);
+    return smith_waterman_fetch(sw, result);
+  }
 
-    alignment_reverse_move(&curr_matrix, &curr_score,
-                           &score_x, &score_y, &arr_index, aligner);
+  // 1. Score-only pass for the end.  smith_waterman_best_hit() breaks ties
+  // in row order, fetch takes the leftmost end.  The match scores of cells up
+  // to column x only depend on seq_a[0..x), so while a prefix of seq_a ending
+  // before the hit scores as well, take its hit instead.
+  if(!smith_waterman_best_hit(a, b, best->len_a, len_b, scoring, sw, &hit))
+    return 0;
+
+  while(hit.end_a > 0 &&
+        smith_waterman_best_hit(a, b, hit.end_a, len_b, scoring, sw, &prefix) &&
+        prefix.score == hit.score)
+  {
+    hit = prefix;
   }
 
-  result->result_a[length] = '\0';
-  result->result_b[length] = '\0';
+  // 2. Reverse pass from the end for where the hit can start
+  ex = hit.end_a+1;
+  ey = hit.end_b+1;
+  _best_hit_start(sw, ex, ey, hit.score, &sx, &sy);
 
-  result->score = end_score;
+  // 3. Fill and trace back only that rectangle.  Cells on the hit score the
+  // same as in the whole matrices (its path lies inside), and so are followed
+  // in the same way.
+  aligner_t *aligner = &sw->aligner;
+  aligner_align(aligner, a+sx, b+sy, ex-sx, ey-sy, scoring, 1);
+  _reset_history(sw);
 
-  result->pos_a = score_x;
-  result->pos_b = score_y;
+  if(!_follow_hit(sw, aligner_index(aligner, ex-sx, ey-sy), result) ||
+     result->score != hit.score)
+  {
+    fprintf(stderr, "%s:%i: Program error: best hit not found\n",
+            __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
 
-  result->len_a = end_score_x - score_x;
-  result->len_b = end_score_y - score_y;
+  result->pos_a += sx;
+  result->pos_b += sy;
+
+  // Only one hit: the rectangle's matrices do not cover the others
+  sw->history.counted = true;
+  sw->history.next_bin = 0;
 
   return 1;
 }
@@ -261,9 +611,12 @@ int smith_waterman_fetch(sw_aligner_t *sw, alignment_t *result)
 {
   sw_history_t *hist = &(sw->history);
 
-  while(hist->next_hit < hist->num_of_hits)
+  if(sw->linear.loaded) return sw_linear_fetch(&sw->linear, result);
+  if(sw->best.loaded) return _fetch_best(sw, result);
+
+  while(hist->next_hit < hist->num_of_hits || _refill_hits(sw))
   {
-    size_t arr_index = hist->sorted_match_indices[hist->next_hit++];
+    size_t arr_index = hist->hits[hist->next_hit++].index;
     // printf("hit %lu/%lu\n", hist->next_hit, hist->num_of_hits);
 
     if(!bitset32_get(hist->match_scores_mask.b, arr_index) &&
@@ -275,3 +628,85 @@ int smith_waterman_fetch(sw_aligner_t *sw, alignment_t *result)
 
   return 0;
 }
+
+int smith_waterman_best_hit(const char *a, const char *b,
+                            size_t len_a, size_t len_b,
+                            const scoring_t *scoring, sw_aligner_t *sw,
+                            sw_hit_t *hit)
+{
+  sw->linear.loaded = sw->best.loaded = false;
+
+  if(striped_sw_score(&sw->striped, a, b, len_a, len_b, scoring,
+                      &hit->score, &hit->end_a, &hit->end_b))
+  {
+    return hit->score > 0;
+  }
+
+  // Fall back to two rows of the matrices, first best cell in row order
+  size_t end_x, end_y;
+  hit->score = aligner_score(&sw->aligner, a, b, len_a, len_b, scoring, 1,
+                             &end_x, &end_y);
+  sw->history.num_of_hits = sw->history.next_hit = 0;
+  sw->history.counted = true;
+  sw->history.next_bin = 0;
+
+  hit->end_a = hit->end_b = 0;
+
+  if(hit->score > 0) {
+    hit->end_a = end_x - 1;
+    hit->end_b = end_y - 1;
+  }
+
+  return hit->score > 0;
+}
+
+score_t smith_waterman_best_score(const char *a, const char *b,
+                                  size_t len_a, size_t len_b,
+                                  const scoring_t *scoring, sw_aligner_t *sw)
+{
+  sw_hit_t hit;
+  smith_waterman_best_hit(a, b, len_a, len_b, scoring, sw, &hit);
+  return hit.score;
+}
+
+// Set up the history so the next fetch returns the best hit
+static void _history_best_hit(sw_aligner_t *sw)
+{
+  _reset_history(sw);
+  sw->history.batch_size = 1;
+}
+
+typedef struct
+{
+  sw_aligner_t *sw;
+  alignment_t **results;
+} sw_batch_t;
+
+static void _smith_waterman_batch_hit(aligner_t *aligner, size_t i, void *arg)
+{
+  sw_batch_t *sb = arg;
+  alignment_t *result = sb->results[i];
+  (void)aligner; // same as &sb->sw->aligner
+
+  _history_best_hit(sb->sw);
+
+  if(!smith_waterman_fetch(sb->sw, result)) {
+    // No positive scoring local alignment
+    result->result_a[0] = result->result_b[0] = '\0';
+    result->length = result->pos_a = result->pos_b = 0;
+    result->len_a = result->len_b = 0;
+    result->score = 0;
+  }
+}
+
+void smith_waterman_align_batch(const char *const *seqs_a,
+                                const char *const *seqs_b,
+                                const size_t *lens_a, const size_t *lens_b,
+                                size_t n, const scoring_t *scoring,
+                                sw_aligner_t *sw, aligner_batch_t *batch,
+                                alignment_t **results)
+{
+  sw_batch_t sb = {.sw = sw, .results = results};
+  aligner_batch_align(batch, seqs_a, seqs_b, lens_a, lens_b, n, scoring, 1,
+                      results, &sw->aligner, _smith_waterman_batch_hit, &sb);
+}
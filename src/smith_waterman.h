@@ -11,9 +11,17 @@
 
 #include "seq_align.h"
 #include "alignment.h"
+#include "alignment_batch.h"
 
 typedef struct sw_aligner_t sw_aligner_t;
 
+// Best local alignment found without traceback
+typedef struct
+{
+  score_t score;
+  size_t end_a, end_b; // position of last base in the hit (0-based)
+} sw_hit_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,10 +42,81 @@ void smith_waterman_align2(const char *seq_a, const char *seq_b,
                            size_t len_a, size_t len_b,
                            const scoring_t *scoring, sw_aligner_t *sw);
 
+// As smith_waterman_align2() but only filling cells within `band` diagonals
+// of those joining the start and end of the matrices (see
+// aligner_align_banded()).  With widen, the band is doubled until the best hit
+// no longer touches its edge.
+void smith_waterman_align_banded(const char *seq_a, const char *seq_b,
+                                 size_t len_a, size_t len_b,
+                                 const scoring_t *scoring,
+                                 size_t band, bool widen, sw_aligner_t *sw);
+
+/*
+ Waterman-Eggert local alignments in memory linear in the sequence lengths:
+ each smith_waterman_fetch() returns the best alignment that does not share a
+ cell with any returned before, re-scoring paths around earlier hits rather
+ than dropping them.  After the first pass over the whole matrix, only the
+ region each hit may have changed is re-scored (as in Huang & Miller's SIM),
+ which is most of the matrix for hits running across it.  The first hit is
+ the same as from smith_waterman_align2(); later ones can differ, as the full
+ matrices drop any hit whose traceback reaches a cell already used, and may
+ score more.  Do not alter seq_a, seq_b or scoring whilst fetching hits.
+*/
+void smith_waterman_align_linear(const char *seq_a, const char *seq_b,
+                                 size_t len_a, size_t len_b,
+                                 const scoring_t *scoring, sw_aligner_t *sw);
+
+/*
+ Only the best local alignment, for when one hit is wanted: the next
+ smith_waterman_fetch() finds it in three passes rather than filling the
+ whole matrices.  A score-only pass (smith_waterman_best_hit()) finds where it
+ ends, a reverse score-only pass from there finds where it starts, then only
+ the rectangle between them is filled and traced back.  The alignment is the
+ same as the first smith_waterman_fetch() after smith_waterman_align2(); later
+ fetches return nothing.  Do not alter seq_a, seq_b or scoring before the
+ fetch.
+*/
+void smith_waterman_align_best(const char *seq_a, const char *seq_b,
+                               size_t len_a, size_t len_b,
+                               const scoring_t *scoring, sw_aligner_t *sw);
+
 // An alignment to read from, and a pointer to memory to store the result
 // returns 1 if an alignment was read, 0 otherwise
 int smith_waterman_fetch(sw_aligner_t *sw, alignment_t *result);
 
+/*
+ Score-only search for the best local alignment, using a striped SIMD kernel
+ where the scoring allows it.  Much faster than smith_waterman_align2() for
+ screening: only pairs that pass need a full alignment afterwards.
+ Ties go to the hit ending first in seq_b, then first in seq_a.
+ Invalidates any hits not yet fetched from a previous smith_waterman_align().
+ returns 1 if a hit with score > 0 was found, 0 otherwise
+*/
+int smith_waterman_best_hit(const char *seq_a, const char *seq_b,
+                            size_t len_a, size_t len_b,
+                            const scoring_t *scoring, sw_aligner_t *sw,
+                            sw_hit_t *hit);
+
+// Score of the best local alignment, or 0 if there is none, from
+// smith_waterman_best_hit().  Memory is linear in the sequence lengths.
+score_t smith_waterman_best_score(const char *seq_a, const char *seq_b,
+                                  size_t len_a, size_t len_b,
+                                  const scoring_t *scoring, sw_aligner_t *sw);
+
+/*
+ Best local alignment of each of n pairs, seqs_a[i] against seqs_b[i] into
+ results[i], filling the matrices of several pairs at once (one per SIMD
+ lane).  Each result is the first hit smith_waterman_fetch() would return, or
+ an empty alignment with score 0 if there is none.
+ Invalidates any hits not yet fetched from a previous smith_waterman_align().
+*/
+void smith_waterman_align_batch(const char *const *seqs_a,
+                                const char *const *seqs_b,
+                                const size_t *lens_a, const size_t *lens_b,
+                                size_t n, const scoring_t *scoring,
+                                sw_aligner_t *sw, aligner_batch_t *batch,
+                                alignment_t **results);
+
 #ifdef __cplusplus
 }
 #endif
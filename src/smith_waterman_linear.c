@@ -0,0 +1,777 @@
+/*
+ smith_waterman_linear.c
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+// Non-intersecting local alignments in linear memory, after:
+//   Waterman M.S. & Eggert M. "A new algorithm for best subsequence
+//   alignments with application to tRNA-rRNA comparisons" JMB 197(4) 1987
+//   Huang X. & Miller W. "A time-efficient, linear-space local similarity
+//   algorithm" Adv. Appl. Math. 12(3) 1991
+//
+// Each hit is the best path that shares no cell with an earlier hit: cells on
+// hits are blocked and paths that touched them are re-scored around them.
+// Score-only passes over two rows of the matrices carry, along with each
+// score, the cell its path starts from (its origin).  As in SIM, a pass keeps
+// one candidate per origin: its best cell in MATCH, where hits end, and the
+// box holding its cells in MATCH.
+// Only the best max_nodes candidates are kept and the threshold is the best
+// score of any origin dropped, so the best candidate is the next hit if it
+// scores above the threshold.  Otherwise the whole matrix is scored again,
+// keeping four times as many.
+//
+// Blocking the cells of a hit only changes cells whose paths went through
+// them, all below and right of its first cell, and only lowers their scores.
+// A candidate keeps its best cell unless the hit passes through the box from
+// its origin to that cell, when it is dropped.  The blocks of cells under the
+// boxes of candidates the hit passes through are marked stale.  Each block keeps
+// its best score when last scored, the origin of that score and the best score
+// from any other origin, which still bound its cells.  So only stale blocks
+// that may hold a cell coming before the best candidate are re-scored, a
+// rectangle at a time.  The matrix is split into at most SW_LINEAR_LINES x
+// SW_LINEAR_LINES rectangles, each keeping its last row and column, and a
+// pass starts from those of the rectangles above and left of it if no hit has
+// been returned above and left of them since they were scored.  Memory stays
+// linear in the sequence lengths.  Hits are those of re-scoring the whole
+// matrix each time, though a hit costs about a pass over the cells below and
+// right of its start that may come next.  Where the scoring lets unrelated
+// sequence align (as the default does for DNA) hits run across the matrix, so
+// each still costs about a pass over it.  The path of each hit is recovered
+// in linear memory by alignment_linear_path().
+//
+// Scores and tie breaks follow smith_waterman_align2() and
+// smith_waterman_fetch(), so the first hit is the same.  Later hits may differ
+// from the full matrices: smith_waterman_fetch() scores the matrices once and
+// drops any hit whose traceback reaches a cell already used (on a hit or on a
+// traceback dropped before), whereas here that path is re-scored around the
+// hit cells and cells on dropped tracebacks are not blocked.  A path next to
+// an earlier hit may so be returned ahead of, and score more than, hits the
+// full matrices return next.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "smith_waterman_linear.h"
+#include "alignment_linear.h"
+#include "alignment_macros.h"
+
+// Score of a blocked cell.  Small enough that no path through it is kept,
+// large enough that adding a penalty cannot overflow.
+#define SW_LINEAR_BLOCKED (SCORE_MIN/2)
+
+// Candidates kept by the first pass
+#define SW_LINEAR_NODES 64
+
+// Most rows (and columns) of scores kept to start passes from
+#define SW_LINEAR_LINES 16
+
+static void* _grow(void *ptr, size_t *capacity, size_t n, size_t size)
+{
+  if(n <= *capacity) return ptr;
+  *capacity = ROUNDUP2POW(n);
+  ptr = realloc(ptr, *capacity * size);
+  if(ptr == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+void sw_linear_destroy(sw_linear_t *swl)
+{
+  free(swl->scores);
+  free(swl->origins);
+  free(swl->profile);
+  free(swl->codes_b);
+  free(swl->blocked);
+  free(swl->spans);
+  free(swl->row_spans);
+  free(swl->nodes);
+  free(swl->node_table);
+  free(swl->blocks);
+  free(swl->row_lines);
+  free(swl->col_lines);
+  free(swl->fresh);
+  sw_linear_init(swl);
+}
+
+// Forget all candidates and keep up to max_nodes of them from now on
+static void _reset_nodes(sw_linear_t *swl, size_t max_nodes)
+{
+  size_t i;
+
+  swl->max_nodes = max_nodes;
+  swl->nodes = _grow(swl->nodes, &swl->nodes_capacity, max_nodes,
+                     sizeof(sw_linear_node_t));
+  swl->node_table = _grow(swl->node_table, &swl->table_capacity, 2*max_nodes,
+                          sizeof(size_t));
+
+  for(i = 0; i < swl->table_capacity; i++) swl->node_table[i] = SIZE_MAX;
+
+  swl->num_nodes = 0;
+  swl->threshold = 0;
+}
+
+// Give each character of seq_b a code and score seq_a against each code, so
+// passes look substitution scores up in a row rather than scoring_lookup()
+static void _load_profile(sw_linear_t *swl)
+{
+  const scoring_t *scoring = swl->scoring;
+  const size_t len_a = swl->len_a, len_b = swl->len_b;
+  int codes[256], substitution_penalty;
+  size_t ncodes = 0, x, y;
+  score_t *row;
+  bool is_match;
+  uint8_t c;
+
+  memset(codes, -1, sizeof(codes));
+  swl->codes_b = _grow(swl->codes_b, &swl->codes_b_capacity, len_b+1, 1);
+
+  for(y = 0; y < len_b; y++) {
+    c = (uint8_t)swl->seq_b[y];
+    if(codes[c] < 0) {
+      codes[c] = (int)ncodes++;
+      swl->profile = _grow(swl->profile, &swl->profile_capacity,
+                           ncodes*len_a, sizeof(score_t));
+      row = swl->profile + codes[c]*len_a;
+      for(x = 0; x < len_a; x++) {
+        scoring_lookup(scoring, swl->seq_a[x], (char)c,
+                       &substitution_penalty, &is_match);
+        row[x] = scoring->no_mismatches && !is_match ? PROFILE_NO_MATCH
+                                                     : substitution_penalty;
+      }
+    }
+    swl->codes_b[y] = (uint8_t)codes[c];
+  }
+}
+
+void sw_linear_load(sw_linear_t *swl, const char *seq_a, const char *seq_b,
+                    size_t len_a, size_t len_b, const scoring_t *scoring)
+{
+  size_t width = len_a+1, height = len_b+1, y, size;
+
+  scoring_check_fits(scoring, len_a, len_b);
+
+  swl->seq_a = seq_a;
+  swl->seq_b = seq_b;
+  swl->len_a = len_a;
+  swl->len_b = len_b;
+  swl->scoring = scoring;
+  swl->loaded = true;
+  swl->done = false;
+  swl->num_spans = 0;
+
+  if(6*width > swl->rows_capacity) {
+    swl->rows_capacity = ROUNDUP2POW(6*width);
+    swl->scores = realloc(swl->scores, swl->rows_capacity * sizeof(score_t));
+    swl->origins = realloc(swl->origins, swl->rows_capacity * sizeof(size_t));
+    if(swl->scores == NULL || swl->origins == NULL) {
+      fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  _load_profile(swl);
+
+  swl->blocked = _grow(swl->blocked, &swl->blocked_capacity, width, 1);
+  swl->row_spans = _grow(swl->row_spans, &swl->row_spans_capacity, len_b+1,
+                         sizeof(size_t));
+
+  for(y = 0; y <= len_b; y++) swl->row_spans[y] = SIZE_MAX;
+
+  // About as many blocks as cells in a row and column
+  for(size = 16; size*size*(width+len_b+1) < width*(len_b+1); size *= 2) {}
+  swl->block_size = size;
+  swl->blocks_wide = (width+size-1) / size;
+  swl->blocks_high = (height+size-1) / size;
+  swl->blocks = _grow(swl->blocks, &swl->blocks_capacity,
+                      swl->blocks_wide * swl->blocks_high,
+                      sizeof(sw_linear_block_t));
+
+  // Lines whole blocks apart
+  size *= SW_LINEAR_LINES;
+  swl->line_x = (width+size-1) / size * swl->block_size;
+  swl->line_y = (height+size-1) / size * swl->block_size;
+  swl->rects_wide = (width + swl->line_x-1) / swl->line_x;
+  swl->rects_high = (height + swl->line_y-1) / swl->line_y;
+  swl->row_lines = _grow(swl->row_lines, &swl->row_lines_capacity,
+                         height / swl->line_y * width,
+                         sizeof(sw_linear_cell_t));
+  swl->col_lines = _grow(swl->col_lines, &swl->col_lines_capacity,
+                         width / swl->line_x * height,
+                         sizeof(sw_linear_cell_t));
+  swl->fresh = _grow(swl->fresh, &swl->fresh_capacity,
+                     swl->rects_wide * swl->rects_high, 1);
+
+  // The first fetch scores the whole matrix
+  _reset_nodes(swl, SW_LINEAR_NODES);
+  swl->scored = false;
+}
+
+// Mark the cells x0..x1 of row y on hits already returned: out[x-x0] is 1 if
+// cell (x,y) is, 0 if not.  Also passed to alignment_linear_path().
+static void _blocked_row(void *arg, size_t y, size_t x0, size_t x1,
+                         uint8_t *out)
+{
+  const sw_linear_t *swl = arg;
+  const sw_linear_span_t *span;
+  size_t i, lo, hi;
+
+  memset(out, 0, x1-x0+1);
+
+  for(i = swl->row_spans[y]; i != SIZE_MAX; i = span->next) {
+    span = &swl->spans[i];
+    if(span->x0 > x1) break;
+    if(span->x1 < x0) continue;
+    lo = MAX2(span->x0, x0);
+    hi = MIN2(span->x1, x1);
+    memset(out + lo-x0, 1, hi-lo+1);
+  }
+}
+
+static inline size_t _node_hash(size_t origin, size_t mask)
+{
+  uint64_t h = (uint64_t)origin * 0x9E3779B97F4A7C15ull;
+  return (size_t)(h ^ (h >> 32)) & mask;
+}
+
+// Slot of node_table holding origin, or the empty slot where it would go
+static size_t _node_slot(const sw_linear_t *swl, size_t origin)
+{
+  const size_t mask = swl->table_capacity-1;
+  size_t slot = _node_hash(origin, mask);
+
+  while(swl->node_table[slot] != SIZE_MAX &&
+        swl->nodes[swl->node_table[slot]].origin != origin)
+  {
+    slot = (slot+1) & mask;
+  }
+
+  return slot;
+}
+
+// Remove node i, moving the last node into its place
+static void _remove_node(sw_linear_t *swl, size_t i)
+{
+  const size_t mask = swl->table_capacity-1;
+  size_t *table = swl->node_table, last = swl->num_nodes-1;
+  size_t hole = _node_slot(swl, swl->nodes[i].origin), slot = hole, home;
+
+  // Shift back any entries that probed past the hole
+  while(1) {
+    slot = (slot+1) & mask;
+    if(table[slot] == SIZE_MAX) break;
+    home = _node_hash(swl->nodes[table[slot]].origin, mask);
+    if(hole <= slot ? (hole < home && home <= slot)
+                    : (hole < home || home <= slot)) continue;
+    table[hole] = table[slot];
+    hole = slot;
+  }
+  table[hole] = SIZE_MAX;
+
+  if(i != last) {
+    swl->nodes[i] = swl->nodes[last];
+    table[_node_slot(swl, swl->nodes[i].origin)] = i;
+  }
+
+  swl->num_nodes--;
+}
+
+// Whether a hit with score s ending on (x,y) comes before one with score t
+// ending on (u,v): highest score, then leftmost, then first in row order, as
+// smith_waterman_fetch() orders hits
+static inline bool _before(score_t s, size_t x, size_t y,
+                           score_t t, size_t u, size_t v)
+{
+  return s > t || (s == t && (x < u || (x == u && y < v)));
+}
+
+// Index of the best candidate, num_nodes if there are none
+static size_t _best_node(const sw_linear_t *swl)
+{
+  const sw_linear_node_t *node, *best = NULL;
+  size_t i, best_index = swl->num_nodes;
+
+  for(i = 0; i < swl->num_nodes; i++) {
+    node = &swl->nodes[i];
+    if(best == NULL ||
+       _before(node->score, node->ex, node->ey,
+               best->score, best->ex, best->ey))
+    {
+      best = node;
+      best_index = i;
+    }
+  }
+
+  return best_index;
+}
+
+// Add cell (x,y) in MATCH, reached with score from origin, to the candidates.
+// Called with scores above the threshold.  hint is the node last added to:
+// neighbouring cells mostly share an origin, so it saves looking it up.
+static void _add_cell(sw_linear_t *swl, size_t *hint, size_t origin,
+                      score_t score, size_t x, size_t y)
+{
+  sw_linear_node_t *node;
+  size_t slot, i, worst;
+
+  if(*hint >= swl->num_nodes || swl->nodes[*hint].origin != origin)
+  {
+    slot = _node_slot(swl, origin);
+
+    if(swl->node_table[slot] == SIZE_MAX)
+    {
+      if(swl->num_nodes == swl->max_nodes)
+      {
+        for(worst = 0, i = 1; i < swl->num_nodes; i++)
+          if(swl->nodes[i].score < swl->nodes[worst].score) worst = i;
+
+        // Drop whichever of the new origin and the worst candidate scores
+        // less
+        node = &swl->nodes[worst];
+        if(score <= node->score) {
+          swl->threshold = MAX2(swl->threshold, score);
+          return;
+        }
+
+        swl->threshold = MAX2(swl->threshold, node->score);
+        _remove_node(swl, worst);
+        slot = _node_slot(swl, origin);
+      }
+
+      node = &swl->nodes[swl->num_nodes];
+      node->origin = origin;
+      node->score = 0;
+      node->ex = node->bx = x;
+      node->ey = node->by = y;
+      node->pass = swl->passes;
+      swl->node_table[slot] = swl->num_nodes++;
+    }
+
+    *hint = swl->node_table[slot];
+  }
+
+  node = &swl->nodes[*hint];
+
+  if(_before(score, x, y, node->score, node->ex, node->ey)) {
+    node->score = score;
+    node->ex = x;
+    node->ey = y;
+  }
+
+  node->bx = MAX2(node->bx, x);
+  node->by = MAX2(node->by, y);
+}
+
+// Best move into a cell from the scores (s) and path starts (o) of the cell
+// it is reached from, with the penalty from each matrix.  Ties prefer GAP_A,
+// then GAP_B, then MATCH as alignment_reverse_move() does.  A path scoring 0
+// or less starts on this cell (self), unless moves are not floored at 0 (free
+// end gaps), when only blocked paths score below 0.
+static inline void _best_move(const score_t *s, const size_t *o,
+                              int match_penalty, int gap_a_penalty,
+                              int gap_b_penalty, bool floor, size_t self,
+                              score_t *score, size_t *origin)
+{
+  score_t best = s[GAP_A] + gap_a_penalty, tmp;
+  size_t from = o[GAP_A];
+
+  tmp = s[GAP_B] + gap_b_penalty;
+  if(tmp > best) { best = tmp; from = o[GAP_B]; }
+  tmp = s[MATCH] + match_penalty;
+  if(tmp > best) { best = tmp; from = o[MATCH]; }
+
+  if(best > 0) { *score = best; *origin = from; }
+  else if(floor || best == 0) { *score = 0; *origin = self; }
+  else { *score = SW_LINEAR_BLOCKED; *origin = self; }
+}
+
+// Add a cell in MATCH scoring more than the best of block from other origins
+static inline void _block_add(sw_linear_block_t *block, size_t origin,
+                              score_t score)
+{
+  if(origin == block->origin) block->max = MAX2(block->max, score);
+  else if(score > block->max) {
+    block->second = block->max;
+    block->max = score;
+    block->origin = origin;
+  }
+  else block->second = score;
+}
+
+static inline void _store_cell(sw_linear_cell_t *cell, const score_t *scores,
+                               const size_t *origins)
+{
+  memcpy(cell->scores, scores, sizeof(cell->scores));
+  memcpy(cell->origins, origins, sizeof(cell->origins));
+}
+
+static inline void _load_cell(const sw_linear_cell_t *cell, score_t *scores,
+                              size_t *origins)
+{
+  memcpy(scores, cell->scores, sizeof(cell->scores));
+  memcpy(origins, cell->origins, sizeof(cell->origins));
+}
+
+// Score-only pass over cells x0..x1 of rows y0..y1, starting from the kept
+// lines above and left of them.  (x0,y0) must be the top left corner of a
+// rectangle and x1+1, y1+1 the edge of a block or of the matrix.  Cells
+// scoring above the threshold are added to the candidates.
+static void _pass(sw_linear_t *swl, size_t x0, size_t y0, size_t x1, size_t y1)
+{
+  const scoring_t *scoring = swl->scoring;
+  const size_t len_a = swl->len_a, len_b = swl->len_b;
+  const size_t width = len_a+1, height = len_b+1, size = swl->block_size;
+  const int gap_open = scoring->gap_open + scoring->gap_extend;
+  const int gap_extend = scoring->gap_extend;
+  const size_t line_x = swl->line_x, line_y = swl->line_y;
+
+  const score_t *row = NULL;
+  sw_linear_block_t *block;
+  size_t x, y, self, left, i, j, hint = SIZE_MAX;
+  score_t substitution_penalty;
+
+  swl->passes++;
+
+  // Row above the first
+  if(y0 > 0) {
+    const sw_linear_cell_t *line = swl->row_lines + (y0/line_y-1)*width;
+    score_t *prev = swl->scores + 3*width*!(y0&1);
+    size_t *oprev = swl->origins + 3*width*!(y0&1);
+    for(x = x0 > 0 ? x0-1 : 0; x <= x1; x++)
+      _load_cell(&line[x], prev + 3*x, oprev + 3*x);
+  }
+
+  for(y = y0; y <= y1; y++)
+  {
+    score_t *curr = swl->scores + 3*width*(y&1);
+    score_t *prev = swl->scores + 3*width*!(y&1);
+    size_t *ocurr = swl->origins + 3*width*(y&1);
+    size_t *oprev = swl->origins + 3*width*!(y&1);
+
+    block = swl->blocks + (y/size)*swl->blocks_wide + x0/size;
+
+    if(y % size == 0) {
+      for(i = 0; i <= (x1-x0)/size; i++) {
+        block[i].max = block[i].second = 0;
+        block[i].origin = SIZE_MAX;
+        block[i].pass = swl->passes;
+        block[i].stale = false;
+      }
+    }
+
+    // Cell left of the first
+    if(x0 > 0) {
+      _load_cell(&swl->col_lines[(x0/line_x-1)*height + y],
+                 curr + 3*(x0-1), ocurr + 3*(x0-1));
+    }
+
+    _blocked_row(swl, y, x0, x1, swl->blocked + x0);
+
+    if(y > 0) row = swl->profile + swl->codes_b[y-1]*len_a;
+
+    for(x = x0, self = y*width+x0, left = size; x <= x1; x++, self++)
+    {
+      score_t *out = curr + 3*x;
+      size_t *org = ocurr + 3*x;
+
+      if(left-- == 0) { block++; left = size-1; }
+
+      if(swl->blocked[x]) {
+        out[MATCH] = out[GAP_A] = out[GAP_B] = SW_LINEAR_BLOCKED;
+        org[MATCH] = org[GAP_A] = org[GAP_B] = self;
+        continue;
+      }
+
+      if(x == 0 || y == 0) {
+        out[MATCH] = out[GAP_A] = out[GAP_B] = 0;
+        org[MATCH] = org[GAP_A] = org[GAP_B] = self;
+        continue;
+      }
+
+      substitution_penalty = row[x-1];
+
+      if(substitution_penalty == PROFILE_NO_MATCH) {
+        out[MATCH] = 0;
+        org[MATCH] = self;
+      }
+      else {
+        _best_move(prev + 3*(x-1), oprev + 3*(x-1), substitution_penalty,
+                   substitution_penalty, substitution_penalty, true, self,
+                   &out[MATCH], &org[MATCH]);
+      }
+
+      // from [x][y-1]
+      if(x == len_a && scoring->no_end_gap_penalty)
+        _best_move(prev + 3*x, oprev + 3*x, 0, 0, 0, false, self,
+                   &out[GAP_A], &org[GAP_A]);
+      else if(!scoring->no_gaps_in_a || x == len_a)
+        _best_move(prev + 3*x, oprev + 3*x, gap_open, gap_extend, gap_open,
+                   true, self, &out[GAP_A], &org[GAP_A]);
+      else {
+        out[GAP_A] = 0;
+        org[GAP_A] = self;
+      }
+
+      // from [x-1][y]
+      if(y == len_b && scoring->no_end_gap_penalty)
+        _best_move(out - 3, org - 3, 0, 0, 0, false, self,
+                   &out[GAP_B], &org[GAP_B]);
+      else if(!scoring->no_gaps_in_b || y == len_b)
+        _best_move(out - 3, org - 3, gap_open, gap_open, gap_extend,
+                   true, self, &out[GAP_B], &org[GAP_B]);
+      else {
+        out[GAP_B] = 0;
+        org[GAP_B] = self;
+      }
+
+      if(out[MATCH] > block->second) _block_add(block, org[MATCH], out[MATCH]);
+
+      if(out[MATCH] > swl->threshold)
+        _add_cell(swl, &hint, org[MATCH], out[MATCH], x, y);
+    }
+
+    // Keep the lines
+    for(x = x0+line_x-1; x <= x1; x += line_x) {
+      _store_cell(&swl->col_lines[(x/line_x)*height + y],
+                  curr + 3*x, ocurr + 3*x);
+    }
+
+    if((y+1) % line_y == 0) {
+      sw_linear_cell_t *line = swl->row_lines + (y/line_y)*width;
+      for(x = x0; x <= x1; x++) _store_cell(&line[x], curr + 3*x, ocurr + 3*x);
+    }
+  }
+
+  // Rectangles scored whole are fresh
+  for(j = y0/line_y; j < swl->rects_high; j++) {
+    if(MIN2((j+1)*line_y, height)-1 > y1) break;
+    for(i = x0/line_x; i < swl->rects_wide; i++) {
+      if(MIN2((i+1)*line_x, width)-1 > x1) break;
+      swl->fresh[j*swl->rects_wide + i] = true;
+    }
+  }
+}
+
+// Score the whole matrix, keeping up to max_nodes candidates
+static void _full_pass(sw_linear_t *swl, size_t max_nodes)
+{
+  _reset_nodes(swl, max_nodes);
+  _pass(swl, 0, 0, swl->len_a, swl->len_b);
+  swl->scored = true;
+}
+
+// Whether rectangles i0..i1 of rows j0..j1 of them are all fresh
+static bool _all_fresh(const sw_linear_t *swl, size_t i0, size_t j0,
+                       size_t i1, size_t j1)
+{
+  size_t i, j;
+
+  for(j = j0; j <= j1; j++)
+    for(i = i0; i <= i1; i++)
+      if(!swl->fresh[j*swl->rects_wide + i]) return false;
+
+  return true;
+}
+
+// Best score a cell in block may now have.  The cells from its best origin
+// score no more than its candidate if it was a candidate when the block was
+// scored and still is.
+static score_t _block_bound(const sw_linear_t *swl,
+                            const sw_linear_block_t *block)
+{
+  size_t slot = _node_slot(swl, block->origin), i = swl->node_table[slot];
+  if(i != SIZE_MAX && swl->nodes[i].pass <= block->pass) return block->second;
+  return block->max;
+}
+
+// Re-score a rectangle holding a stale block that may hold a cell coming
+// before candidate best (or, if there is none, scoring above the threshold).
+// The pass starts from lines in fresh rectangles, so may cover more above
+// and left of it.  Returns whether there was such a block.
+static bool _rescore_stale(sw_linear_t *swl, size_t best)
+{
+  const size_t size = swl->block_size;
+  const size_t line_x = swl->line_x, line_y = swl->line_y;
+  const sw_linear_block_t *block = swl->blocks;
+  const size_t num_blocks = swl->blocks_wide * swl->blocks_high;
+  score_t min = swl->threshold+1;
+  size_t b, x0, y0, x1, y1, i0, j0, i1, j1;
+  bool grown = true;
+
+  if(best < swl->num_nodes) min = MAX2(min, swl->nodes[best].score);
+
+  for(b = 0; b < num_blocks; b++, block++)
+    if(block->stale && block->max >= min && _block_bound(swl, block) >= min)
+      break;
+
+  if(b == num_blocks) return false;
+
+  x0 = b % swl->blocks_wide * size / line_x * line_x;
+  y0 = b / swl->blocks_wide * size / line_y * line_y;
+  x1 = MIN2(x0+line_x, swl->len_a+1) - 1;
+  y1 = MIN2(y0+line_y, swl->len_b+1) - 1;
+  i1 = x1 / line_x;
+  j1 = y1 / line_y;
+
+  // Move the top left corner up and left until the lines above and left of
+  // it are in fresh rectangles
+  while(grown) {
+    grown = false;
+    i0 = x0 / line_x;
+    j0 = y0 / line_y;
+    if(i0 > 0 && !_all_fresh(swl, i0-1, j0 > 0 ? j0-1 : 0, i0-1, j1)) {
+      x0 -= line_x;
+      grown = true;
+    }
+    if(j0 > 0 && !_all_fresh(swl, i0 > 0 ? i0-1 : 0, j0-1, i1, j0-1)) {
+      y0 -= line_y;
+      grown = true;
+    }
+  }
+
+  _pass(swl, x0, y0, x1, y1);
+  return true;
+}
+
+// Block cells x0..x1 of row y
+static void _add_span(sw_linear_t *swl, size_t y, size_t x0, size_t x1)
+{
+  size_t *link = &swl->row_spans[y];
+
+  swl->spans = _grow(swl->spans, &swl->spans_capacity, swl->num_spans+1,
+                     sizeof(sw_linear_span_t));
+
+  while(*link != SIZE_MAX && swl->spans[*link].x0 < x0)
+    link = &swl->spans[*link].next;
+
+  swl->spans[swl->num_spans] = (sw_linear_span_t){.x0 = x0, .x1 = x1,
+                                                  .next = *link};
+  *link = swl->num_spans++;
+}
+
+// Whether the spans of a hit, one per row from spans[first] on row y to row
+// hy1, overlap the box from (x0,y0) to (x1,y1)
+static bool _hit_overlaps(const sw_linear_t *swl, size_t first,
+                          size_t y, size_t hy1,
+                          size_t x0, size_t y0, size_t x1, size_t y1)
+{
+  const sw_linear_span_t *span;
+  size_t r;
+
+  for(r = MAX2(y0, y); r <= MIN2(y1, hy1); r++) {
+    span = &swl->spans[first + r-y];
+    if(span->x0 <= x1 && span->x1 >= x0) return true;
+  }
+
+  return false;
+}
+
+// Block the cells on the path of result, which starts on (x,y).  Only cells
+// below and right of (x,y) whose paths went through it can now score
+// differently: those above the threshold are in the boxes of candidates
+// the hit passes through, and the blocks under them are marked stale.  A
+// candidate keeps its best cell unless the hit passes through the box from
+// its origin to that cell, when it is dropped.
+static void _add_hit(sw_linear_t *swl, const alignment_t *result,
+                     size_t x, size_t y)
+{
+  const size_t width = swl->len_a+1, size = swl->block_size;
+  const size_t hx = x, hy = y, hy1 = y + result->len_b;
+  const size_t first = swl->num_spans;
+  const sw_linear_node_t *node;
+  size_t i, j, x0 = x, x1 = x, ox, oy, bx, by;
+
+  for(i = 0; i < result->length; i++)
+  {
+    if(result->result_a[i] != '-') x++;
+    if(result->result_b[i] != '-') {
+      _add_span(swl, y++, x0, x1);
+      x0 = x;
+    }
+    x1 = x;
+  }
+
+  _add_span(swl, y, x0, x1);
+
+  for(i = swl->num_nodes; i-- > 0; ) {
+    node = &swl->nodes[i];
+    ox = node->origin % width;
+    oy = node->origin / width;
+    if(_hit_overlaps(swl, first, hy, hy1, ox, oy, node->bx, node->by)) {
+      for(by = MAX2(oy, hy) / size; by <= node->by / size; by++)
+        for(bx = MAX2(ox, hx) / size; bx <= node->bx / size; bx++)
+          swl->blocks[by*swl->blocks_wide + bx].stale = true;
+      if(_hit_overlaps(swl, first, hy, hy1, ox, oy, node->ex, node->ey))
+        _remove_node(swl, i);
+    }
+  }
+
+  for(j = hy / swl->line_y; j < swl->rects_high; j++)
+    for(i = hx / swl->line_x; i < swl->rects_wide; i++)
+      swl->fresh[j*swl->rects_wide + i] = false;
+}
+
+int sw_linear_fetch(sw_linear_t *swl, alignment_t *result)
+{
+  const size_t width = swl->len_a+1;
+  const sw_linear_node_t *node;
+  size_t best, sx, sy, ex, ey;
+  score_t score;
+
+  if(!swl->loaded || swl->done) return 0;
+
+  if(!swl->scored) _full_pass(swl, swl->max_nodes);
+
+  while(1)
+  {
+    best = _best_node(swl);
+
+    // Blocks that may hold a cell coming first are scored again first
+    if(_rescore_stale(swl, best)) continue;
+
+    if(best < swl->num_nodes && swl->nodes[best].score > swl->threshold) break;
+    else if(swl->threshold > 0) {
+      // A dropped origin may score as well: keep more candidates
+      _full_pass(swl, 4*swl->max_nodes);
+    }
+    else {
+      swl->done = true;
+      return 0;
+    }
+  }
+
+  node = &swl->nodes[best];
+  score = node->score;
+  sx = node->origin % width;
+  sy = node->origin / width;
+  ex = node->ex;
+  ey = node->ey;
+
+  alignment_linear_path(swl->seq_a, swl->seq_b, swl->len_a, swl->len_b,
+                        swl->scoring, _blocked_row, swl,
+                        sx, sy, ex, ey, result);
+
+  result->score = score;
+  result->pos_a = sx;
+  result->pos_b = sy;
+  result->len_a = ex - sx;
+  result->len_b = ey - sy;
+
+  _add_hit(swl, result, sx, sy);
+
+  // The path is found out of order, so the CIGAR is made from the strings
+  if(result->cigar_only) {
+    alignment_cigar_from_strings(&result->cigar, result->result_a,
+                                 result->result_b,
+                                 swl->scoring->case_sensitive);
+    result->result_a[0] = result->result_b[0] = '\0';
+    result->length = 0;
+  }
+
+  return 1;
+}
@@ -0,0 +1,114 @@
+/*
+ smith_waterman_linear.h
+ url: https://github.com/noporpoise/seq-align
+ maintainer: Isaac Turner <turner.isaac@gmail.com>
+ license: Public Domain, no warranty
+ date: Oct 2026
+ */
+
+#ifndef SMITH_WATERMAN_LINEAR_HEADER_SEEN
+#define SMITH_WATERMAN_LINEAR_HEADER_SEEN
+
+#include <stdint.h> // SIZE_MAX
+#include <string.h> // memset
+#include "alignment.h"
+
+// Cells x0..x1 of a row on a hit already returned.  next is the index of the
+// span after it in the same row (in order of x), SIZE_MAX if none.
+typedef struct
+{
+  size_t x0, x1, next;
+} sw_linear_span_t;
+
+// Candidate hit: the best cell (ex,ey) in MATCH reached by paths starting
+// from cell origin, and the bottom right corner (bx,by) of the box holding
+// every cell in MATCH they reach that scored above the threshold when last
+// computed (and so the paths to them).  pass is the pass that added it.
+typedef struct
+{
+  size_t origin, ex, ey, bx, by, pass;
+  score_t score;
+} sw_linear_node_t;
+
+// Block of cells as last scored (by pass): the best score in MATCH, the
+// origin it came from and the best from any other origin.  stale if cells in
+// it may have scored differently since.
+typedef struct
+{
+  score_t max, second;
+  size_t origin, pass;
+  bool stale;
+} sw_linear_block_t;
+
+// Scores of a cell kept to start passes from, and where their paths start
+typedef struct
+{
+  score_t scores[3];
+  size_t origins[3];
+} sw_linear_cell_t;
+
+// Workspace for Waterman-Eggert local alignments in linear memory (see
+// smith_waterman_align_linear())
+typedef struct
+{
+  const char *seq_a, *seq_b;
+  size_t len_a, len_b;
+  const scoring_t *scoring;
+  bool loaded, done;
+  // Two rows of scores and of where each cell's path starts (y*(len_a+1)+x),
+  // three per cell
+  score_t *scores;
+  size_t *origins, rows_capacity;
+  // Query profile: profile[codes_b[y]*len_a+x] is the score of seq_a[x]
+  // against seq_b[y], or PROFILE_NO_MATCH where --nomismatches forbids it
+  score_t *profile;
+  uint8_t *codes_b;
+  size_t profile_capacity, codes_b_capacity;
+  uint8_t *blocked; // cells of the current row on earlier hits
+  size_t blocked_capacity;
+  // Spans of earlier hits, listed from row_spans[y] for row y
+  sw_linear_span_t *spans;
+  size_t num_spans, spans_capacity, *row_spans, row_spans_capacity;
+  // Candidates, at most max_nodes, one per origin.  node_table maps origins
+  // to nodes (open addressing, SIZE_MAX for empty).  Origins without a node
+  // score no more than threshold anywhere in MATCH.
+  sw_linear_node_t *nodes;
+  size_t num_nodes, max_nodes, nodes_capacity;
+  size_t *node_table, table_capacity;
+  score_t threshold;
+  // Blocks of block_size x block_size cells, in row order
+  sw_linear_block_t *blocks;
+  size_t block_size, blocks_wide, blocks_high, blocks_capacity;
+  // Last row of every line_y rows and last column of every line_x columns,
+  // kept from the passes.  These lines divide the matrix into rectangles, in
+  // row order; a rectangle is fresh if no hit has changed a cell in it since
+  // it was last scored.
+  sw_linear_cell_t *row_lines, *col_lines;
+  size_t line_x, line_y, rects_wide, rects_high;
+  size_t row_lines_capacity, col_lines_capacity;
+  uint8_t *fresh;
+  size_t fresh_capacity;
+  size_t passes;
+  bool scored; // whether the whole matrix has been scored since loading
+} sw_linear_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define sw_linear_init(swl) (memset(swl, 0, sizeof(sw_linear_t)))
+void sw_linear_destroy(sw_linear_t *swl);
+
+// Start handing out hits of seq_a against seq_b
+void sw_linear_load(sw_linear_t *swl, const char *seq_a, const char *seq_b,
+                    size_t len_a, size_t len_b, const scoring_t *scoring);
+
+// Next best hit not touching any earlier one
+// returns 1 if an alignment was read, 0 otherwise
+int sw_linear_fetch(sw_linear_t *swl, alignment_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,6 +17,7 @@
 
 // Alignment scoring and loading
 #include "alignment_cmdline.h"
+#include "alignment_binary.h"
 
 #include "needleman_wunsch.h"
 
@@ -24,18 +25,55 @@
 cmdline_t *cmd;
 scoring_t scoring;
 
-// Alignment results stored here
-nw_aligner_t *nw;
-alignment_t *result;
+// Index of the first alignment in the current file
+size_t alignment_index = 0;
+
+// Aligner and results for each thread
+typedef struct
+{
+  nw_aligner_t *nw;
+  alignment_t *result;
+} nw_worker_t;
 
 static void nw_set_default_scoring()
 {
   scoring_system_default(&scoring);
 }
 
-static void align_zam(const char *seq_a, const char *seq_b)
+static void nw_align(const char *seq_a, const char *seq_b,
+                     size_t len_a, size_t len_b, nw_worker_t *worker)
 {
-  needleman_wunsch_align(seq_a, seq_b, &scoring, nw, result);
+  nw_aligner_t *nw = worker->nw;
+  alignment_t *result = worker->result;
+
+  if(cmd->linear_space)
+  {
+    needleman_wunsch_align_linear(seq_a, seq_b, len_a, len_b, &scoring, result);
+  }
+  else if(cmd->compact)
+  {
+    needleman_wunsch_align_compact(seq_a, seq_b, len_a, len_b,
+                                   &scoring, nw, result);
+  }
+  else if(cmd->band_set)
+  {
+    needleman_wunsch_align_banded(seq_a, seq_b, len_a, len_b,
+                                  &scoring, cmd->band, cmd->band_widen,
+                                  nw, result);
+  }
+  else
+  {
+    needleman_wunsch_align2(seq_a, seq_b, len_a, len_b, &scoring, nw, result);
+  }
+}
+
+static void align_zam(const char *seq_a, const char *seq_b,
+                      size_t len_a, size_t len_b, FILE *out,
+                      nw_worker_t *worker)
+{
+  alignment_t *result = worker->result;
+
+  nw_align(seq_a, seq_b, len_a, len_b, worker);
 
   // Swap '-' for '_'
   int i;
@@ -49,110 +87,169 @@ static void align_zam(const char *seq_a, const char *seq_b)
   int num_of_indels = 0;
 
   // Print branch 1 and spacer
-  printf("Br1:%s\n    ", result->result_a);
+  fprintf(out, "Br1:%s\n    ", result->result_a);
 
   for(i = 0; result->result_a[i] != '\0'; i++)
   {
     if(result->result_a[i] == '_' || result->result_b[i] == '_')
     {
-      putc(' ', stdout);
+      putc(' ', out);
       num_of_indels++;
     }
     else if((scoring.case_sensitive && result->result_a[i] != result->result_b[i]) ||
             tolower(result->result_a[i]) != tolower(result->result_b[i]))
     {
-      putc('*', stdout);
+      putc('*', out);
       num_of_mismatches++;
     }
     else
     {
-      putc('|', stdout);
+      putc('|', out);
     }
   }
 
   // Print branch 2 and mismatch indel numbers
-  printf("\nBr2:%s\n%i %i\n\n", result->result_b,
-         num_of_mismatches, num_of_indels);
+  fprintf(out, "\nBr2:%s\n%i %i\n\n", result->result_b,
+          num_of_mismatches, num_of_indels);
+}
+
+static void align_score_only(const char *seq_a, const char *seq_b,
+                             size_t len_a, size_t len_b,
+                             const char *seq_a_name, const char *seq_b_name,
+                             size_t index, FILE *out, nw_worker_t *worker)
+{
+  score_t score = needleman_wunsch_score(seq_a, seq_b, len_a, len_b,
+                                         &scoring, worker->nw);
+
+  if(cmd->binary_out)
+  {
+    binary_write_score(out, alignment_index+index, score, len_a, len_b);
+    return;
+  }
+
+  if(cmd->print_fasta && seq_a_name != NULL)
+  {
+    fputs(seq_a_name, out);
+    putc('\n', out);
+  }
+
+  if(cmd->print_fasta && seq_b_name != NULL)
+  {
+    fputs(seq_b_name, out);
+    putc('\n', out);
+  }
+
+  fprintf(out, "score: %i\n\n", score);
+  if(cmd->interactive) fflush(out);
 }
 
+// Sequences need not be null terminated
 static void align(const char *seq_a, const char *seq_b,
-                  const char *seq_a_name, const char *seq_b_name)
+                  size_t len_a, size_t len_b,
+                  const char *seq_a_name, const char *seq_b_name,
+                  size_t index, FILE *out, nw_worker_t *worker)
 {
+  alignment_t *result = worker->result;
+
   if(cmd->zam_stle_output)
   {
-    align_zam(seq_a, seq_b);
-    fflush(stdout);
+    align_zam(seq_a, seq_b, len_a, len_b, out, worker);
+    if(cmd->interactive) fflush(out);
     return;
   }
 
-  needleman_wunsch_align(seq_a, seq_b, &scoring, nw, result);
+  if(cmd->score_only)
+  {
+    align_score_only(seq_a, seq_b, len_a, len_b, seq_a_name, seq_b_name,
+                     index, out, worker);
+    return;
+  }
+
+  nw_align(seq_a, seq_b, len_a, len_b, worker);
+
+  if(cmd->format != SEQ_ALIGN_FORMAT_TEXT || cmd->binary_out)
+  {
+    // Global: both sequences are aligned end to end
+    result->pos_a = result->pos_b = 0;
+    result->len_a = len_a;
+    result->len_b = len_b;
+    if(cmd->binary_out)
+      binary_write_record(out, alignment_index+index, result);
+    else
+      cmdline_print_alignment(out, cmd->format, result, seq_a_name, seq_b_name,
+                              seq_a, len_a, len_b, false);
+    if(cmd->interactive) fflush(out);
+    return;
+  }
 
   if(cmd->print_matrices)
   {
-    alignment_print_matrices(nw);
+    alignment_print_matrices(worker->nw);
   }
 
   if(cmd->print_fasta && seq_a_name != NULL)
   {
-    fputs(seq_a_name, stdout);
-    putc('\n', stdout);
+    fputs(seq_a_name, out);
+    putc('\n', out);
   }
 
   if(cmd->print_fasta && cmd->print_pretty && seq_b_name != NULL)
   {
-    fputs(seq_b_name, stdout);
-    putc('\n', stdout);
+    fputs(seq_b_name, out);
+    putc('\n', out);
   }
 
   if(cmd->print_colour)
   {
     // Print alignment line 1
-    alignment_colour_print_against(result->result_a, result->result_b,
-                                   scoring.case_sensitive);
+    alignment_colour_fprint_against(out, result->result_a, result->result_b,
+                                    scoring.case_sensitive);
   }
   else
   {
-    fputs(result->result_a, stdout);
+    fputs(result->result_a, out);
   }
-  putc('\n', stdout);
+  putc('\n', out);
 
   if(cmd->print_pretty)
   {
     // Print spacer
-    alignment_print_spacer(result->result_a, result->result_b, &scoring);
-    putc('\n', stdout);
+    alignment_fprint_spacer(out, result->result_a, result->result_b, &scoring);
+    putc('\n', out);
   }
   else if(cmd->print_fasta && seq_b_name != NULL)
   {
-    fputs(seq_b_name, stdout);
-    putc('\n', stdout);
+    fputs(seq_b_name, out);
+    putc('\n', out);
   }
 
   if(cmd->print_colour)
   {
     // Print alignment line 2
-    alignment_colour_print_against(result->result_b, result->result_a,
-                                   scoring.case_sensitive);
+    alignment_colour_fprint_against(out, result->result_b, result->result_a,
+                                    scoring.case_sensitive);
   }
   else
   {
-    fputs(result->result_b, stdout);
+    fputs(result->result_b, out);
   }
-  putc('\n', stdout);
+  putc('\n', out);
 
   if(cmd->print_scores) {
-    printf("score: %i\n", result->score);
+    fprintf(out, "score: %i\n", result->score);
   }
 
-  putc('\n', stdout);
-  fflush(stdout);
+  putc('\n', out);
+  if(cmd->interactive) fflush(out);
 }
 
-static void align_pair_from_file(read_t *read1, read_t *read2)
+static void align_pair_from_file(read_t *read1, read_t *read2, size_t index,
+                                 FILE *out, void *state)
 {
-  align(read1->seq.b, read2->seq.b,
+  align(read1->seq.b, read2->seq.b, read1->seq.end, read2->seq.end,
         (read1->name.end == 0 ? NULL : read1->name.b),
-        (read2->name.end == 0 ? NULL : read2->name.b));
+        (read2->name.end == 0 ? NULL : read2->name.b),
+        index, out, (nw_worker_t*)state);
 }
 
 int main(int argc, char* argv[])
@@ -165,17 +262,39 @@ int main(int argc, char* argv[])
   cmd = cmdline_new(argc, argv, &scoring, SEQ_ALIGN_NW_CMD);
 
   // Align!
-  nw = needleman_wunsch_new();
-  result = alignment_create(256);
+  size_t i, nthreads = cmd->nthreads;
+  nw_worker_t *workers = malloc(nthreads * sizeof(nw_worker_t));
+  void **states = malloc(nthreads * sizeof(void*));
+
+  if(workers == NULL || states == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  for(i = 0; i < nthreads; i++) {
+    workers[i].nw = needleman_wunsch_new();
+    aligner_set_threads(workers[i].nw, cmd->fill_threads);
+    workers[i].result = alignment_create(256);
+    workers[i].result->cigar_only = (cmd->format != SEQ_ALIGN_FORMAT_TEXT ||
+                                     cmd->binary_out);
+    states[i] = &workers[i];
+  }
+
+  if(cmd->binary_out) binary_write_header(stdout);
 
   if(cmd->seq1 != NULL)
   {
     // Align seq1 and seq2 pair passed on the command line
-    align(cmd->seq1, cmd->seq2, NULL, NULL);
+    align(cmd->seq1, cmd->seq2, strlen(cmd->seq1), strlen(cmd->seq2),
+          NULL, NULL, 0, stdout, &workers[0]);
+    alignment_index++;
   }
 
   // Align from files
-  size_t i, num_of_file_pairs = cmdline_get_num_of_file_pairs(cmd);
+  align_stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+
+  size_t num_of_file_pairs = cmdline_get_num_of_file_pairs(cmd);
   for(i = 0; i < num_of_file_pairs; i++)
   {
     const char *file1 = cmdline_get_file1(cmd, i);
@@ -183,12 +302,22 @@ int main(int argc, char* argv[])
     if(file1 != NULL && *file1 == '\0' && file2 == NULL) {
       file1 = "-";
     }
-    align_from_file(file1, file2, &align_pair_from_file, !cmd->interactive);
+    alignment_index += align_from_file(file1, file2, &align_pair_from_file,
+                                       states, cmd->interactive ? 0 : nthreads,
+                                       !cmd->interactive, &stats);
   }
 
+  if(cmd->print_stats)
+    align_stats_print(&stats, stderr);
+
   // Free memory for storing alignment results
-  needleman_wunsch_free(nw);
-  alignment_free(result);
+  for(i = 0; i < nthreads; i++) {
+    needleman_wunsch_free(workers[i].nw);
+    alignment_free(workers[i].result);
+  }
+
+  free(workers);
+  free(states);
 
   cmdline_free(cmd);
 
@@ -21,16 +21,21 @@
 #include "alignment_scoring_load.h"
 #include "alignment_cmdline.h"
 #include "alignment_macros.h"
+#include "alignment_binary.h"
 
 #include "smith_waterman.h"
 
 cmdline_t *cmd;
 scoring_t scoring;
 
-// Alignment results stored here
-sw_aligner_t *sw;
-alignment_t *result;
+// Aligner and results for each thread
+typedef struct
+{
+  sw_aligner_t *sw;
+  alignment_t *result;
+} sw_worker_t;
 
+// Index of the first alignment in the current file
 size_t alignment_index = 0;
 bool wait_on_keystroke = 0;
 
@@ -45,40 +50,47 @@ static void sw_set_default_scoring()
   scoring.gap_extend = -1;
 }
 
+// Print c n times
+static void print_chars(FILE *out, char c, size_t n)
+{
+  char buf[256];
+  memset(buf, c, MIN2(n, sizeof(buf)));
+  for(; n > sizeof(buf); n -= sizeof(buf)) fwrite(buf, 1, sizeof(buf), out);
+  fwrite(buf, 1, n, out);
+}
+
 // Print one line of an alignment
-void print_alignment_part(const char* seq1, const char* seq2,
+void print_alignment_part(FILE *out, const char* seq1, const char* seq2,
                           size_t pos, size_t len,
                           const char* context_str,
                           size_t spaces_left, size_t spaces_right,
                           size_t context_left, size_t context_right)
 {
-  size_t i;
-  printf("  ");
-
-  for(i = 0; i < spaces_left; i++) printf(" ");
+  fputs("  ", out);
+  print_chars(out, ' ', spaces_left);
 
   if(context_left > 0)
   {
-    if(cmd->print_colour) fputs(align_col_context, stdout);
-    printf("%.*s", (int)context_left, context_str+pos-context_left);
-    if(cmd->print_colour) fputs(align_col_stop, stdout);
+    if(cmd->print_colour) fputs(align_col_context, out);
+    fwrite(context_str+pos-context_left, 1, context_left, out);
+    if(cmd->print_colour) fputs(align_col_stop, out);
   }
 
   if(cmd->print_colour)
-    alignment_colour_print_against(seq1, seq2, scoring.case_sensitive);
+    alignment_colour_fprint_against(out, seq1, seq2, scoring.case_sensitive);
   else
-    fputs(seq1, stdout);
+    fputs(seq1, out);
 
   if(context_right > 0)
   {
-    if(cmd->print_colour) fputs(align_col_context, stdout);
-    printf("%.*s", (int)context_right, context_str+pos+len);
-    if(cmd->print_colour) fputs(align_col_stop, stdout);
+    if(cmd->print_colour) fputs(align_col_context, out);
+    fwrite(context_str+pos+len, 1, context_right, out);
+    if(cmd->print_colour) fputs(align_col_stop, out);
   }
 
-  for(i = 0; i < spaces_right; i++) putc(' ', stdout);
+  print_chars(out, ' ', spaces_right);
 
-  printf("  [pos: %li; len: %lu]\n", pos, len);
+  fprintf(out, "  [pos: %li; len: %lu]\n", pos, len);
 }
 
 static char get_next_hit()
@@ -122,9 +134,14 @@ static char get_next_hit()
 }
 
 // Align two sequences against each other to find local alignments between them
-void align(const char *seq_a, const char *seq_b,
-           const char *seq_a_name, const char *seq_b_name)
+// Sequences need not be null terminated
+void align(const char *seq_a, const char *seq_b, size_t len_a, size_t len_b,
+           const char *seq_a_name, const char *seq_b_name,
+           size_t index, FILE *out, sw_worker_t *worker)
 {
+  sw_aligner_t *sw = worker->sw;
+  alignment_t *result = worker->result;
+
   if((seq_a_name != NULL || seq_b_name != NULL) && wait_on_keystroke)
   {
     fprintf(stderr, "Error: Interactive input takes seq only "
@@ -134,7 +151,7 @@ void align(const char *seq_a, const char *seq_b,
   }
 
   // Check both arguments have length > 0
-  if(seq_a[0] == '\0' || seq_b[0] == '\0')
+  if(len_a == 0 || len_b == 0)
   {
     fprintf(stderr, "Error: Sequences must have length > 0\n");
     fflush(stderr);
@@ -149,61 +166,120 @@ void align(const char *seq_a, const char *seq_b,
     return;
   }
 
-  smith_waterman_align(seq_a, seq_b, &scoring, sw);
+  score_t min_score = cmd->min_score;
+
+  if(!cmd->min_score_set)
+  {
+    // If min_score hasn't been set, set a limit based on the lengths of seqs
+    // or zero if we're running interactively
+    min_score = wait_on_keystroke ? 0
+                  : scoring.match * MAX2(0.2 * MIN2(len_a, len_b), 2);
+
+    #ifdef SEQ_ALIGN_VERBOSE
+    fprintf(out, "min_score: %i\n", min_score);
+    #endif
+  }
+
+  // Screen with the score-only kernel first: if the best hit cannot reach
+  // min_score nothing will be printed, so skip the full alignment
+  // With --scoreonly that score is all we print
+  bool screened_out = false;
+  sw_hit_t best_hit;
 
-  aligner_t *aligner = smith_waterman_get_aligner(sw);
-  size_t len_a = aligner->score_width-1, len_b = aligner->score_height-1;
+  // With one hit wanted, its own score-only pass does the screening
+  bool best_only = cmd->max_hits_per_alignment_set &&
+                   cmd->max_hits_per_alignment == 1 &&
+                   !cmd->score_only && !cmd->print_matrices &&
+                   !cmd->band_set && !cmd->linear_space && !wait_on_keystroke;
 
-  printf("== Alignment %zu lengths (%lu, %lu):\n", alignment_index, len_a, len_b);
+  if(cmd->score_only ||
+     (!cmd->print_matrices && !wait_on_keystroke && !best_only))
+  {
+    smith_waterman_best_hit(seq_a, seq_b, len_a, len_b, &scoring, sw, &best_hit);
+    screened_out = cmd->score_only || (best_hit.score < min_score);
+  }
+
+  if(!screened_out && cmd->band_set)
+    smith_waterman_align_banded(seq_a, seq_b, len_a, len_b, &scoring,
+                                cmd->band, cmd->band_widen, sw);
+  else if(!screened_out && best_only)
+    smith_waterman_align_best(seq_a, seq_b, len_a, len_b, &scoring, sw);
+  else if(!screened_out && cmd->linear_space)
+    smith_waterman_align_linear(seq_a, seq_b, len_a, len_b, &scoring, sw);
+  else if(!screened_out)
+    smith_waterman_align2(seq_a, seq_b, len_a, len_b, &scoring, sw);
+
+  size_t hit_index = 0;
+
+  if(cmd->binary_out && cmd->score_only)
+  {
+    binary_write_score(out, alignment_index+index, best_hit.score,
+                       len_a, len_b);
+    return;
+  }
+
+  if(cmd->format != SEQ_ALIGN_FORMAT_TEXT || cmd->binary_out)
+  {
+    // One line per hit, the best first
+    while(!screened_out &&
+          (!cmd->max_hits_per_alignment_set ||
+           hit_index < cmd->max_hits_per_alignment) &&
+          get_next_hit() &&
+          smith_waterman_fetch(sw, result) && result->score >= min_score)
+    {
+      if(cmd->binary_out)
+        binary_write_record(out, alignment_index+index, result);
+      else
+        cmdline_print_alignment(out, cmd->format, result, seq_a_name,
+                                seq_b_name, seq_a, len_a, len_b, hit_index > 0);
+      hit_index++;
+      if(cmd->interactive) fflush(out);
+    }
+    return;
+  }
+
+  fprintf(out, "== Alignment %zu lengths (%lu, %lu):\n",
+          alignment_index+index, len_a, len_b);
 
   if(cmd->print_matrices)
   {
-    alignment_print_matrices(aligner);
+    alignment_print_matrices(smith_waterman_get_aligner(sw));
   }
 
   // seqA
   if(cmd->print_fasta && seq_a_name != NULL)
   {
-    fputs(seq_a_name, stdout);
-    putc('\n', stdout);
+    fputs(seq_a_name, out);
+    putc('\n', out);
   }
 
   if(cmd->print_seq)
   {
-    fputs(seq_a, stdout);
-    putc('\n', stdout);
+    fwrite(seq_a, 1, len_a, out);
+    putc('\n', out);
   }
 
   // seqB
   if(cmd->print_fasta && seq_b_name != NULL)
   {
-    fputs(seq_b_name, stdout);
-    putc('\n', stdout);
+    fputs(seq_b_name, out);
+    putc('\n', out);
   }
 
   if(cmd->print_seq)
   {
-    fputs(seq_b, stdout);
-    putc('\n', stdout);
+    fwrite(seq_b, 1, len_b, out);
+    putc('\n', out);
   }
 
-  putc('\n', stdout);
+  putc('\n', out);
 
-  if(!cmd->min_score_set)
+  if(cmd->score_only)
   {
-    // If min_score hasn't been set, set a limit based on the lengths of seqs
-    // or zero if we're running interactively
-    cmd->min_score = wait_on_keystroke ? 0
-                       : scoring.match * MAX2(0.2 * MIN2(len_a, len_b), 2);
-
-    #ifdef SEQ_ALIGN_VERBOSE
-    printf("min_score: %i\n", cmd->min_score);
-    #endif
+    fprintf(out, "score: %i\n\n", best_hit.score);
   }
 
-  fflush(stdout);
-
-  size_t hit_index = 0;
+  if(cmd->interactive) fflush(out);
 
   // For print context
   size_t context_left = 0, context_right = 0;
@@ -211,12 +287,15 @@ void align(const char *seq_a, const char *seq_b,
   size_t right_spaces_a = 0, right_spaces_b = 0;
 
 
-  while(get_next_hit() &&
-        smith_waterman_fetch(sw, result) && result->score >= cmd->min_score &&
+  // Check --maxhits first: each fetch may search far for the next hit
+  while(!screened_out &&
         (!cmd->max_hits_per_alignment_set ||
-         hit_index < cmd->max_hits_per_alignment))
+         hit_index < cmd->max_hits_per_alignment) &&
+        get_next_hit() &&
+        smith_waterman_fetch(sw, result) && result->score >= min_score)
   {
-    printf("hit %zu.%zu score: %i\n", alignment_index, hit_index++, result->score);
+    fprintf(out, "hit %zu.%zu score: %i\n",
+            alignment_index+index, hit_index++, result->score);
 
     if(cmd->print_context)
     {
@@ -241,14 +320,14 @@ void align(const char *seq_a, const char *seq_b,
     }
 
     #ifdef SEQ_ALIGN_VERBOSE
-    printf("context left = %lu; right = %lu spacing: [%lu,%lu] [%lu,%lu]\n",
+    fprintf(out, "context left = %lu; right = %lu spacing: [%lu,%lu] [%lu,%lu]\n",
            context_left, context_right,
            left_spaces_a, right_spaces_a,
            left_spaces_b, right_spaces_b);
     #endif
 
     // seq a
-    print_alignment_part(result->result_a, result->result_b,
+    print_alignment_part(out, result->result_a, result->result_b,
                          result->pos_a, result->len_a,
                          seq_a,
                          left_spaces_a, right_spaces_a,
@@ -257,67 +336,54 @@ void align(const char *seq_a, const char *seq_b,
 
     if(cmd->print_pretty)
     {
-      fputs("  ", stdout);
+      fputs("  ", out);
 
       size_t max_left_spaces = MAX2(left_spaces_a, left_spaces_b);
       size_t max_right_spaces = MAX2(right_spaces_a, right_spaces_b);
-      size_t spacer;
 
       // Print spaces for lefthand spacing
-      for(spacer = 0; spacer < max_left_spaces; spacer++)
-      {
-        putc(' ', stdout);
-      }
+      print_chars(out, ' ', max_left_spaces);
 
       // Print dots for lefthand context sequence
-      for(spacer = 0; spacer < context_left-max_left_spaces; spacer++)
-      {
-        putc('.', stdout);
-      }
+      print_chars(out, '.', context_left-max_left_spaces);
 
-      alignment_print_spacer(result->result_a, result->result_b, &scoring);
+      alignment_fprint_spacer(out, result->result_a, result->result_b,
+                              &scoring);
 
       // Print dots for righthand context sequence
-      for(spacer = 0; spacer < context_right-max_right_spaces; spacer++)
-      {
-        putc('.', stdout);
-      }
+      print_chars(out, '.', context_right-max_right_spaces);
 
       // Print spaces for righthand spacing
-      for(spacer = 0; spacer < max_right_spaces; spacer++)
-      {
-        putc(' ', stdout);
-      }
+      print_chars(out, ' ', max_right_spaces);
 
-      putc('\n', stdout);
+      putc('\n', out);
     }
 
     // seq b
-    print_alignment_part(result->result_b, result->result_a,
+    print_alignment_part(out, result->result_b, result->result_a,
                          result->pos_b, result->len_b,
                          seq_b,
                          left_spaces_b, right_spaces_b,
                          context_left-left_spaces_b,
                          context_right-right_spaces_b);
 
-    printf("\n");
+    fprintf(out, "\n");
 
-    // Flush output here
-    fflush(stdout);
+    // Flush output here if interactive
+    if(cmd->interactive) fflush(out);
   }
 
-  fputs("==\n", stdout);
-  fflush(stdout);
-
-  // Increment sequence alignment counter
-  alignment_index++;
+  fputs("==\n", out);
+  if(cmd->interactive) fflush(out);
 }
 
-void align_pair_from_file(read_t *read1, read_t *read2)
+void align_pair_from_file(read_t *read1, read_t *read2, size_t index,
+                          FILE *out, void *state)
 {
-  align(read1->seq.b, read2->seq.b,
+  align(read1->seq.b, read2->seq.b, read1->seq.end, read2->seq.end,
        (read1->name.end == 0 ? NULL : read1->name.b),
-       (read2->name.end == 0 ? NULL : read2->name.b));
+       (read2->name.end == 0 ? NULL : read2->name.b),
+       index, out, (sw_worker_t*)state);
 }
 
 int main(int argc, char* argv[])
@@ -330,17 +396,40 @@ int main(int argc, char* argv[])
   cmd = cmdline_new(argc, argv, &scoring, SEQ_ALIGN_SW_CMD);
 
   // Align!
-  sw = smith_waterman_new();
-  result = alignment_create(256);
+  size_t i, nthreads = cmd->nthreads;
+  sw_worker_t *workers = malloc(nthreads * sizeof(sw_worker_t));
+  void **states = malloc(nthreads * sizeof(void*));
+
+  if(workers == NULL || states == NULL) {
+    fprintf(stderr, "%s:%i: Out of memory\n", __FILE__, __LINE__);
+    exit(EXIT_FAILURE);
+  }
+
+  for(i = 0; i < nthreads; i++) {
+    workers[i].sw = smith_waterman_new();
+    aligner_set_threads(smith_waterman_get_aligner(workers[i].sw),
+                        cmd->fill_threads);
+    workers[i].result = alignment_create(256);
+    workers[i].result->cigar_only = (cmd->format != SEQ_ALIGN_FORMAT_TEXT ||
+                                     cmd->binary_out);
+    states[i] = &workers[i];
+  }
+
+  if(cmd->binary_out) binary_write_header(stdout);
 
   if(cmd->seq1 != NULL)
   {
     // Align seq1 and seq2
-    align(cmd->seq1, cmd->seq2, NULL, NULL);
+    align(cmd->seq1, cmd->seq2, strlen(cmd->seq1), strlen(cmd->seq2),
+          NULL, NULL, 0, stdout, &workers[0]);
+    alignment_index++;
   }
 
   // Align from files
-  size_t i, num_of_file_pairs = cmdline_get_num_of_file_pairs(cmd);
+  align_stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+
+  size_t num_of_file_pairs = cmdline_get_num_of_file_pairs(cmd);
   for(i = 0; i < num_of_file_pairs; i++)
   {
     const char *file1 = cmdline_get_file1(cmd, i);
@@ -349,12 +438,22 @@ int main(int argc, char* argv[])
       wait_on_keystroke = 1;
       file1 = "-";
     }
-    align_from_file(file1, file2, &align_pair_from_file, !cmd->interactive);
+    alignment_index += align_from_file(file1, file2, &align_pair_from_file,
+                                       states, cmd->interactive ? 0 : nthreads,
+                                       !cmd->interactive, &stats);
   }
 
+  if(cmd->print_stats)
+    align_stats_print(&stats, stderr);
+
   // Free memory for storing alignment results
-  smith_waterman_free(sw);
-  alignment_free(result);
+  for(i = 0; i < nthreads; i++) {
+    smith_waterman_free(workers[i].sw);
+    alignment_free(workers[i].result);
+  }
+
+  free(workers);
+  free(states);
 
   cmdline_free(cmd);
 
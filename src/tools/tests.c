@@ -6,16 +6,23 @@
  date: Feb 2015
  */
 
+// request decent POSIX version
+#define _XOPEN_SOURCE 700
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <time.h> // needed for rand()
 #include <unistd.h>  // need for getpid() for getting setting rand number
-
+#include <zlib.h>
 
 #include "needleman_wunsch.h"
 #include "smith_waterman.h"
+#include "seed_extend.h"
+#include "alignment_gzip.h"
+#include "alignment_mmap.h"
+#include "alignment_binary.h"
 
 //
 // Tests
@@ -173,6 +180,16 @@ static char* make_rand_seq(char *seq, size_t size)
   return seq;
 }
 
+// Random sequence of exactly len bases
+static char* make_rand_seq_len(char *seq, size_t len)
+{
+  size_t i;
+  const char bases[] = "acgt";
+  for(i = 0; i < len; i++) seq[i] = bases[rand() & 3];
+  seq[len] = '\0';
+  return seq;
+}
+
 void nw_test_no_mismatches_rand()
 {
   nw_aligner_t *nw = needleman_wunsch_new();
@@ -217,6 +234,404 @@ void nw_test_no_mismatches_rand()
   needleman_wunsch_free(nw);
 }
 
+// Score an alignment from scratch: gaps cost gap_open + length * gap_extend
+static int nw_rescore(const alignment_t *aln, const scoring_t *scoring)
+{
+  const char *a = aln->result_a, *b = aln->result_b;
+  int score = 0, substitution;
+  bool is_match;
+  char prev = 0; // 'a' if in a gap in seq_a, 'b' if gap in seq_b
+
+  for(; *a; a++, b++)
+  {
+    if(*a == '-') {
+      score += scoring->gap_extend + (prev != 'a' ? scoring->gap_open : 0);
+      prev = 'a';
+    } else if(*b == '-') {
+      score += scoring->gap_extend + (prev != 'b' ? scoring->gap_open : 0);
+      prev = 'b';
+    } else {
+      scoring_lookup(scoring, *a, *b, &substitution, &is_match);
+      score += substitution;
+      prev = 0;
+    }
+  }
+  return score;
+}
+
+// Alignments of all shapes should add up to the score reported
+void nw_test_score_rand()
+{
+  nw_aligner_t *nw = needleman_wunsch_new();
+  alignment_t *aln = alignment_create(256);
+
+  scoring_t scoring;
+  scoring_init(&scoring, 1, -2, -4, -1,
+               false, false, false, false, false, true);
+
+  char seqa[100], seqb[100];
+  size_t i;
+
+  for(i = 0; i < 50; i++)
+  {
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    needleman_wunsch_align(seqa, seqb, &scoring, nw, aln);
+    ASSERT(nw_rescore(aln, &scoring) == aln->score);
+  }
+
+  alignment_free(aln);
+  needleman_wunsch_free(nw);
+}
+
+// Linear memory alignments must score the same as the full matrices, and
+// still be alignments of the two sequences
+void nw_test_linear()
+{
+  nw_aligner_t *nw = needleman_wunsch_new();
+  alignment_t *aln = alignment_create(256), *lin = alignment_create(256);
+
+  scoring_t scoring;
+  char seqa[200], seqb[200], stripped[200];
+  size_t i, j, k;
+
+  for(i = 0; i < 50; i++)
+  {
+    // Cycle through free end gaps and no gaps in either sequence
+    scoring_init(&scoring, 1, -2, -4, -1, i&1, i&2, i&4, i&8, false, true);
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    needleman_wunsch_align(seqa, seqb, &scoring, nw, aln);
+    needleman_wunsch_align_linear(seqa, seqb, strlen(seqa), strlen(seqb),
+                                  &scoring, lin);
+    ASSERT(lin->score == aln->score);
+    ASSERT(strlen(lin->result_a) == strlen(lin->result_b));
+
+    for(j = k = 0; lin->result_a[j]; j++)
+      if(lin->result_a[j] != '-') stripped[k++] = lin->result_a[j];
+    stripped[k] = '\0';
+    ASSERT(strcmp(stripped, seqa) == 0);
+
+    for(j = k = 0; lin->result_b[j]; j++)
+      if(lin->result_b[j] != '-') stripped[k++] = lin->result_b[j];
+    stripped[k] = '\0';
+    ASSERT(strcmp(stripped, seqb) == 0);
+  }
+
+  alignment_free(aln);
+  alignment_free(lin);
+  needleman_wunsch_free(nw);
+}
+
+// Compact traceback must give exactly the alignment from the full matrices
+void nw_test_compact()
+{
+  nw_aligner_t *nw = needleman_wunsch_new();
+  alignment_t *aln = alignment_create(256), *cmp = alignment_create(256);
+
+  scoring_t scoring;
+  char seqa[200], seqb[200];
+  size_t i;
+
+  for(i = 0; i < 50; i++)
+  {
+    scoring_init(&scoring, 1, -2, -4, -1, i&1, i&2, i&4, i&8, false, true);
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    needleman_wunsch_align(seqa, seqb, &scoring, nw, aln);
+    needleman_wunsch_align_compact(seqa, seqb, strlen(seqa), strlen(seqb),
+                                   &scoring, nw, cmp);
+    ASSERT(cmp->score == aln->score);
+    ASSERT(strcmp(cmp->result_a, aln->result_a) == 0);
+    ASSERT(strcmp(cmp->result_b, aln->result_b) == 0);
+  }
+
+  alignment_free(aln);
+  alignment_free(cmp);
+  needleman_wunsch_free(nw);
+}
+
+// CIGAR built during traceback must describe the same alignment as the
+// gapped strings
+void nw_test_cigar()
+{
+  nw_aligner_t *nw = needleman_wunsch_new();
+  alignment_t *aln = alignment_create(256), *cig = alignment_create(256);
+  alignment_cigar_t expect;
+  memset(&expect, 0, sizeof(expect));
+  cig->cigar_only = true;
+
+  scoring_t scoring;
+  char seqa[200], seqb[200];
+  size_t i, j, len;
+
+  for(i = 0; i < 50; i++)
+  {
+    scoring_init(&scoring, 1, -2, -4, -1, i&1, i&2, i&4, i&8, false, true);
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    needleman_wunsch_align(seqa, seqb, &scoring, nw, aln);
+    needleman_wunsch_align(seqa, seqb, &scoring, nw, cig);
+    alignment_cigar_from_strings(&expect, aln->result_a, aln->result_b, false);
+
+    ASSERT(cig->score == aln->score);
+    ASSERT(cig->length == aln->length);
+    ASSERT(cig->result_a[0] == '\0');
+    ASSERT(cig->cigar.n == expect.n);
+    ASSERT(cig->cigar.nm == expect.nm);
+    ASSERT(memcmp(cig->cigar.ops, expect.ops,
+                  MIN(cig->cigar.n, expect.n) * sizeof(uint32_t)) == 0);
+
+    for(j = len = 0; j < cig->cigar.n; j++) {
+      ASSERT(j == 0 || alignment_cigar_op(&cig->cigar, j) !=
+                       alignment_cigar_op(&cig->cigar, j-1));
+      len += alignment_cigar_len(&cig->cigar, j);
+    }
+    ASSERT(len == aln->length);
+  }
+
+  // 'X' and gaps count towards NM
+  alignment_cigar_from_strings(&expect, "ACG-TTa", "AGGCT-A", false);
+  ASSERT(expect.n == 7 && expect.nm == 3);
+  ASSERT(alignment_cigar_op(&expect, 6) == '=');
+
+  free(expect.ops);
+  alignment_free(aln);
+  alignment_free(cig);
+  needleman_wunsch_free(nw);
+}
+
+// The query profile is kept between alignments: it must follow changes to
+// seq_a and to the scoring used, both made in place
+void nw_test_profile()
+{
+  nw_aligner_t *nw = needleman_wunsch_new(), *fresh;
+  alignment_t *aln = alignment_create(256), *ref = alignment_create(256);
+
+  scoring_t scoring, scoring2;
+  scoring_init(&scoring, 1, -2, -4, -1, false, false, false, false, false, true);
+  scoring_init(&scoring2, 3, -1, -2, -1, false, false, false, false, false, true);
+
+  char seqa[100], seqb[100];
+  size_t i;
+
+  for(i = 0; i < 30; i++)
+  {
+    // Same query buffer against several targets, then change the query
+    if(i % 5 == 0) make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    const scoring_t *s = (i & 1) ? &scoring2 : &scoring;
+
+    needleman_wunsch_align(seqa, seqb, s, nw, aln);
+    fresh = needleman_wunsch_new();
+    needleman_wunsch_align(seqa, seqb, s, fresh, ref);
+    needleman_wunsch_free(fresh);
+
+    ASSERT(aln->score == ref->score);
+    ASSERT(strcmp(aln->result_a, ref->result_a) == 0);
+    ASSERT(strcmp(aln->result_b, ref->result_b) == 0);
+  }
+
+  // Encoded sequences fold case unless the scoring is case sensitive
+  needleman_wunsch_align("ACGTN", "acgtn", &scoring, nw, aln);
+  ASSERT(aln->score == -10);
+  scoring.case_sensitive = false;
+  needleman_wunsch_align("ACGTN", "acgtn", &scoring, nw, aln);
+  ASSERT(aln->score == 5);
+
+  // New scores in the same scoring_t
+  scoring_init(&scoring, 10, -20, -40, -10, false, false, false, false, false,
+               false);
+  needleman_wunsch_align("ACGTN", "acgtn", &scoring, nw, aln);
+  ASSERT(aln->score == 50);
+
+  sw_aligner_t *sw = smith_waterman_new();
+  scoring_init(&scoring, 1, -2, -4, -1, false, false, false, false, false,
+               false);
+  smith_waterman_align("ACGTACG", "TTACGTACGTT", &scoring, sw);
+  ASSERT(smith_waterman_fetch(sw, aln) && aln->score == 7);
+  scoring_init(&scoring, 10, -20, -40, -10, false, false, false, false, false,
+               false);
+  smith_waterman_align("ACGTACG", "TTACGTACGTT", &scoring, sw);
+  ASSERT(smith_waterman_fetch(sw, aln) && aln->score == 70);
+  smith_waterman_free(sw);
+
+  alignment_free(aln);
+  alignment_free(ref);
+  needleman_wunsch_free(nw);
+}
+
+// Score-only alignment must agree with the full matrices, whichever sequence
+// is the shorter
+void nw_test_score()
+{
+  nw_aligner_t *nw = needleman_wunsch_new();
+  alignment_t *aln = alignment_create(256);
+
+  scoring_t scoring;
+  char seqa[200], seqb[200];
+  size_t i;
+
+  for(i = 0; i < 50; i++)
+  {
+    scoring_init(&scoring, 1, -2, -4, -1, i&1, i&2, i&4, i&8, false, true);
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    needleman_wunsch_align(seqa, seqb, &scoring, nw, aln);
+    ASSERT(needleman_wunsch_score(seqa, seqb, strlen(seqa), strlen(seqb),
+                                  &scoring, nw) == aln->score);
+  }
+
+  alignment_free(aln);
+  needleman_wunsch_free(nw);
+}
+
+// A band covering the whole matrix must give the full alignment, and a narrow
+// band is enough for sequences differing by a single indel
+void nw_test_banded()
+{
+  nw_aligner_t *nw = needleman_wunsch_new();
+  alignment_t *aln = alignment_create(256), *band = alignment_create(256);
+
+  scoring_t scoring;
+  scoring_init(&scoring, 1, -2, -4, -1, false, false, false, false, false, true);
+
+  char seqa[100], seqb[100];
+  size_t i, len_a, len_b;
+
+  for(i = 0; i < 50; i++)
+  {
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    len_a = strlen(seqa);
+    len_b = strlen(seqb);
+    needleman_wunsch_align(seqa, seqb, &scoring, nw, aln);
+    needleman_wunsch_align_banded(seqa, seqb, len_a, len_b, &scoring,
+                                  len_a > len_b ? len_a : len_b, false,
+                                  nw, band);
+    ASSERT(band->score == aln->score);
+    ASSERT(strcmp(band->result_a, aln->result_a) == 0);
+    ASSERT(strcmp(band->result_b, aln->result_b) == 0);
+  }
+
+  const char *a = "acgtgtcaactgcatgcatgcaaaagtcgtgcatatcga";
+  const char *b = "acgtgtcaactgcatgcatgcagtcgtgcatatcga";
+  needleman_wunsch_align(a, b, &scoring, nw, aln);
+  needleman_wunsch_align_banded(a, b, strlen(a), strlen(b), &scoring, 1, true,
+                                nw, band);
+  ASSERT(band->score == aln->score);
+  ASSERT(strcmp(band->result_a, aln->result_a) == 0);
+  ASSERT(strcmp(band->result_b, aln->result_b) == 0);
+
+  alignment_free(aln);
+  alignment_free(band);
+  needleman_wunsch_free(nw);
+}
+
+// Batched alignments must match aligning each pair on its own
+static void _nw_test_batch(const scoring_t *scoring)
+{
+  nw_aligner_t *nw = needleman_wunsch_new();
+  aligner_batch_t batch;
+  aligner_batch_init(&batch);
+
+  enum { NPAIRS = 21 };
+  char seqs[2*NPAIRS][100];
+  const char *seqs_a[NPAIRS], *seqs_b[NPAIRS];
+  size_t lens_a[NPAIRS], lens_b[NPAIRS], i;
+  alignment_t *results[NPAIRS], *aln = alignment_create(256);
+
+  for(i = 0; i < NPAIRS; i++) {
+    seqs_a[i] = make_rand_seq(seqs[2*i], sizeof(seqs[0]));
+    seqs_b[i] = make_rand_seq(seqs[2*i+1], sizeof(seqs[0]));
+    lens_a[i] = strlen(seqs_a[i]);
+    lens_b[i] = strlen(seqs_b[i]);
+    results[i] = alignment_create(256);
+  }
+
+  needleman_wunsch_align_batch(seqs_a, seqs_b, lens_a, lens_b, NPAIRS,
+                               scoring, nw, &batch, results);
+
+  for(i = 0; i < NPAIRS; i++) {
+    needleman_wunsch_align(seqs_a[i], seqs_b[i], scoring, nw, aln);
+    ASSERT(results[i]->score == aln->score);
+    ASSERT(strcmp(results[i]->result_a, aln->result_a) == 0);
+    ASSERT(strcmp(results[i]->result_b, aln->result_b) == 0);
+    alignment_free(results[i]);
+  }
+
+  alignment_free(aln);
+  aligner_batch_destroy(&batch);
+  needleman_wunsch_free(nw);
+}
+
+void nw_test_batch()
+{
+  scoring_t scoring;
+  scoring_init(&scoring, 1, -2, -4, -1, false, true, false, false, false, true);
+  _nw_test_batch(&scoring);
+
+  // Free end gaps and no mismatches change the traceback bits of the edges
+  scoring_init(&scoring, 1, -2, -4, -1, true, true, false, false, true, true);
+  _nw_test_batch(&scoring);
+
+  // Scores too large for 16 bits have to be redone with 32
+  scoring_init(&scoring, 1000, -2000, -4000, -1000,
+               false, false, false, false, false, true);
+  _nw_test_batch(&scoring);
+}
+
+// Filling tiles of the matrices on several threads must leave the same
+// matrices and alignment as a serial fill
+static void _nw_test_threads(const scoring_t *scoring)
+{
+  nw_aligner_t *nw = needleman_wunsch_new(), *ref = needleman_wunsch_new();
+  alignment_t *aln = alignment_create(256), *refaln = alignment_create(256);
+  char seqa[1200], seqb[1200];
+  size_t i, ncells;
+
+  aligner_set_threads(nw, 3);
+
+  for(i = 0; i < 4; i++)
+  {
+    // Tiles are 256 cells a side: whole tiles and partial ones down to a
+    // single column or row
+    make_rand_seq_len(seqa, i < 3 ? 257 + 300*i : 1100);
+    make_rand_seq_len(seqb, i < 3 ? 1100 - 300*i : 257);
+
+    needleman_wunsch_align(seqa, seqb, scoring, nw, aln);
+    needleman_wunsch_align(seqa, seqb, scoring, ref, refaln);
+
+    ncells = aligner_num_cells(ref);
+    ASSERT(memcmp(nw->match_scores, ref->match_scores,
+                  ncells*sizeof(score_t)) == 0);
+    ASSERT(memcmp(nw->gap_a_scores, ref->gap_a_scores,
+                  ncells*sizeof(score_t)) == 0);
+    ASSERT(memcmp(nw->gap_b_scores, ref->gap_b_scores,
+                  ncells*sizeof(score_t)) == 0);
+    ASSERT(aln->score == refaln->score);
+    ASSERT(strcmp(aln->result_a, refaln->result_a) == 0);
+    ASSERT(strcmp(aln->result_b, refaln->result_b) == 0);
+  }
+
+  alignment_free(aln);
+  alignment_free(refaln);
+  needleman_wunsch_free(nw);
+  needleman_wunsch_free(ref);
+}
+
+void nw_test_threads()
+{
+  scoring_t scoring;
+  scoring_init(&scoring, 1, -2, -4, -1, false, false, false, false, false, true);
+  _nw_test_threads(&scoring);
+
+  scoring_init(&scoring, 1, -2, -4, -1, true, true, false, false, false, true);
+  _nw_test_threads(&scoring);
+
+  scoring_init(&scoring, 1, -2, -4, -1, false, false, true, false, false, true);
+  _nw_test_threads(&scoring);
+}
 
 void test_nw()
 {
@@ -226,6 +641,15 @@ void test_nw()
   nw_test_free_gaps_at_ends();
   nw_test_no_mismatches();
   nw_test_no_mismatches_rand();
+  nw_test_score_rand();
+  nw_test_batch();
+  nw_test_linear();
+  nw_test_score();
+  nw_test_compact();
+  nw_test_cigar();
+  nw_test_profile();
+  nw_test_banded();
+  nw_test_threads();
 
   SUITE_END();
 }
@@ -267,12 +691,661 @@ void sw_test_no_gaps_smith_waterman()
   smith_waterman_free(sw);
 }
 
+void sw_test_best_hit()
+{
+  sw_aligner_t *sw = smith_waterman_new();
+  alignment_t *result = alignment_create(256);
+  sw_hit_t hit;
+
+  scoring_t scoring;
+  scoring_init(&scoring, 2, -2, -2, -1, false, false, false, false, false,
+               false);
+
+  ASSERT(smith_waterman_best_hit("tttacgtacgaaa", "ccacgtacgcc", 13, 11,
+                                 &scoring, sw, &hit) == 1);
+  ASSERT(hit.score == 14 && hit.end_a == 9 && hit.end_b == 8);
+
+  ASSERT(smith_waterman_best_hit("aaaa", "cccc", 4, 4, &scoring, sw, &hit) == 0);
+  ASSERT(hit.score == 0);
+
+  // Too high a score for 8 bit lanes
+  char seq[201];
+  memset(seq, 'a', 200);
+  seq[200] = '\0';
+  ASSERT(smith_waterman_best_hit(seq, seq, 200, 200, &scoring, sw, &hit) == 1);
+  ASSERT(hit.score == 400 && hit.end_a == 199 && hit.end_b == 199);
+
+  // Score must agree with the best hit from a full alignment
+  char seqa[200], seqb[200];
+  size_t i;
+
+  for(i = 0; i < 50; i++)
+  {
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    smith_waterman_best_hit(seqa, seqb, strlen(seqa), strlen(seqb),
+                            &scoring, sw, &hit);
+    smith_waterman_align(seqa, seqb, &scoring, sw);
+    if(smith_waterman_fetch(sw, result)) { ASSERT(hit.score == result->score); }
+    else { ASSERT(hit.score == 0); }
+  }
+
+  alignment_free(result);
+  smith_waterman_free(sw);
+}
+
+// Hits are fetched in batches: order must hold across them (highest score
+// first, then ending leftmost on seq_a)
+void sw_test_fetch_order()
+{
+  sw_aligner_t *sw = smith_waterman_new();
+  alignment_t *result = alignment_create(256);
+
+  scoring_t scoring;
+  scoring_init(&scoring, 1, -1, -1, -1, false, false, false, false, false,
+               false);
+
+  char seqa[400], seqb[400];
+  size_t i, nhits, end_a, prev_end_a = 0;
+  score_t prev_score = 0;
+  bool in_order = true;
+
+  for(i = 0; i < 10; i++)
+  {
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    smith_waterman_align(seqa, seqb, &scoring, sw);
+
+    for(nhits = 0; smith_waterman_fetch(sw, result); nhits++)
+    {
+      end_a = result->pos_a + result->len_a;
+      if(nhits > 0 && (result->score > prev_score ||
+                       (result->score == prev_score && end_a < prev_end_a)))
+        in_order = false;
+      prev_score = result->score;
+      prev_end_a = end_a;
+    }
+
+    ASSERT(in_order);
+    ASSERT(!smith_waterman_fetch(sw, result));
+  }
+
+  alignment_free(result);
+  smith_waterman_free(sw);
+}
+
+// Linear memory hits: the first must match the full matrices, each must add
+// up to its score, none may score more than the one before and no two may
+// share a cell
+void sw_test_linear()
+{
+  sw_aligner_t *sw = smith_waterman_new();
+  alignment_t *aln = alignment_create(256), *lin = alignment_create(256);
+
+  scoring_t scoring;
+  scoring_init(&scoring, 1, -2, -4, -1, false, false, false, false, false,
+               true);
+
+  char seqa[100], seqb[100];
+  static bool used[100][100];
+  size_t i, j, x, y, len_a, len_b;
+  score_t prev_score;
+  bool disjoint;
+
+  for(i = 0; i < 20; i++)
+  {
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    len_a = strlen(seqa);
+    len_b = strlen(seqb);
+
+    smith_waterman_align2(seqa, seqb, len_a, len_b, &scoring, sw);
+    if(!smith_waterman_fetch(sw, aln)) aln->score = 0;
+
+    smith_waterman_align_linear(seqa, seqb, len_a, len_b, &scoring, sw);
+    ASSERT(smith_waterman_fetch(sw, lin) == (aln->score > 0));
+    if(aln->score == 0) continue;
+
+    ASSERT(lin->score == aln->score);
+    ASSERT(lin->pos_a == aln->pos_a && lin->pos_b == aln->pos_b);
+    ASSERT(lin->len_a == aln->len_a && lin->len_b == aln->len_b);
+
+    memset(used, 0, sizeof(used));
+    disjoint = true;
+    prev_score = lin->score;
+
+    do
+    {
+      ASSERT(nw_rescore(lin, &scoring) == lin->score);
+      ASSERT(lin->score <= prev_score);
+      prev_score = lin->score;
+      x = lin->pos_a;
+      y = lin->pos_b;
+      for(j = 0; j <= lin->length; j++) {
+        if(j > 0 && lin->result_a[j-1] != '-') x++;
+        if(j > 0 && lin->result_b[j-1] != '-') y++;
+        if(used[x][y]) disjoint = false;
+        used[x][y] = true;
+      }
+    }
+    while(smith_waterman_fetch(sw, lin));
+
+    ASSERT(disjoint);
+  }
+
+  alignment_free(aln);
+  alignment_free(lin);
+  smith_waterman_free(sw);
+}
+
+// The three pass best hit must be exactly the first hit from the full
+// matrices, including which of several equal hits is taken
+void sw_test_align_best()
+{
+  sw_aligner_t *sw = smith_waterman_new();
+  alignment_t *aln = alignment_create(256), *best = alignment_create(256);
+
+  scoring_t scoring;
+  char seqa[100], seqb[400];
+  size_t i, len_a, len_b;
+  int found;
+
+  for(i = 0; i < 64; i++)
+  {
+    // Cycle through no gaps in either sequence and no mismatches
+    scoring_init(&scoring, 1, -2, -4, -1, false, false, i&1, i&2, i&4, true);
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, 100);
+    len_a = strlen(seqa);
+
+    // Repeat seq_b, with seq_a in it, for hits with equal scores
+    if(i & 8) strcat(seqb, seqa);
+    len_b = strlen(seqb);
+    if(i & 16) { memmove(seqb+len_b, seqb, len_b+1); len_b *= 2; }
+
+    smith_waterman_align2(seqa, seqb, len_a, len_b, &scoring, sw);
+    found = smith_waterman_fetch(sw, aln);
+
+    smith_waterman_align_best(seqa, seqb, len_a, len_b, &scoring, sw);
+    ASSERT(smith_waterman_fetch(sw, best) == found);
+    ASSERT(!smith_waterman_fetch(sw, best));
+    if(!found) continue;
+
+    ASSERT(best->score == aln->score);
+    ASSERT(best->pos_a == aln->pos_a && best->pos_b == aln->pos_b);
+    ASSERT(best->len_a == aln->len_a && best->len_b == aln->len_b);
+    ASSERT(strcmp(best->result_a, aln->result_a) == 0);
+    ASSERT(strcmp(best->result_b, aln->result_b) == 0);
+  }
+
+  alignment_free(aln);
+  alignment_free(best);
+  smith_waterman_free(sw);
+}
+
+// Hits from a band covering the whole matrix must match the full matrices
+void sw_test_banded()
+{
+  sw_aligner_t *sw = smith_waterman_new();
+  alignment_t *aln = alignment_create(256), *band = alignment_create(256);
+
+  scoring_t scoring;
+  scoring_init(&scoring, 1, -2, -4, -1, false, false, false, false, false, true);
+
+  char seqa[100], seqb[100];
+  size_t i, len_a, len_b;
+  int found;
+
+  for(i = 0; i < 50; i++)
+  {
+    make_rand_seq(seqa, sizeof(seqa));
+    make_rand_seq(seqb, sizeof(seqb));
+    len_a = strlen(seqa);
+    len_b = strlen(seqb);
+    smith_waterman_align2(seqa, seqb, len_a, len_b, &scoring, sw);
+    found = smith_waterman_fetch(sw, aln);
+    smith_waterman_align_banded(seqa, seqb, len_a, len_b, &scoring,
+                                len_a > len_b ? len_a : len_b, false, sw);
+    ASSERT(smith_waterman_fetch(sw, band) == found);
+    if(found) {
+      ASSERT(band->score == aln->score);
+      ASSERT(band->pos_a == aln->pos_a && band->pos_b == aln->pos_b);
+      ASSERT(strcmp(band->result_a, aln->result_a) == 0);
+      ASSERT(strcmp(band->result_b, aln->result_b) == 0);
+    }
+  }
+
+  alignment_free(aln);
+  alignment_free(band);
+  smith_waterman_free(sw);
+}
+
+void sw_test_batch()
+{
+  sw_aligner_t *sw = smith_waterman_new();
+  aligner_batch_t batch;
+  aligner_batch_init(&batch);
+
+  scoring_t scoring;
+  scoring_init(&scoring, 2, -2, -2, -1, false, false, false, false, false,
+               false);
+
+  enum { NPAIRS = 21 };
+  char seqs[2*NPAIRS][100];
+  const char *seqs_a[NPAIRS], *seqs_b[NPAIRS];
+  size_t lens_a[NPAIRS], lens_b[NPAIRS], i;
+  alignment_t *results[NPAIRS], *aln = alignment_create(256);
+
+  for(i = 0; i < NPAIRS; i++) {
+    seqs_a[i] = make_rand_seq(seqs[2*i], sizeof(seqs[0]));
+    seqs_b[i] = make_rand_seq(seqs[2*i+1], sizeof(seqs[0]));
+    lens_a[i] = strlen(seqs_a[i]);
+    lens_b[i] = strlen(seqs_b[i]);
+    results[i] = alignment_create(256);
+  }
+
+  smith_waterman_align_batch(seqs_a, seqs_b, lens_a, lens_b, NPAIRS,
+                             &scoring, sw, &batch, results);
+
+  for(i = 0; i < NPAIRS; i++) {
+    smith_waterman_align(seqs_a[i], seqs_b[i], &scoring, sw);
+    if(smith_waterman_fetch(sw, aln)) {
+      ASSERT(results[i]->score == aln->score);
+      ASSERT(results[i]->pos_a == aln->pos_a);
+      ASSERT(results[i]->pos_b == aln->pos_b);
+      ASSERT(results[i]->len_a == aln->len_a);
+      ASSERT(strcmp(results[i]->result_a, aln->result_a) == 0);
+      ASSERT(strcmp(results[i]->result_b, aln->result_b) == 0);
+    }
+    else { ASSERT(results[i]->score == 0 && results[i]->length == 0); }
+    alignment_free(results[i]);
+  }
+
+  alignment_free(aln);
+  aligner_batch_destroy(&batch);
+  smith_waterman_free(sw);
+}
+
+// Hits from matrices filled on several threads are those of a serial fill
+void sw_test_threads()
+{
+  sw_aligner_t *sw = smith_waterman_new(), *ref = smith_waterman_new();
+  alignment_t *aln = alignment_create(256), *refaln = alignment_create(256);
+
+  scoring_t scoring;
+  scoring_init(&scoring, 2, -2, -2, -1, false, false, false, false, false,
+               false);
+
+  char seqa[1200], seqb[1200];
+  size_t i;
+  int found;
+
+  aligner_set_threads(smith_waterman_get_aligner(sw), 4);
+
+  for(i = 0; i < 4; i++)
+  {
+    make_rand_seq_len(seqa, 300 + 250*i);
+    make_rand_seq_len(seqb, 1100 - 250*i);
+
+    smith_waterman_align(seqa, seqb, &scoring, sw);
+    smith_waterman_align(seqa, seqb, &scoring, ref);
+
+    do {
+      found = smith_waterman_fetch(sw, aln);
+      ASSERT(found == smith_waterman_fetch(ref, refaln));
+      if(!found) break;
+      ASSERT(aln->score == refaln->score);
+      ASSERT(aln->pos_a == refaln->pos_a && aln->pos_b == refaln->pos_b);
+      ASSERT(strcmp(aln->result_a, refaln->result_a) == 0);
+      ASSERT(strcmp(aln->result_b, refaln->result_b) == 0);
+    } while(aln->score > 10);
+  }
+
+  alignment_free(aln);
+  alignment_free(refaln);
+  smith_waterman_free(sw);
+  smith_waterman_free(ref);
+}
 
 void test_sw()
 {
   SUITE_START("Smith-Waterman");
 
   sw_test_no_gaps_smith_waterman();
+  sw_test_best_hit();
+  sw_test_fetch_order();
+  sw_test_linear();
+  sw_test_align_best();
+  sw_test_batch();
+  sw_test_banded();
+  sw_test_threads();
+
+  SUITE_END();
+}
+
+// Extension should run through a matching region with an indel and stop soon
+// after the sequences stop matching
+void extend_test_xdrop()
+{
+  seed_extend_t *ext = seed_extend_new();
+  alignment_t *aln = alignment_create(256);
+
+  scoring_t scoring;
+  scoring_init(&scoring, 1, -2, -4, -1, false, false, false, false, false, true);
+
+  const char *a = "acgtgtcaactgcatgcatgcaaaagtcgtgcatatcga" "ttttttttttttttttttt";
+  const char *b = "acgtgtcaactgcatgcatgcagtcgtgcatatcga" "ggggggggggggggggggggg";
+
+  ASSERT(seed_extend_align(a, b, strlen(a), strlen(b), &scoring, 10, 0,
+                           ext, aln) == 29);
+  ASSERT(aln->len_a == 39 && aln->len_b == 36);
+  ASSERT(nw_rescore(aln, &scoring) == aln->score);
+
+  // Nothing in common
+  ASSERT(seed_extend_align("aaaa", "cccc", 4, 4, &scoring, 10, 0,
+                           ext, aln) == 0);
+  ASSERT(aln->length == 0 && aln->len_a == 0 && aln->len_b == 0);
+
+  // Z-drop stops in a run of mismatches that X-drop would cross
+  a = "acgtacgtacgtacgtacgtacgtacgtacgt" "cccccccccccccccccccccccccccccc"
+      "acgtgtcaactgcatgcatgcaaaagtcgtgcatatcga"
+      "acgtgtcaactgcatgcatgcaaaagtcgtgcatatcga";
+  b = "acgtacgtacgtacgtacgtacgtacgtacgt" "gggggggggggggggggggggggggggggg"
+      "acgtgtcaactgcatgcatgcaaaagtcgtgcatatcga"
+      "acgtgtcaactgcatgcatgcaaaagtcgtgcatatcga";
+  ASSERT(seed_extend_align(a, b, strlen(a), strlen(b), &scoring, 100, 0,
+                           ext, aln) == 32 - 60 + 78);
+  ASSERT(seed_extend_align(a, b, strlen(a), strlen(b), &scoring, 100, 20,
+                           ext, aln) == 32);
+  ASSERT(aln->len_a == 32 && aln->len_b == 32);
+
+  alignment_free(aln);
+  seed_extend_free(ext);
+}
+
+void test_extend()
+{
+  SUITE_START("Seed extension");
+
+  extend_test_xdrop();
+
+  SUITE_END();
+}
+
+// Compiled lookups must match the original for every pair in alphabet
+static void _scoring_test_compiled(scoring_t *scoring, const char *alphabet)
+{
+  static scoring_t compiled;
+  compiled = *scoring;
+  ASSERT(scoring_compile(&compiled));
+
+  const char *a, *b;
+  int score, compiled_score;
+  bool is_match, compiled_is_match;
+
+  for(a = alphabet; *a; a++) {
+    for(b = alphabet; *b; b++) {
+      scoring_lookup(scoring, *a, *b, &score, &is_match);
+      scoring_lookup(&compiled, *a, *b, &compiled_score, &compiled_is_match);
+      ASSERT(score == compiled_score && is_match == compiled_is_match);
+    }
+  }
+}
+
+void scoring_test_compile()
+{
+  static scoring_t scoring;
+  char printable[128];
+  size_t i;
+
+  for(i = 0; i < 94; i++) printable[i] = (char)(33+i);
+  printable[94] = '\0';
+
+  scoring_system_default(&scoring);
+  scoring_add_wildcard(&scoring, 'N', 1);
+  _scoring_test_compiled(&scoring, printable);
+
+  scoring.case_sensitive = true;
+  scoring.no_mismatches = true;
+  _scoring_test_compiled(&scoring, printable);
+
+  scoring_system_BLOSUM62(&scoring);
+  scoring_add_wildcard(&scoring, 'x', -1);
+  _scoring_test_compiled(&scoring, printable);
+
+  // No match/mismatch fallback: only the substitution pairs are known
+  scoring_system_DNA_hybridization(&scoring);
+  _scoring_test_compiled(&scoring, "ACGTacgt");
+}
+
+void scoring_test_fits()
+{
+  static scoring_t scoring;
+
+  scoring_system_default(&scoring);
+  ASSERT(scoring_fits(&scoring, 1000000, 1000000));
+
+  // Compiling picks up scores edited after init
+  scoring.match = 1<<20;
+  scoring_compile(&scoring);
+  ASSERT(scoring.max_penalty == 1<<20);
+  ASSERT(scoring_fits(&scoring, 100, 100));
+  ASSERT(!scoring_fits(&scoring, 1000, 1000));
+}
+
+void test_scoring()
+{
+  SUITE_START("Scoring");
+
+  scoring_test_compile();
+  scoring_test_fits();
+
+  SUITE_END();
+}
+
+// Write data as BGZF blocks of at most block bytes, then the empty EOF block
+static void _gzip_write_bgzf(FILE *fh, const char *data, size_t len,
+                             size_t block)
+{
+  unsigned char head[18] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0,
+                            'B', 'C', 2, 0, 0, 0};
+  unsigned char cdata[70000], foot[8];
+  size_t i, n, clen;
+  uint32_t crc;
+
+  for(i = 0; ; i += n)
+  {
+    n = len - i < block ? len - i : block;
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    deflateInit2(&strm, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    strm.next_in = (unsigned char*)data + i;
+    strm.avail_in = n;
+    strm.next_out = cdata;
+    strm.avail_out = sizeof(cdata);
+    deflate(&strm, Z_FINISH);
+    clen = sizeof(cdata) - strm.avail_out;
+    deflateEnd(&strm);
+
+    crc = crc32(crc32(0L, Z_NULL, 0), (unsigned char*)data + i, n);
+    head[16] = (clen + 25) & 0xff;
+    head[17] = (clen + 25) >> 8;
+    foot[0] = crc; foot[1] = crc >> 8; foot[2] = crc >> 16; foot[3] = crc >> 24;
+    foot[4] = n; foot[5] = n >> 8; foot[6] = foot[7] = 0;
+
+    fwrite(head, 1, sizeof(head), fh);
+    fwrite(cdata, 1, clen, fh);
+    fwrite(foot, 1, sizeof(foot), fh);
+
+    if(n == 0) break;
+  }
+}
+
+// Read everything from the reader, returns whether it matched data
+static bool _gzip_test_read(gzip_reader_t *gz, const char *data, size_t len,
+                            char *buf)
+{
+  ssize_t n;
+  size_t total = 0;
+  int fd = gzip_reader_fd(gz);
+
+  while((n = read(fd, buf + total, len + 1 - total)) > 0) total += n;
+  close(fd);
+
+  return total == len && memcmp(buf, data, len) == 0;
+}
+
+void gzip_test_reader()
+{
+  char path[] = "/tmp/seq_align_test_XXXXXX";
+  size_t i, len = 300000;
+  char *data = malloc(len), *buf = malloc(len + 1);
+  gzip_reader_t *gz;
+  FILE *fh;
+
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0);
+  close(fd);
+
+  for(i = 0; i < len; i++) data[i] = "ACGT\n"[rand() % 5];
+
+  // Plain text isn't taken
+  fh = fopen(path, "w");
+  fwrite(data, 1, len, fh);
+  fclose(fh);
+  ASSERT(gzip_reader_open(path, 2) == NULL);
+
+  // BGZF, inflated on several threads
+  fh = fopen(path, "w");
+  _gzip_write_bgzf(fh, data, len, 7000);
+  fclose(fh);
+  ASSERT((gz = gzip_reader_open(path, 3)) != NULL);
+  ASSERT(_gzip_test_read(gz, data, len, buf));
+  ASSERT(gzip_reader_close(gz));
+
+  // A bad CRC is reported (the last block's CRC starts 36 bytes from the end,
+  // before its size and the 28 byte EOF block)
+  fh = fopen(path, "r+");
+  fseek(fh, -36, SEEK_END);
+  int c = getc(fh);
+  fseek(fh, -36, SEEK_END);
+  putc(c ^ 1, fh);
+  fclose(fh);
+  ASSERT((gz = gzip_reader_open(path, 2)) != NULL);
+  ASSERT(!_gzip_test_read(gz, data, len, buf));
+  ASSERT(!gzip_reader_close(gz));
+
+  // Plain gzip
+  gzFile gzfh = gzopen(path, "w");
+  gzwrite(gzfh, data, len);
+  gzclose(gzfh);
+  ASSERT((gz = gzip_reader_open(path, 2)) != NULL);
+  ASSERT(_gzip_test_read(gz, data, len, buf));
+  ASSERT(gzip_reader_close(gz));
+
+  unlink(path);
+  free(data);
+  free(buf);
+}
+
+void mmap_test_reader()
+{
+  char path[] = "/tmp/seq_align_test_XXXXXX";
+  read_t view, buf;
+  mmap_reader_t *map;
+
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0);
+  const char *fasta = ">one\nACGT\n\n>two desc\r\nAC\r\nGT\r\nTT\r\n>three\n";
+  ASSERT(write(fd, fasta, strlen(fasta)) == (ssize_t)strlen(fasta));
+  close(fd);
+
+  seq_read_alloc(&buf);
+  ASSERT((map = mmap_reader_open(path)) != NULL);
+
+  // Single line sequences are left in the file
+  ASSERT(mmap_reader_read(map, &view, &buf));
+  ASSERT(strcmp(view.name.b, "one") == 0);
+  ASSERT(view.seq.end == 4 && strncmp(view.seq.b, "ACGT\n", 5) == 0);
+  ASSERT(view.seq.b != buf.seq.b);
+
+  // Lines are joined into the buffer
+  ASSERT(mmap_reader_read(map, &view, &buf));
+  ASSERT(strcmp(view.name.b, "two desc") == 0);
+  ASSERT(view.seq.end == 6 && strcmp(view.seq.b, "ACGTTT") == 0);
+
+  ASSERT(mmap_reader_read(map, &view, &buf));
+  ASSERT(strcmp(view.name.b, "three") == 0 && view.seq.end == 0);
+  ASSERT(!mmap_reader_read(map, &view, &buf));
+  mmap_reader_close(map);
+
+  seq_read_dealloc(&buf);
+  unlink(path);
+}
+
+// Records written by --binary-out are read back in place
+void binary_test_reader()
+{
+  char path[] = "/tmp/seq_align_test_XXXXXX";
+  const binary_record_t *rec;
+  const uint32_t *cigar;
+  binary_reader_t *bin;
+
+  sw_aligner_t *sw = smith_waterman_new();
+  alignment_t *result = alignment_create(256);
+  result->cigar_only = true;
+
+  scoring_t scoring;
+  scoring_init(&scoring, 2, -2, -2, -1, false, false, false, false, false, false);
+  smith_waterman_align("TTTACGTACGGGGACGTA", "CCACGTACGGCCACGTAGG",
+                       &scoring, sw);
+  ASSERT(smith_waterman_fetch(sw, result));
+
+  int fd = mkstemp(path);
+  ASSERT(fd >= 0);
+  FILE *fh = fdopen(fd, "w");
+  binary_write_header(fh);
+  binary_write_record(fh, 7, result);
+  binary_write_score(fh, 8, -3, 10, 12);
+  fclose(fh);
+
+  ASSERT((bin = binary_reader_open(path)) != NULL);
+
+  ASSERT(binary_reader_next(bin, &rec, &cigar));
+  ASSERT(rec->index == 7 && rec->score == result->score);
+  ASSERT(rec->pos_a == result->pos_a && rec->pos_b == result->pos_b);
+  ASSERT(rec->len_a == result->len_a && rec->len_b == result->len_b);
+  ASSERT(rec->n_cigar == result->cigar.n);
+  ASSERT(memcmp(cigar, result->cigar.ops, rec->n_cigar*sizeof(uint32_t)) == 0);
+  ASSERT(((size_t)rec & 7) == 0);
+
+  ASSERT(binary_reader_next(bin, &rec, &cigar));
+  ASSERT(((size_t)rec & 7) == 0);
+  ASSERT(rec->index == 8 && rec->score == -3 && rec->n_cigar == 0);
+  ASSERT(rec->len_a == 10 && rec->len_b == 12);
+
+  ASSERT(!binary_reader_next(bin, &rec, &cigar));
+  binary_reader_close(bin);
+
+  // Not a binary results file
+  fh = fopen(path, "w");
+  fputs(">seq\nACGTACGTACGTACGTACGT\n", fh);
+  fclose(fh);
+  ASSERT(binary_reader_open(path) == NULL);
+
+  unlink(path);
+  alignment_free(result);
+  smith_waterman_free(sw);
+}
+
+void test_input()
+{
+  SUITE_START("Input files");
+
+  gzip_test_reader();
+  mmap_test_reader();
+  binary_test_reader();
 
   SUITE_END();
 }
@@ -292,8 +1365,11 @@ int main(int argc, char **argv)
   printf("  Test seq-align C library:\n\n");
 
   // Test suites go here
+  test_scoring();
   test_nw();
   test_sw();
+  test_extend();
+  test_input();
 
   printf("\n");
   printf(" %i / %i suites failed\n", suites_failed, suites_run);